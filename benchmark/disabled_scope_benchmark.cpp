@@ -0,0 +1,51 @@
+#include <benchmark/benchmark.h>
+
+#include "cxxtrace/cxxtrace.h"
+
+using namespace neon;
+
+// Cost of a scope while tracing is off. The bodies are kept out of line so
+// every variant runs the same call and loop around the instrumentation.
+
+__attribute__((noinline)) static int untraced(int value) {
+    benchmark::DoNotOptimize(value);
+    return value + 1;
+}
+
+__attribute__((noinline)) static int traced(int value) {
+    TRACE_SCOPE(disabled_scope);
+    benchmark::DoNotOptimize(value);
+    return value + 1;
+}
+
+__attribute__((noinline)) static int traced_leveled(int value) {
+    TRACE_SCOPE_L(kDebug, 0x1u, disabled_leveled_scope);
+    benchmark::DoNotOptimize(value);
+    return value + 1;
+}
+
+// the out-of-line calls every site made before the jump labels
+__attribute__((noinline)) static int traced_section(int value) {
+    static const TraceSiteId site =
+        TraceRegisterSite("disabled_section", SourceLocation::current());
+    TraceSectionBegin(site);
+    benchmark::DoNotOptimize(value);
+    TraceSectionEnd(site);
+    return value + 1;
+}
+
+template <int (*Function)(int)>
+static void BM_DisabledScope(benchmark::State& state) {
+    int value = 0;
+    for (auto _ : state) {
+        value = Function(value);
+    }
+    benchmark::DoNotOptimize(value);
+}
+
+BENCHMARK_TEMPLATE(BM_DisabledScope, untraced)->Name("BM_NoInstrumentation");
+BENCHMARK_TEMPLATE(BM_DisabledScope, traced)->Name("BM_DisabledTraceScope");
+BENCHMARK_TEMPLATE(BM_DisabledScope, traced_leveled)
+    ->Name("BM_DisabledLeveledScope");
+BENCHMARK_TEMPLATE(BM_DisabledScope, traced_section)
+    ->Name("BM_DisabledSectionCalls");
@@ -0,0 +1,56 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "event_block.h"
+
+using namespace neon;
+
+// A full block of back to back scopes, as the writer produces them.
+static std::vector<std::uint8_t> typical_block() {
+    std::vector<format::EventRecord> events(format::kEventBlockEvents);
+    std::int64_t ts = 1234567890123;
+    for (std::uint32_t i = 0; i < events.size(); ++i) {
+        format::EventRecord& event = events[i];
+        event.type = format::EventType::kScopeComplete;
+        event.tid = 1;
+        event.site_id = 1 + i % 5;
+        event.depth = static_cast<std::uint16_t>(i % 3);
+        event.weight = 1;
+        event.ts = ts;
+        event.duration = 3000 + (i * 7919) % 9000;
+        event.task_clock_ns = event.duration / 3;
+        ts += event.duration + 150;
+    }
+    std::vector<std::uint8_t> payload;
+    format::EncodeEventBlock(events.data(), events.size(), false, payload);
+    return payload;
+}
+
+static void BM_DecodeEventBlock(benchmark::State& state) {
+    const auto payload = typical_block();
+    std::vector<format::EventRecord> events;
+    for (auto _ : state) {
+        events.clear();
+        format::DecodeEventBlock(payload.data(), payload.size(), events);
+        benchmark::DoNotOptimize(events.data());
+    }
+    state.SetItemsProcessed(state.iterations() * format::kEventBlockEvents);
+    state.counters["bytes_per_event"] =
+        static_cast<double>(payload.size()) / format::kEventBlockEvents;
+}
+BENCHMARK(BM_DecodeEventBlock);
+
+static void BM_EncodeEventBlock(benchmark::State& state) {
+    const auto payload = typical_block();
+    std::vector<format::EventRecord> events;
+    format::DecodeEventBlock(payload.data(), payload.size(), events);
+    std::vector<std::uint8_t> out;
+    for (auto _ : state) {
+        out.clear();
+        format::EncodeEventBlock(events.data(), events.size(), false, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * format::kEventBlockEvents);
+}
+BENCHMARK(BM_EncodeEventBlock);
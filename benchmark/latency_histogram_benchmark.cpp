@@ -0,0 +1,44 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "latency_histogram.h"
+
+using namespace neon;
+
+// Durations spread over a few octaves, as a busy scope would produce.
+static std::vector<std::uint64_t> durations() {
+    std::vector<std::uint64_t> values(4096);
+    std::uint64_t random = 0x9e3779b97f4a7c15ull;
+    for (auto& value : values) {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        value = 200 + (random & 0xffff);
+    }
+    return values;
+}
+
+static void BM_HistogramRecord(benchmark::State& state) {
+    static LatencyHistogram histogram;
+    const auto values = durations();
+    std::size_t i = 0;
+    for (auto _ : state) {
+        histogram.record(values[i++ & 4095], 1);
+    }
+}
+BENCHMARK(BM_HistogramRecord);
+
+// per-thread site lookup plus the wall and task clock histograms
+static void BM_LatencyHistogramsRecord(benchmark::State& state) {
+    const TraceSiteId site =
+        TraceRegisterSite("histogram_benchmark", SourceLocation::current());
+    const auto values = durations();
+    std::size_t i = 0;
+    for (auto _ : state) {
+        const std::uint64_t value = values[i++ & 4095];
+        LatencyHistograms::record(site, value, value / 2, 1);
+    }
+}
+BENCHMARK(BM_LatencyHistogramsRecord);
@@ -0,0 +1,69 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+
+#include "malloc_hook.h"
+#include "thread_counts.h"
+#include "thread_info.h"
+
+using namespace neon;
+
+// malloc/free of state.range(0) bytes as the program sees them once
+// MallocInterposition has replaced its PLT entries. The hook cannot be
+// removed again, so the unhooked baseline calls glibc's own entry points,
+// which do not go through the PLT.
+#if defined(__linux__) && defined(__GLIBC__)
+
+extern "C" void* __libc_malloc(std::size_t size);
+extern "C" void __libc_free(void* pointer);
+
+static void BM_UnhookedMallocFree(benchmark::State& state) {
+    const auto size = static_cast<std::size_t>(state.range(0));
+    for (auto _ : state) {
+        void* pointer = __libc_malloc(size);
+        benchmark::DoNotOptimize(pointer);
+        __libc_free(pointer);
+    }
+}
+BENCHMARK(BM_UnhookedMallocFree)->Arg(16)->Arg(4096)->Apply(thread_counts);
+
+// hooked, interposition disabled: the wrapper and the flag check
+static void install_disabled(benchmark::State const&) {
+    MallocInterposition::install();
+    MallocInterposition::disable();
+}
+
+// hooked, counting into the per-thread heap statistics as tracing does
+static void install_listener(benchmark::State const&) {
+    ThreadInfo::enable_malloc_statistics();
+    MallocInterposition::enable();
+}
+
+static void remove_listener(benchmark::State const&) {
+    MallocInterposition::disable();
+    ThreadInfo::disable_malloc_statistics();
+}
+
+static void BM_MallocFree(benchmark::State& state) {
+    const auto size = static_cast<std::size_t>(state.range(0));
+    for (auto _ : state) {
+        void* pointer = std::malloc(size);
+        benchmark::DoNotOptimize(pointer);
+        std::free(pointer);
+    }
+}
+BENCHMARK(BM_MallocFree)
+    ->Name("BM_HookedMallocFreeDisabled")
+    ->Setup(install_disabled)
+    ->Arg(16)
+    ->Arg(4096)
+    ->Apply(thread_counts);
+BENCHMARK(BM_MallocFree)
+    ->Name("BM_HookedMallocFree")
+    ->Setup(install_listener)
+    ->Teardown(remove_listener)
+    ->Arg(16)
+    ->Arg(4096)
+    ->Apply(thread_counts);
+
+#endif
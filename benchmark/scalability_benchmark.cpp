@@ -0,0 +1,246 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "call_tree_log.h"
+#include "flight_recorder_log.h"
+#include "latency_histogram.h"
+#include "ring_buffer_log.h"
+#include "structlog.h"
+#include "thread_counts.h"
+
+using namespace neon;
+
+// Every recording backend driven by 1..N threads that record nested scopes
+// straight into it, without the clock and counter reads of TraceSection*;
+// the queued backends with Overflow::kDropNewest and with kBlock.
+// The backend is created for each run, so all of them compare in one
+// process. Besides time per nesting and items_per_second (events over all
+// threads), a run reports:
+//   p50_ns, p99_ns, p999_ns  one record() call, including a clock read
+//   drop_rate                events dropped per event recorded
+//   stall_rate               waits for a full queue per event (kBlock)
+//   queue_peak               most events in the shared queue (StructLog)
+//   lock_wait_rate           contended backend locks per event
+
+namespace {
+
+constexpr int kDepth = 4;
+const char* const kPath = "scalability_benchmark.bin";
+
+TraceOption::Backend backend(benchmark::State const& state) {
+    return static_cast<TraceOption::Backend>(state.range(0));
+}
+
+TraceOption::Overflow overflow(benchmark::State const& state) {
+    return static_cast<TraceOption::Overflow>(state.range(1));
+}
+
+void backends(benchmark::internal::Benchmark* bench) {
+    using Backend = TraceOption::Backend;
+    using Overflow = TraceOption::Overflow;
+    bench->ArgNames({"backend", "overflow"});
+    for (Backend backend : {Backend::kStructLog, Backend::kRingBuffer}) {
+        for (Overflow overflow : {Overflow::kDropNewest, Overflow::kBlock}) {
+            bench->Args(
+                {static_cast<int>(backend), static_cast<int>(overflow)});
+        }
+    }
+    for (Backend backend : {Backend::kCallTree, Backend::kFlightRecorder}) {
+        bench->Args({static_cast<int>(backend),
+                     static_cast<int>(Overflow::kDropNewest)});
+    }
+}
+
+ClockCalibration const& calibration() {
+    static const ClockCalibration calibration = TraceClock::calibrate(
+        TraceClock::resolve(TraceOption::Clock::kCpuCounter));
+    return calibration;
+}
+
+// One run at a time, shared by its threads. The backend lives for the
+// whole run, the rest covers one trial of it: benchmark calls the function
+// again with more iterations until the run is long enough.
+struct Run {
+    std::unique_ptr<Recorder> recorder;
+    std::mutex mutex;
+    std::vector<std::uint64_t> latency;  // LatencyHistogram buckets
+    std::uint64_t latency_max{0};
+    std::uint64_t events{0};
+    std::atomic<int> merged{0};
+    // the backend's counts when the trial started
+    std::uint64_t dropped{0};
+    TraceContention contention{};
+};
+Run g_run_;
+
+// by the first thread, before the others may pass the start of the loop
+void start_trial() {
+    g_run_.latency.assign(LatencyHistogram::kBuckets, 0);
+    g_run_.latency_max = 0;
+    g_run_.events = 0;
+    g_run_.merged = 0;
+    g_run_.dropped = g_run_.recorder->dropped_events();
+    g_run_.contention = g_run_.recorder->contention();
+}
+
+void create_backend(benchmark::State const& state) {
+    switch (backend(state)) {
+        case TraceOption::Backend::kRingBuffer: {
+            RingBufferLog::CreateOption option;
+            option.overflow = overflow(state);
+            option.file_name = kPath;
+            option.calibration = calibration();
+            g_run_.recorder.reset(new RingBufferLog{option});
+            break;
+        }
+        case TraceOption::Backend::kCallTree: {
+            CallTreeLog::CreateOption option;
+            option.file_name = kPath;
+            // often enough that short runs see the dump's lock
+            option.dump_interval = std::chrono::milliseconds(100);
+            option.calibration = calibration();
+            g_run_.recorder.reset(new CallTreeLog{option});
+            break;
+        }
+        case TraceOption::Backend::kFlightRecorder: {
+            FlightRecorderLog::CreateOption option;
+            option.file_name = kPath;
+            option.calibration = calibration();
+            g_run_.recorder.reset(new FlightRecorderLog{option});
+            break;
+        }
+        case TraceOption::Backend::kStructLog:
+        default: {
+            StructLog::CreateOption option;
+            option.overflow = overflow(state);
+            option.file_name = kPath;
+            option.calibration = calibration();
+            g_run_.recorder.reset(new StructLog{option});
+            break;
+        }
+    }
+}
+
+void destroy_backend(benchmark::State const& state) {
+    g_run_.recorder.reset();
+    if (backend(state) == TraceOption::Backend::kStructLog) {
+        // the queue worker holds the writer until it has drained
+        spdlog::shutdown();
+    }
+    std::remove(kPath);
+}
+
+void report(benchmark::State& state) {
+    static const char* const kBackends[] = {"StructLog", "RingBuffer",
+                                            "CallTree", "FlightRecorder"};
+    const bool queued = backend(state) == TraceOption::Backend::kStructLog ||
+                        backend(state) == TraceOption::Backend::kRingBuffer;
+    const bool block =
+        queued && overflow(state) == TraceOption::Overflow::kBlock;
+    state.SetLabel(std::string{kBackends[state.range(0)]} +
+                   (block ? "/block" : ""));
+    Recorder const& recorder = *g_run_.recorder;
+    const double events = static_cast<double>(g_run_.events);
+    const double ns_per_tick = calibration().ns_per_tick;
+    auto latency = [ns_per_tick](double q) {
+        std::uint64_t total = 0;
+        for (std::uint64_t count : g_run_.latency) {
+            total += count;
+        }
+        return static_cast<double>(LatencyHistogram::quantile(
+                   g_run_.latency, total, q, g_run_.latency_max)) *
+               ns_per_tick;
+    };
+    state.counters["p50_ns"] = latency(0.5);
+    state.counters["p99_ns"] = latency(0.99);
+    state.counters["p999_ns"] = latency(0.999);
+    const TraceContention contention = recorder.contention();
+    auto rate = [events](std::uint64_t count, std::uint64_t before) {
+        return static_cast<double>(count - before) / events;
+    };
+    state.counters["drop_rate"] =
+        rate(recorder.dropped_events(), g_run_.dropped);
+    state.counters["stall_rate"] =
+        rate(contention.full_waits, g_run_.contention.full_waits);
+    state.counters["queue_peak"] =
+        static_cast<double>(contention.queue_peak);
+    state.counters["lock_wait_rate"] =
+        rate(contention.lock_waits, g_run_.contention.lock_waits);
+}
+
+}  // namespace
+
+static void BM_RecordNestedScopes(benchmark::State& state) {
+    static const TraceSiteId sites[kDepth] = {
+        TraceRegisterSite("scalability_0", SourceLocation::current()),
+        TraceRegisterSite("scalability_1", SourceLocation::current()),
+        TraceRegisterSite("scalability_2", SourceLocation::current()),
+        TraceRegisterSite("scalability_3", SourceLocation::current()),
+    };
+    const auto clock = calibration().clock;
+    Recorder& recorder = *g_run_.recorder;
+    const bool begins = recorder.wants_scope_begin();
+    const std::uint32_t tid = ThreadInfo::current().tid();
+    LatencyHistogram latency;
+    if (state.thread_index() == 0) {
+        start_trial();
+    }
+    auto record = [&](TraceEvent const& event) {
+        const std::int64_t start = TraceClock::now(clock);
+        recorder.record(event);
+        latency.record(
+            static_cast<std::uint64_t>(TraceClock::now(clock) - start), 1);
+    };
+    std::int64_t starts[kDepth];
+    for (auto _ : state) {
+        for (int depth = 0; depth < kDepth; ++depth) {
+            starts[depth] = TraceClock::now(clock);
+            if (begins) {
+                TraceEvent event{TraceEvent::Type::kScopeBegin, sites[depth]};
+                event.tid = tid;
+                event.depth = static_cast<std::uint32_t>(depth);
+                event.ts = starts[depth];
+                record(event);
+            }
+        }
+        for (int depth = kDepth - 1; depth >= 0; --depth) {
+            TraceEvent event{TraceEvent::Type::kScopeComplete, sites[depth]};
+            event.tid = tid;
+            event.depth = static_cast<std::uint32_t>(depth);
+            event.ts = starts[depth];
+            event.duration = TraceClock::now(clock) - starts[depth];
+            record(event);
+        }
+    }
+    const std::int64_t events =
+        state.iterations() * kDepth * (begins ? 2 : 1);
+    state.SetItemsProcessed(events);
+
+    {
+        std::lock_guard<std::mutex> lock(g_run_.mutex);
+        latency.add_to(g_run_.latency, g_run_.latency_max);
+        g_run_.events += static_cast<std::uint64_t>(events);
+    }
+    g_run_.merged.fetch_add(1, std::memory_order_acq_rel);
+    if (state.thread_index() == 0) {
+        while (g_run_.merged.load(std::memory_order_acquire) !=
+               state.threads()) {
+            std::this_thread::yield();
+        }
+        report(state);
+    }
+}
+BENCHMARK(BM_RecordNestedScopes)
+    ->Apply(backends)
+    ->Setup(create_backend)
+    ->Teardown(destroy_backend)
+    ->Apply(thread_counts)
+    ->UseRealTime();
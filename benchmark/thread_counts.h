@@ -0,0 +1,22 @@
+#pragma once
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+// Runs a benchmark on 1, 2, 4 ... threads and on all hardware threads, so
+// that contention shows up next to the single thread cost. The environment
+// variable CXXTRACE_BENCH_THREADS raises or lowers the top, e.g. to 128 for
+// the thread count of a service on a smaller machine.
+inline void thread_counts(benchmark::internal::Benchmark* bench) {
+    int max =
+        static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    if (const char* threads = std::getenv("CXXTRACE_BENCH_THREADS")) {
+        max = std::max(1, std::atoi(threads));
+    }
+    for (int threads = 1; threads < max; threads *= 2) {
+        bench->Threads(threads);
+    }
+    bench->Threads(max);
+}
@@ -0,0 +1,106 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <string>
+
+#include "thread_counts.h"
+#include "thread_info.h"
+#if defined(__linux__)
+#include "perf_event.h"
+#endif
+
+using namespace neon;
+
+// The per-thread reads every recorded scope makes on both ends.
+
+static void BM_ThreadInfoCurrent(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(&ThreadInfo::current());
+    }
+}
+BENCHMARK(BM_ThreadInfoCurrent)->Apply(thread_counts);
+
+template <typename Value, Value (ThreadInfo::*Getter)() const>
+static void BM_ThreadInfoGetter(benchmark::State& state) {
+    ThreadInfo const& thread = ThreadInfo::current();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize((thread.*Getter)());
+    }
+}
+BENCHMARK_TEMPLATE(BM_ThreadInfoGetter, std::uint32_t, &ThreadInfo::tid)
+    ->Name("BM_ThreadInfoTid")
+    ->Apply(thread_counts);
+BENCHMARK_TEMPLATE(BM_ThreadInfoGetter, std::string, &ThreadInfo::name)
+    ->Name("BM_ThreadInfoName")
+    ->Apply(thread_counts);
+BENCHMARK_TEMPLATE(BM_ThreadInfoGetter, std::int64_t,
+                   &ThreadInfo::task_clock_ns)
+    ->Name("BM_ThreadInfoTaskClock")
+    ->Apply(thread_counts);
+BENCHMARK_TEMPLATE(BM_ThreadInfoGetter, std::uint64_t,
+                   &ThreadInfo::allocated_heap_bytes)
+    ->Name("BM_ThreadInfoAllocatedHeapBytes")
+    ->Apply(thread_counts);
+BENCHMARK_TEMPLATE(BM_ThreadInfoGetter, std::uint64_t,
+                   &ThreadInfo::deallocated_heap_bytes)
+    ->Name("BM_ThreadInfoDeallocatedHeapBytes")
+    ->Apply(thread_counts);
+
+static void enable_hardware_counters(benchmark::State const&) {
+    ThreadInfo::enable_hardware_counters();
+}
+
+static void disable_hardware_counters(benchmark::State const&) {
+    ThreadInfo::disable_hardware_counters();
+}
+
+// one group read of all counters
+static void BM_ThreadInfoHardwareCounters(benchmark::State& state) {
+    ThreadInfo const& thread = ThreadInfo::current();
+    HardwareCounters counters;
+    if (!thread.hardware_counters(counters)) {
+        state.SkipWithError("hardware counters are not available");
+    }
+    for (auto _ : state) {
+        thread.hardware_counters(counters);
+        benchmark::DoNotOptimize(counters);
+    }
+}
+BENCHMARK(BM_ThreadInfoHardwareCounters)
+    ->Setup(enable_hardware_counters)
+    ->Teardown(disable_hardware_counters)
+    ->Apply(thread_counts);
+
+#if defined(__linux__)
+// The task clock's times read through read(2) and, with user_page:1, from
+// the mapped perf page, which falls back to read(2) when the kernel does not
+// set cap_user_time (the label says so).
+static void BM_PerfEventNow(benchmark::State& state) {
+    const auto read_mode = state.range(0) ? PerfEvent::ReadMode::kUserPage
+                                          : PerfEvent::ReadMode::kSyscall;
+    auto event = PerfEvent::create(PerfEvent::TypeID::SOFTWARE,
+                                   PerfEvent::Config::SW_TASK_CLOCK,
+                                   PerfEvent::Domain::USER, read_mode);
+    if (!event) {
+        state.SkipWithError("perf_event_open failed");
+    } else {
+        event->enable();
+        // the user page leaves the value at 0, read() fills it in
+        PerfEvent::Count probe{};
+        event->now_times(probe);
+        if (read_mode == PerfEvent::ReadMode::kUserPage && probe.value != 0) {
+            state.SetLabel("read(2) fallback");
+        }
+    }
+    PerfEvent::Count count{};
+    for (auto _ : state) {
+        event->now_times(count);
+        benchmark::DoNotOptimize(count);
+    }
+}
+BENCHMARK(BM_PerfEventNow)
+    ->ArgName("user_page")
+    ->Arg(0)
+    ->Arg(1)
+    ->Apply(thread_counts);
+#endif
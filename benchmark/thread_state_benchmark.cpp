@@ -0,0 +1,94 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <memory>
+
+#include "recorder.h"
+#include "scope_stack.h"
+#include "thread_counts.h"
+#include "thread_info.h"
+
+using namespace neon;
+
+// The per-thread reads of one event: ThreadInfo::current() and the getters
+// take_snapshot calls, less the task clock and hardware counters, whose
+// perf reads would hide the cost of reaching the thread's state.
+static void BM_ThreadSnapshot(benchmark::State& state) {
+    for (auto _ : state) {
+        ThreadInfo const& thread = ThreadInfo::current();
+        benchmark::DoNotOptimize(thread.tid());
+        benchmark::DoNotOptimize(thread.allocated_heap_bytes());
+        benchmark::DoNotOptimize(thread.deallocated_heap_bytes());
+    }
+}
+BENCHMARK(BM_ThreadSnapshot)->Apply(thread_counts);
+
+namespace {
+
+// ThreadInfo as it was before the flat block, for comparison: a guarded
+// thread_local object referring to a second one that owns the perf handle,
+// with out-of-line getters.
+class LegacyThreadInfo {
+   public:
+    class Impl {
+       public:
+        static Impl& current() {
+            static thread_local Impl instance;
+            return instance;
+        }
+        std::uint32_t tid{1};
+        std::unique_ptr<int> event{new int{0}};
+        std::uint64_t allocated_bytes{0};
+        std::uint64_t deallocated_bytes{0};
+    };
+    __attribute__((noinline)) static LegacyThreadInfo const& current() {
+        static thread_local LegacyThreadInfo instance;
+        return instance;
+    }
+    __attribute__((noinline)) std::uint32_t tid() const { return impl_.tid; }
+    __attribute__((noinline)) std::uint64_t allocated_heap_bytes() const {
+        return impl_.allocated_bytes;
+    }
+    __attribute__((noinline)) std::uint64_t deallocated_heap_bytes() const {
+        return impl_.deallocated_bytes;
+    }
+
+   private:
+    LegacyThreadInfo() : impl_{Impl::current()} {}
+    Impl& impl_;
+};
+
+}  // namespace
+
+static void BM_LegacyThreadSnapshot(benchmark::State& state) {
+    for (auto _ : state) {
+        LegacyThreadInfo const& thread = LegacyThreadInfo::current();
+        benchmark::DoNotOptimize(thread.tid());
+        benchmark::DoNotOptimize(thread.allocated_heap_bytes());
+        benchmark::DoNotOptimize(thread.deallocated_heap_bytes());
+    }
+}
+BENCHMARK(BM_LegacyThreadSnapshot)->Apply(thread_counts);
+
+namespace {
+class NullRecorder : public Recorder {
+   public:
+    void record(TraceEvent const& event) override {
+        benchmark::DoNotOptimize(&event);
+    }
+};
+}  // namespace
+
+// a scope on the shadow stack: push, match and pop, without recording
+static void BM_ScopeStackBeginEnd(benchmark::State& state) {
+    const TraceSiteId site =
+        TraceRegisterSite("scope_stack_benchmark", SourceLocation::current());
+    NullRecorder recorder;
+    TraceEvent begin{TraceEvent::Type::kScopeBegin, site};
+    TraceEvent end{TraceEvent::Type::kScopeComplete, site};
+    for (auto _ : state) {
+        ScopeStack::begin(begin);
+        ScopeStack::end(end, 0, false, recorder);
+    }
+}
+BENCHMARK(BM_ScopeStackBeginEnd)->Apply(thread_counts);
@@ -0,0 +1,72 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <vector>
+
+#include "trace_format.h"
+#include "trace_output.h"
+#if defined(__linux__)
+#include "uring_output.h"
+#endif
+
+using namespace neon;
+
+using OpenOutput = std::unique_ptr<TraceOutput> (*)(const char* path);
+
+// One event record with its header, the unit TraceWriter writes, until
+// about 1 GiB has gone to the file.
+static void write_events(benchmark::State& state, OpenOutput open) {
+    const char* path = "trace_output_benchmark.bin";
+    constexpr std::size_t kRecordSize =
+        sizeof(format::RecordHeader) + sizeof(format::EventRecord);
+    constexpr std::size_t kRecords = (std::size_t{1} << 30) / kRecordSize;
+    std::vector<char> record(kRecordSize, 'e');
+    for (auto _ : state) {
+        auto output = open(path);
+        if (!output) {
+            state.SkipWithError("cannot create the output file");
+            break;
+        }
+        for (std::size_t i = 0; i < kRecords; ++i) {
+            output->write(record.data(), record.size());
+        }
+        // includes the writeback the output started, not the whole of it
+        output.reset();
+    }
+    state.SetBytesProcessed(state.iterations() * kRecords * kRecordSize);
+    std::remove(path);
+}
+
+// the output of the StructLog and RingBuffer backends before kMappedFile
+static void BM_StdioOutput(benchmark::State& state) {
+    write_events(state, [](const char* path) {
+        return TraceOutput::open(path, TraceOption::Output::kStdio);
+    });
+}
+BENCHMARK(BM_StdioOutput)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_MappedFileOutput(benchmark::State& state) {
+    write_events(state, [](const char* path) {
+        return TraceOutput::open(path, TraceOption::Output::kMappedFile);
+    });
+}
+BENCHMARK(BM_MappedFileOutput)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+#if defined(__linux__)
+static void BM_UringOutput(benchmark::State& state) {
+    write_events(state, [](const char* path) {
+        return TraceOutput::open(path, TraceOption::Output::kUring);
+    });
+}
+BENCHMARK(BM_UringOutput)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// the fallback without io_uring: blocking pwritev of the filled buffers
+static void BM_PwritevOutput(benchmark::State& state) {
+    write_events(state, [](const char* path) {
+        UringOutput::CreateOption option;
+        option.use_io_uring = false;
+        return std::unique_ptr<TraceOutput>(UringOutput::open(path, option));
+    });
+}
+BENCHMARK(BM_PwritevOutput)->Unit(benchmark::kMillisecond)->UseRealTime();
+#endif
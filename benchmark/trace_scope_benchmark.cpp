@@ -0,0 +1,99 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+
+#include "cxxtrace/cxxtrace.h"
+#include "thread_counts.h"
+
+using namespace neon;
+
+// Cost of a scope while tracing is on. Events go to the per-thread rings of
+// the RingBuffer backend, so threads do not contend on a shared queue; a
+// full ring drops the event, which dropped_per_op reports. The trace is
+// rotated under a total size limit so that long runs do not fill the disk.
+
+static bool g_tracing_{false};
+static std::uint64_t g_dropped_before_{0};
+
+static void enable_tracing(benchmark::State const&) {
+    TraceOption option;
+    option.backend = TraceOption::Backend::kRingBuffer;
+    option.file_name = "cxxtrace_bench.bin";
+    option.rotate_bytes = std::uint64_t{64} << 20;
+    option.max_total_bytes = std::uint64_t{256} << 20;
+    TraceEnable(option);
+    g_dropped_before_ = TraceDroppedEvents();
+    g_tracing_ = true;
+}
+
+static void disable_tracing(benchmark::State const&) {
+    TraceDisable();
+    g_tracing_ = false;
+}
+
+// every thread has left the loop when the first one gets here
+static void report_dropped(benchmark::State& state) {
+    if (g_tracing_ && state.thread_index() == 0) {
+        state.counters["dropped_per_op"] = benchmark::Counter(
+            static_cast<double>(TraceDroppedEvents() - g_dropped_before_),
+            benchmark::Counter::kAvgIterations);
+    }
+}
+
+__attribute__((noinline)) static int traced(int value) {
+    TRACE_SCOPE(enabled_scope);
+    benchmark::DoNotOptimize(value);
+    return value + 1;
+}
+
+static void BM_EnabledTraceScope(benchmark::State& state) {
+    int value = 0;
+    for (auto _ : state) {
+        value = traced(value);
+    }
+    benchmark::DoNotOptimize(value);
+    report_dropped(state);
+}
+BENCHMARK(BM_EnabledTraceScope)
+    ->Setup(enable_tracing)
+    ->Teardown(disable_tracing)
+    ->Apply(thread_counts);
+
+struct Callee {
+    __attribute__((noinline)) int next(int value) {
+        benchmark::DoNotOptimize(value);
+        return value + 1;
+    }
+};
+
+// the same call through a plain pointer, the baseline of BM_TraceWrap
+static void BM_PointerCall(benchmark::State& state) {
+    Callee callee;
+    Callee* pointer = &callee;
+    benchmark::DoNotOptimize(pointer);
+    int value = 0;
+    for (auto _ : state) {
+        value = pointer->next(value);
+    }
+    benchmark::DoNotOptimize(value);
+}
+BENCHMARK(BM_PointerCall)->Apply(thread_counts);
+
+// every call through WrapPtr::operator-> opens and closes a section
+static void BM_TraceWrap(benchmark::State& state) {
+    Callee callee;
+    auto pointer =
+        traceWrap("wrap_benchmark", SourceLocation::current(), &callee);
+    int value = 0;
+    for (auto _ : state) {
+        value = pointer->next(value);
+    }
+    benchmark::DoNotOptimize(value);
+    report_dropped(state);
+}
+BENCHMARK(BM_TraceWrap)->Name("BM_DisabledTraceWrap")->Apply(thread_counts);
+BENCHMARK(BM_TraceWrap)
+    ->Name("BM_EnabledTraceWrap")
+    ->Setup(enable_tracing)
+    ->Teardown(disable_tracing)
+    ->Apply(thread_counts);
@@ -23,6 +23,11 @@ const router = createRouter({
       name: 'tags',
       component: () => import('../views/TagsView.vue'),
     },
+    {
+      path: '/latency',
+      name: 'latency',
+      component: () => import('../views/LatencyView.vue'),
+    },
     {
       path: '/timeline',
       name: 'timeline',
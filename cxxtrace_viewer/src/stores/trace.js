@@ -1,29 +1,38 @@
 import { defineStore } from 'pinia'
 import { buildAllThreadFlamegraph, buildTagsCost } from '../utils/traceProcessor'
 
+// hardware counters are only present when the trace recorded them
+const COUNTER_METRICS = ['cycles', 'instructions', 'llc_misses', 'branch_misses', 'dtlb_misses']
+
 export const useTraceStore = defineStore('trace', {
   state: () => ({
     traceData: null,
-    flamegraphs: null
+    flamegraphs: null,
+    latencies: [],
+    losses: [],
+    metrics: []
   }),
   actions: {
     setTraceData(data) {
         this.traceData = data
-        this.flamegraphs ={
-          'ts': buildAllThreadFlamegraph(data, 'ts'),
-          'task_clock': buildAllThreadFlamegraph(data, 'task_clock'),
-          'alloc': buildAllThreadFlamegraph(data, 'alloc'),
-          'dealloc': buildAllThreadFlamegraph(data, 'dealloc')
-        },
-        this.tags_self_cost = {
-            'ts': buildTagsCost(this.flamegraphs['ts']),
-            'task_clock': buildTagsCost(this.flamegraphs['task_clock']),
-            'alloc': buildTagsCost(this.flamegraphs['alloc']),
-            'dealloc': buildTagsCost(this.flamegraphs['dealloc'])
-        }
+        // 延迟直方图统计(每个tag一条)排在作用域事件之后
+        this.latencies = data.filter(event => event.event === 'latency')
+        // 队列满时丢弃的事件，[ts, ts + dur] 区间内该线程的数据不完整
+        this.losses = data.filter(event => event.event === 'lost')
+        data = data.filter(event => event.event === 'X')
+        const first = data.length > 0 ? data[0] : {}
+        this.metrics = ['ts', 'task_clock', 'alloc', 'dealloc']
+          .concat(COUNTER_METRICS.filter(metric => metric in first))
+        this.flamegraphs = {}
+        this.tags_self_cost = {}
+        this.metrics.forEach(metric => {
+          this.flamegraphs[metric] = buildAllThreadFlamegraph(data, metric)
+          this.tags_self_cost[metric] = buildTagsCost(this.flamegraphs[metric])
+        })
     }
   },
   getters: {
-    getFlamegraphs: (state) => state.flamegraphs
+    getFlamegraphs: (state) => state.flamegraphs,
+    lostEvents: (state) => state.losses.reduce((sum, loss) => sum + loss.count, 0)
   }
 })
@@ -1,5 +1,6 @@
 /**
  * 处理trace_event数据，按线程聚类并生成火焰图和调用图所需数据结构
+ * 每个作用域是一个完整事件(X)，同一线程内按结束顺序排列，无需排序
  * @param {Array} traceEvents - 原始trace事件数组
  * @returns {Object} 包含线程数据和转换后结构的对象
  */
@@ -13,15 +14,6 @@ export function buildAllThreadFlamegraph(traceEvents, metric) {
     threads[event.tid].push(event);
   });
 
-  Object.keys(threads).forEach(tid => {
-    threads[tid].sort((a, b) => {
-        if (a.ts === b.ts) {
-          return a.event === 'B' ? -1 : 1;
-        }
-        return a.ts - b.ts;
-    });
-  });
-
   // 2. 为每个线程构建火焰图数据结构
   const flameGraphData = {};
   Object.keys(threads).forEach(tid => {
@@ -31,34 +23,41 @@ export function buildAllThreadFlamegraph(traceEvents, metric) {
   return flameGraphData
 }
 
+function metricValue(event, metric) {
+  const value = metric === 'ts' ? event.dur : event[metric];
+  // 采样记录的作用域代表 weight 次调用
+  return value * (event.weight || 1);
+}
+
 /**
  * 构建火焰图数据结构
+ * 子作用域先于父作用域结束，pending[depth] 收集等待父节点的已结束节点
  * @param {Array} events - 单个线程的事件数组
  * @returns {Object} 火焰图数据结构
  */
 function buildFlameGraph(events, metric) {
-  const stack = [];
   const root = {name: 'root', value: 0, children: []};
+  const pending = [];
 
   events.forEach(event => {
-    if (event.event === 'B') {
-      const node = {
-        name: event.tag,
-        value: 0,
-        children: [],
-        startValue: event[metric]
-      };
-
-      if (stack.length > 0) {
-        stack[stack.length - 1].children.push(node);
-      } else {
-        root.children.push(node);
-      }
-
-      stack.push(node);
-    } else if (event.event === 'E' && stack.length > 0) {
-      const node = stack.pop();
-      node.value = event[metric] - node.startValue;
+    if (event.event !== 'X') {
+      return;
+    }
+    const node = {
+      name: event.tag,
+      value: metricValue(event, metric),
+      children: pending[event.depth + 1] || []
+    };
+    pending[event.depth + 1] = [];
+    if (!pending[event.depth]) {
+      pending[event.depth] = [];
+    }
+    pending[event.depth].push(node);
+  });
+  // 父作用域未结束(或未被记录)的节点挂在根节点下
+  pending.forEach(nodes => {
+    if (nodes) {
+      root.children.push(...nodes);
     }
   });
 
@@ -68,8 +67,6 @@ function buildFlameGraph(events, metric) {
     return acc;
   }, {value: 0})
   merged_root.value = sum.value;
-  console.log(metric)
-  console.log(merged_root.value)
   return merged_root;
 }
 
@@ -87,7 +84,8 @@ function mergeFlameGraphNode(node) {
       };
     } else {
       mergedChildren[child.name].value += child.value;
-      mergedChildren[child.name].children.concat(child.children);
+      mergedChildren[child.name].children =
+        mergedChildren[child.name].children.concat(child.children);
     }
   });
   node.children = Object.values(mergedChildren);
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+
+// Compile-time selection of leveled scopes (TRACE_SCOPE_L). Set through the
+// CXXTRACE_MIN_LEVEL / CXXTRACE_CATEGORIES CMake cache variables, or define
+// the macros before including cxxtrace.h. A scope below the level or outside
+// the categories expands to nothing: no site registration, no calls.
+
+// 0 verbose, 1 debug, 2 info, 3 compiles every leveled scope out
+#ifndef CXXTRACE_MIN_LEVEL
+#define CXXTRACE_MIN_LEVEL 0
+#endif
+
+#ifndef CXXTRACE_CATEGORIES
+#define CXXTRACE_CATEGORIES 0xffffffffu
+#endif
+
+namespace neon {
+
+enum class TraceLevel : std::uint8_t {
+    kVerbose = 0,
+    kDebug = 1,
+    kInfo = 2,
+};
+
+// One bit per category, the meaning of the bits is up to the application.
+using TraceCategory = std::uint32_t;
+constexpr TraceCategory kTraceAllCategories = 0xffffffffu;
+
+constexpr unsigned kTraceMinLevel = CXXTRACE_MIN_LEVEL;
+constexpr TraceCategory kTraceCategories = CXXTRACE_CATEGORIES;
+
+constexpr bool TraceCompiledIn(TraceLevel level, TraceCategory category) {
+    return static_cast<unsigned>(level) >= kTraceMinLevel &&
+           (category & kTraceCategories) != 0;
+}
+
+}  // namespace neon
@@ -1,36 +1,326 @@
 #pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "config.h"
 #include "location.h"
+#include "trace_key.h"
 #include "wrap.hpp"
 
 namespace neon {
 
 using Tag = const char*;
+// Small integer naming a (tag, source location) pair; events carry only this.
+using TraceSiteId = std::uint32_t;
+constexpr TraceSiteId kInvalidTraceSite = 0;
+
+// Which instances of a call site are recorded. A recorded scope carries its
+// sample weight, the number of calls it stands for, so that summed costs stay
+// unbiased. Scopes nested in a scope that was sampled out are dropped as well
+// unless they are `independent`: those are sampled on their own whatever
+// their parent, and weighted by their own period alone.
+struct TraceSampling {
+    enum class Mode {
+        kAll,
+        kEveryN,    // every period-th call of the site on each thread
+        kPoisson,   // each call with probability 1 / period
+        kInterval,  // at most one call per period microseconds and thread
+    };
+    Mode mode{Mode::kAll};
+    std::uint32_t period{1};
+    bool independent{false};
+};
+
+struct TraceOption {
+    enum class Backend {
+        kStructLog,   // the shared spdlog async queue
+        kRingBuffer,  // per-thread lock-free rings drained by one thread
+        kCallTree,    // per-thread calling-context trees, no events
+        // per-thread overwrite rings, written only on TraceDump, a signal
+        // or a crash
+        kFlightRecorder,
+    };
+    enum class Clock {
+        kSteady,             // std::chrono::steady_clock
+        kCpuCounter,         // rdtsc on x86-64, cntvct_el0 on aarch64
+        kCpuCounterOrdered,  // rdtscp / isb + cntvct_el0
+        kMonotonicCoarse,    // CLOCK_MONOTONIC_COARSE, jiffy resolution
+    };
+    enum class Output {
+        kStdio,  // buffered fwrite
+        // preallocated and mapped in large segments, written back by a
+        // background thread; kStdio on Windows
+        kMappedFile,
+        // large aligned buffers written through io_uring with O_DIRECT
+        // where possible, or pwritev without io_uring; Linux only,
+        // kMappedFile elsewhere
+        kUring,
+    };
+    // what recording does when the backend queue is full
+    enum class Overflow {
+        kBlock,            // the recording thread waits for room
+        kDropNewest,       // the new event is dropped
+        kOverwriteOldest,  // the oldest queued event makes room
+    };
+    Backend backend{Backend::kStructLog};
+    // Timestamp source. Events store raw ticks, the calibration goes into
+    // the trace header. Falls back to kSteady when the build or the CPU
+    // cannot provide it (e.g. no invariant TSC).
+    Clock clock{Clock::kCpuCounter};
+    // kRingBuffer and kFlightRecorder: events per thread ring, rounded up to
+    // a power of two; kStructLog: slots of the shared async queue
+    std::size_t ring_buffer_capacity{8192};
+    // kStructLog and kRingBuffer. Dropped events are counted per thread and
+    // written into the trace as "events lost" markers around the interval
+    // they belong to; TraceDroppedEvents() returns the total. kStructLog
+    // marks a thread's losses when its next event arrives.
+    Overflow overflow{Overflow::kDropNewest};
+    // kCallTree only: how often the aggregated trees are rewritten to
+    // file_name; they are always written at exit
+    std::uint32_t dump_interval_ms{1000};
+    // kFlightRecorder only: each dump keeps the events that ended in the
+    // last flight_recorder_window_ms, 0 keeps the whole rings. Dumps go to
+    // file_name with the dump number before the extension, cxxtrace.1.bin
+    // and so on.
+    std::uint32_t flight_recorder_window_ms{0};
+    // kFlightRecorder only, not on Windows: a signal that triggers a dump
+    // (e.g. SIGUSR2), 0 for none, and whether SIGSEGV, SIGBUS, SIGILL, SIGFPE
+    // and SIGABRT dump before the previous handler runs.
+    int dump_signal{0};
+    bool dump_on_crash{false};
+    // kStructLog and kRingBuffer: how the trace file is written. The dumps
+    // of the other backends are small and always use kStdio.
+    Output output{Output::kMappedFile};
+    // kStructLog and kRingBuffer: compress the trace in independent 1 MiB
+    // LZ4 blocks on this many threads, 0 for none. Blocks the threads cannot
+    // keep up with are stored as they are; cxxtrace_convert reads both.
+    std::uint32_t compression_threads{0};
+    // kStructLog and kRingBuffer: once file_name holds rotate_bytes (before
+    // compression) or has been open rotate_interval_ms, it is renamed to
+    // file_name with a number before the extension, cxxtrace.1.bin and so
+    // on, and a new file is started. Every file has its own header and
+    // string table and converts on its own. Numbering continues after the
+    // files an earlier run left. The oldest rotated files, those included,
+    // are deleted so that they and a full current file (the current file as
+    // it grows, with rotate_bytes 0) fit max_total_bytes.
+    // 0 disables each limit.
+    std::uint64_t rotate_bytes{0};
+    std::uint32_t rotate_interval_ms{0};
+    std::uint64_t max_total_bytes{0};
+    // binary trace, turn it into viewer json with cxxtrace_convert
+    std::string file_name{"cxxtrace.bin"};
+    // Linux only: also record cycles, instructions, LLC/branch/dTLB misses
+    // per event, read as one perf event group.
+    bool hardware_counters{false};
+    // applies to every site whose tag has no TraceSetSampling entry
+    TraceSampling sampling{};
+    // Scopes shorter than this are not written; their cost stays part of the
+    // enclosing scope, whose event counts them. 0 writes every scope. The
+    // call tree backend ignores it.
+    std::uint32_t min_duration_ns{0};
+    // Keep a wall and task clock duration histogram per tag in process, see
+    // TraceLatencies. Short scopes dropped by min_duration_ns still count.
+    bool latency_histograms{false};
+    // Time the tracer itself takes: every thread measures 1 in
+    // overhead_sample_rate calls of TraceSectionBegin/End, the malloc hook
+    // and the trace writer. kStructLog and kRingBuffer write the totals per
+    // thread with every clock sync and a summary at the end (events/s,
+    // ns and bytes per event, lost events). 0 turns it off.
+    std::uint32_t overhead_sample_rate{64};
+};
 
-void TraceEnable();
+// The backend is created by the first TraceEnable call; options passed to
+// later calls are ignored. False if the TRACE_SCOPE sites could not be
+// patched (see trace_key.h): they then record nothing, only the
+// TraceSection* calls do.
+bool TraceEnable();
+bool TraceEnable(TraceOption const& option);
 void TraceDisable();
+// Events discarded because a backend queue was full.
+std::uint64_t TraceDroppedEvents();
+// How often recording threads got in each other's way, summed over all
+// threads since the backend was created; rising counts show where tracing
+// stops scaling with the thread count.
+struct TraceContention {
+    // a full queue made a thread wait for room (Overflow::kBlock)
+    std::uint64_t full_waits{0};
+    // most events the queue shared by all threads held at once
+    // (kStructLog); close to its capacity, threads are about to drop events
+    // or wait
+    std::uint64_t queue_peak{0};
+    // a thread found a backend lock held (kCallTree, while its trees are
+    // written)
+    std::uint64_t lock_waits{0};
+};
+TraceContention TraceContentionCounters();
+// Writes the in-memory state of the kFlightRecorder and kCallTree backends
+// now. False for the other backends, before TraceEnable or on a write error.
+bool TraceDump();
+
+// Scope duration percentiles of one tag. Each value is the upper bound of a
+// histogram bucket, at most 1/32 above the exact one.
+struct TraceLatency {
+    struct Percentiles {
+        std::int64_t p50;
+        std::int64_t p90;
+        std::int64_t p99;
+        std::int64_t p999;
+        std::int64_t max;
+    };
+    Tag tag;
+    std::uint64_t count;  // calls, a sampled scope counts its weight
+    Percentiles wall_ns;
+    Percentiles task_clock_ns;
+};
+// Merged over all threads and the sites of each tag, empty unless
+// TraceOption::latency_histograms is set. Also written to the trace file
+// when it is closed.
+std::vector<TraceLatency> TraceLatencies();
+
+// Registers a call site once and returns its id. Registering the same
+// (tag, location) again returns the same id. tag and loc must outlive the
+// process, string literals and SourceLocation::current() do.
+TraceSiteId TraceRegisterSite(Tag tag, const Location& loc);
+
+// Static storage of a TRACE_SCOPE site. Constant-initialized, so a scope
+// that is passed while tracing is off touches nothing; the site is
+// registered the first time it is traced. The registry keeps `state` in
+// sync with the tag filter, so the scope decides with this one load.
+struct TraceSite {
+    constexpr TraceSite(Tag tag, Location loc) noexcept : tag{tag}, loc{loc} {}
+    Tag tag;
+    Location loc;
+    // site id | kTraceSiteDisabled, kInvalidTraceSite until registered
+    std::atomic<TraceSiteId> state{kInvalidTraceSite};
+};
+constexpr TraceSiteId kTraceSiteDisabled = 0x80000000u;
+TraceSiteId TraceRegisterSite(TraceSite& site);
+
+// The id of site, with kTraceSiteDisabled set while its tag is disabled.
+inline TraceSiteId TraceSiteState(TraceSite& site) {
+    const TraceSiteId state = site.state.load(std::memory_order_relaxed);
+    return state != kInvalidTraceSite ? state : TraceRegisterSite(site);
+}
+
+// Tag filter, applied to present and future sites. pattern is a tag, or a
+// tag prefix followed by '*'; "*" matches every tag. Rules are checked in
+// the order they were set and the last match wins, tags no rule matches
+// are enabled. Scopes that are already open are not affected.
+void TraceSetTagEnabled(const char* pattern, bool enabled);
+// Replaces all rules by a comma separated list of patterns, a leading '-'
+// disables, e.g. "-*,order_matching*" traces only the order_matching tags.
+// The CXXTRACE_TAGS environment variable is read as such a list at startup.
+void TraceSetTagFilter(const char* rules);
+
+// Sampling for all sites with this tag, present and future. Takes effect for
+// scopes opened after the call.
+void TraceSetSampling(Tag tag, TraceSampling const& sampling);
+
+// Runtime filter for the leveled scopes that were compiled in: scopes below
+// level or outside the category mask are skipped when they open. Unleveled
+// TRACE_SCOPE sites are not affected. Default: every level and category.
+void TraceSetLevel(TraceLevel level);
+void TraceSetCategories(TraceCategory mask);
+
+namespace detail {
+extern std::atomic<std::uint32_t> g_trace_min_level_;
+extern std::atomic<TraceCategory> g_trace_categories_;
+}  // namespace detail
+
+inline bool TraceLevelEnabled(TraceLevel level, TraceCategory category) {
+    return static_cast<std::uint32_t>(level) >=
+               detail::g_trace_min_level_.load(std::memory_order_relaxed) &&
+           (category &
+            detail::g_trace_categories_.load(std::memory_order_relaxed)) != 0;
+}
+
+// A begin is skipped while the tag filter disables the site; the end is
+// always recorded if its begin was.
+void TraceSectionBegin(TraceSiteId site);
+void TraceSectionEnd(TraceSiteId site);
+// For callers that found the site enabled in TraceSiteState already: skips
+// the registry lookup of TraceSectionBegin.
+void TraceEnabledSectionBegin(TraceSiteId site);
+// Slow path: looks the site up in the registry on every call.
 void TraceSectionBegin(Tag tag, const Location& loc);
 void TraceSectionEnd(Tag tag, const Location& loc);
 
+// The TraceKeyEnabled() checks compile to a patched nop with static keys.
+// A scope that was opened before tracing got enabled is not ended.
 class TraceScope {
    public:
-    TraceScope(Tag tag, const Location& loc) : tag_{tag}, loc_{loc} {
-        TraceSectionBegin(tag_, loc_);
+    explicit TraceScope(TraceSiteId site) {
+        if (TraceKeyEnabled()) {
+            site_ = site;
+            TraceSectionBegin(site_);
+        }
+    }
+    explicit TraceScope(TraceSite& site) {
+        if (TraceKeyEnabled()) {
+            const TraceSiteId state = TraceSiteState(site);
+            if ((state & kTraceSiteDisabled) == 0) {
+                site_ = state;
+                TraceEnabledSectionBegin(site_);
+            }
+        }
+    }
+    TraceScope(Tag tag, const Location& loc)
+        : TraceScope(TraceRegisterSite(tag, loc)) {}
+    ~TraceScope() {
+        if (TraceKeyEnabled() && site_ != kInvalidTraceSite) {
+            TraceSectionEnd(site_);
+        }
     }
-    ~TraceScope() { TraceSectionEnd(tag_, loc_); }
 
    private:
-    const Tag tag_;
-    Location loc_;
+    TraceSiteId site_{kInvalidTraceSite};
+};
+
+// Scope of TRACE_SCOPE_L. The filter is checked once when the scope opens,
+// so a scope that began is always ended.
+template <bool kCompiledIn>
+class TraceLevelScope {
+   public:
+    TraceLevelScope(TraceSite& site, TraceLevel level, TraceCategory category) {
+        if (TraceKeyEnabled() && TraceLevelEnabled(level, category)) {
+            const TraceSiteId state = TraceSiteState(site);
+            if ((state & kTraceSiteDisabled) == 0) {
+                site_ = state;
+                TraceEnabledSectionBegin(site_);
+            }
+        }
+    }
+    ~TraceLevelScope() {
+        if (TraceKeyEnabled() && site_ != kInvalidTraceSite) {
+            TraceSectionEnd(site_);
+        }
+    }
+
+   private:
+    TraceSiteId site_{kInvalidTraceSite};
+};
+
+// compiled out by CXXTRACE_MIN_LEVEL / CXXTRACE_CATEGORIES
+template <>
+class TraceLevelScope<false> {
+   public:
+    constexpr TraceLevelScope(TraceSite&, TraceLevel, TraceCategory) noexcept {}
 };
 
 struct TraceContext {
-    Location loc;
-    Tag tag;
+    TraceSiteId site;
     static void before(TraceContext const& ctx) {
-        TraceSectionBegin(ctx.tag, ctx.loc);
+        if (TraceKeyEnabled()) {
+            TraceSectionBegin(ctx.site);
+        }
     }
     static void after(TraceContext const& ctx) {
-        TraceSectionEnd(ctx.tag, ctx.loc);
+        if (TraceKeyEnabled()) {
+            TraceSectionEnd(ctx.site);
+        }
     }
 };
 template <typename Pointer>
@@ -41,11 +331,24 @@ template <typename Pointer>
 TracePtr<Pointer> traceWrap(Tag tag, SourceLocation loc,
                             Pointer pointer = nullptr) {
     return wrap(std::move(pointer), &TraceContext::before, &TraceContext::after,
-                TraceContext{.loc = loc, .tag = tag});
+                TraceContext{TraceRegisterSite(tag, loc)});
 }
 
 }  // namespace neon
 
-#define TRACE_SCOPE(tag)                       \
-    ::neon::TraceScope tag##_trace_scope(#tag, \
-                                         ::neon::SourceLocation::current());
+#define TRACE_SCOPE(tag)                          \
+    static ::neon::TraceSite tag##_trace_site{    \
+        #tag, ::neon::SourceLocation::current()}; \
+    ::neon::TraceScope tag##_trace_scope(tag##_trace_site);
+
+// Leveled scope, e.g. TRACE_SCOPE_L(kDebug, kNetwork, parse) where kNetwork
+// is a TraceCategory bit. Compiled out entirely when below CXXTRACE_MIN_LEVEL
+// or outside CXXTRACE_CATEGORIES, filtered by TraceSetLevel and
+// TraceSetCategories otherwise.
+#define TRACE_SCOPE_L(level, category, tag)                            \
+    static ::neon::TraceSite tag##_trace_site{                         \
+        #tag, ::neon::SourceLocation::current()};                      \
+    ::neon::TraceLevelScope<::neon::TraceCompiledIn(                   \
+        ::neon::TraceLevel::level, category)>                          \
+        tag##_trace_scope(tag##_trace_site, ::neon::TraceLevel::level, \
+                          category);
@@ -6,20 +6,10 @@ namespace neon {
 class SourceLocation {
    public:
     constexpr SourceLocation() noexcept : filepath_(""), line_(0) {}
-    constexpr SourceLocation(const SourceLocation& other) noexcept
-        : filepath_(other.filepath_), line_(other.line_) {}
-    constexpr SourceLocation(SourceLocation&& other) noexcept
-        : filepath_(other.filepath_), line_(other.line_) {}
-    SourceLocation& operator=(const SourceLocation& other) noexcept {
-        filepath_ = other.filepath_;
-        line_ = other.line_;
-        return *this;
-    }
-    SourceLocation& operator=(SourceLocation&& other) noexcept {
-        filepath_ = other.filepath_;
-        line_ = other.line_;
-        return *this;
-    }
+    constexpr SourceLocation(const SourceLocation& other) noexcept = default;
+    constexpr SourceLocation(SourceLocation&& other) noexcept = default;
+    SourceLocation& operator=(const SourceLocation& other) noexcept = default;
+    SourceLocation& operator=(SourceLocation&& other) noexcept = default;
 
     static constexpr SourceLocation current(
         const char* filepath = __builtin_FILE(),
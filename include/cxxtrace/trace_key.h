@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// TraceKeyEnabled() is what every TRACE_SCOPE site tests before calling into
+// the library. On Linux x86-64 it is a jump label: a 5 byte nop that
+// TraceEnable / TraceDisable rewrite into a jmp to the traced path and back,
+// so a disabled site costs no load and no call. Elsewhere, or when built
+// with CXXTRACE_STATIC_KEYS=0, it is a relaxed load of a global flag.
+// A disabled site has nothing to fall back on at runtime: where the code
+// can be neither mprotect'ed writable nor written through /proc/self/mem,
+// TraceEnable returns false and such a process needs CXXTRACE_STATIC_KEYS=0.
+#ifndef CXXTRACE_STATIC_KEYS
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__)
+#define CXXTRACE_STATIC_KEYS 1
+#else
+#define CXXTRACE_STATIC_KEYS 0
+#endif
+#endif
+
+namespace neon {
+
+#if CXXTRACE_STATIC_KEYS
+// One per patch site, collected by the linker into cxxtrace_jump_table.
+struct TraceJumpEntry {
+    std::uintptr_t code;    // the nop, 8 byte aligned
+    std::uintptr_t target;  // where the jmp goes when tracing is enabled
+};
+}  // namespace neon
+
+// Bounds of the cxxtrace_jump_table of the module (executable or shared
+// object) that refers to them, provided by the linker. Weak so a module
+// without any site still links.
+extern "C" {
+extern const neon::TraceJumpEntry __start_cxxtrace_jump_table[]
+    __attribute__((weak, visibility("hidden")));
+extern const neon::TraceJumpEntry __stop_cxxtrace_jump_table[]
+    __attribute__((weak, visibility("hidden")));
+}
+
+namespace neon {
+namespace detail {
+// Every module that includes this header registers its own table when it is
+// loaded, so that sites in other shared objects are patched too, including
+// ones dlopen'ed while tracing is enabled. Registering a table again is a
+// no-op.
+void RegisterJumpTable(TraceJumpEntry const* begin, TraceJumpEntry const* end);
+void UnregisterJumpTable(TraceJumpEntry const* begin);
+
+// hidden, so that each module runs its own copy (once per translation unit)
+__attribute__((constructor, visibility("hidden"))) inline void
+RegisterModuleJumpTable() {
+    RegisterJumpTable(__start_cxxtrace_jump_table, __stop_cxxtrace_jump_table);
+}
+__attribute__((destructor, visibility("hidden"))) inline void
+UnregisterModuleJumpTable() {
+    UnregisterJumpTable(__start_cxxtrace_jump_table);
+}
+}  // namespace detail
+
+// The table entry joins the section group ("?") of the function it is
+// inlined into, so it is dropped together with discarded inline copies.
+__attribute__((always_inline)) inline bool TraceKeyEnabled() {
+    asm goto(
+        ".balign 8\n\t"
+        "1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t"
+        ".pushsection cxxtrace_jump_table, \"aw?\"\n\t"
+        ".balign 8\n\t"
+        ".quad 1b, %l[enabled]\n\t"
+        ".popsection\n\t"
+        :
+        :
+        :
+        : enabled);
+    return false;
+enabled:
+    return true;
+}
+#else
+namespace detail {
+extern std::atomic<bool> g_trace_key_;
+}  // namespace detail
+
+inline bool TraceKeyEnabled() {
+    return detail::g_trace_key_.load(std::memory_order_relaxed);
+}
+#endif
+
+}  // namespace neon
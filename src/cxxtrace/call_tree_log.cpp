@@ -0,0 +1,187 @@
+#include "call_tree_log.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "trace_local.h"
+
+namespace neon {
+
+constexpr std::uint32_t CallTreeLog::kNoNode;
+
+// Keeps the thread's tree alive; TraceLocal points to it. Events recorded
+// after the thread's destructors ran are dropped.
+struct CallTreeLog::LocalTree {
+    std::shared_ptr<ThreadTree> tree;
+    ~LocalTree() {
+        t_trace_local_.tree_owner = kTraceLocalExited;
+        t_trace_local_.tree = nullptr;
+    }
+};
+
+CallTreeLog::CallTreeLog(CreateOption const& options) : options_{options} {
+    dumper_ = std::thread([this]() { dump_loop(); });
+}
+
+CallTreeLog::~CallTreeLog() {
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stop_ = true;
+    }
+    stop_cv_.notify_all();
+    if (dumper_.joinable()) {
+        dumper_.join();
+    }
+    dump();
+}
+
+CallTreeLog::ThreadTree* CallTreeLog::local_tree(std::uint32_t tid) {
+    TraceLocal& local = t_trace_local_;
+    if (CXXTRACE_UNLIKELY(local.tree_owner != instance_)) {
+        if (local.tree_owner == kTraceLocalExited) {
+            return nullptr;
+        }
+        static thread_local LocalTree holder;
+        auto tree = std::make_shared<ThreadTree>();
+        tree->tid = tid;
+        tree->nodes.push_back(Node{kInvalidTraceSite, kNoNode});
+        {
+            std::lock_guard<std::mutex> lock(trees_mutex_);
+            trees_.push_back(tree);
+        }
+        holder.tree = std::move(tree);
+        local.tree = holder.tree.get();
+        local.tree_owner = instance_;
+    }
+    return local.tree;
+}
+
+std::uint32_t CallTreeLog::child(ThreadTree& tree, std::uint32_t parent,
+                                 TraceSiteId site) {
+    std::uint32_t* link = &tree.nodes[parent].first_child;
+    while (*link != kNoNode) {
+        if (tree.nodes[*link].site == site) {
+            return *link;
+        }
+        link = &tree.nodes[*link].next_sibling;
+    }
+    const auto index = static_cast<std::uint32_t>(tree.nodes.size());
+    *link = index;
+    tree.nodes.push_back(Node{site, parent});
+    return index;
+}
+
+void CallTreeLog::record(TraceEvent const& event) {
+    ThreadTree* local = local_tree(event.tid);
+    if (!local) {
+        return;
+    }
+    ThreadTree& tree = *local;
+    std::unique_lock<std::mutex> lock(tree.mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        lock_waits_.fetch_add(1, std::memory_order_relaxed);
+        lock.lock();
+    }
+    if (event.type == TraceEvent::Type::kScopeBegin) {
+        const std::uint32_t parent = tree.stack.empty() ? 0 : tree.stack.back();
+        tree.stack.push_back(child(tree, parent, event.site));
+        return;
+    }
+    // Scopes whose end was not recorded (tracing disabled in between) are
+    // abandoned; an end without a begin is ignored.
+    auto open = std::find_if(tree.stack.rbegin(), tree.stack.rend(),
+                             [&tree, &event](std::uint32_t node) {
+                                 return tree.nodes[node].site == event.site;
+                             });
+    if (open == tree.stack.rend()) {
+        return;
+    }
+    // a sampled call stands for weight calls
+    const std::int64_t weight = event.weight;
+    Node& node = tree.nodes[*open];
+    node.count += event.weight;
+    node.total[kWall] += event.duration * weight;
+    node.total[kTaskClock] += event.task_clock_ns * weight;
+    node.total[kAlloc] += event.allocated_heap_bytes * weight;
+    node.total[kDealloc] += event.deallocated_heap_bytes * weight;
+    tree.stack.erase(std::prev(open.base()), tree.stack.end());
+}
+
+TraceContention CallTreeLog::contention() const {
+    TraceContention contention;
+    contention.lock_waits = lock_waits_.load(std::memory_order_relaxed);
+    return contention;
+}
+
+bool CallTreeLog::dump() {
+    std::lock_guard<std::mutex> dump_lock(dump_mutex_);
+    std::vector<std::shared_ptr<ThreadTree>> trees;
+    {
+        std::lock_guard<std::mutex> lock(trees_mutex_);
+        trees = trees_;
+    }
+    // written aside and renamed so readers never see a partial tree
+    const std::string temp_name = options_.file_name + ".tmp";
+    auto writer = TraceWriter::open(temp_name, options_.calibration);
+    if (!writer) {
+        return false;
+    }
+    std::uint32_t next_id = 1;
+    std::vector<Node> nodes;
+    std::vector<Values> children;
+    for (auto const& tree : trees) {
+        std::uint32_t tid;
+        {
+            std::lock_guard<std::mutex> lock(tree->mutex);
+            nodes = tree->nodes;
+            tid = tree->tid;
+        }
+        children.assign(nodes.size(), Values{});
+        for (std::size_t i = 1; i < nodes.size(); ++i) {
+            for (int m = 0; m < kMetricCount; ++m) {
+                children[nodes[i].parent][m] += nodes[i].total[m];
+            }
+        }
+        // node i becomes id base + i, parents always precede their children
+        const std::uint32_t base = next_id - 1;
+        for (std::size_t i = 1; i < nodes.size(); ++i) {
+            Node const& node = nodes[i];
+            Values self;
+            for (int m = 0; m < kMetricCount; ++m) {
+                // a scope still open has no total yet
+                self[m] = std::max<std::int64_t>(
+                    0, node.total[m] - children[i][m]);
+            }
+            format::CallNodeRecord record{};
+            record.id = base + static_cast<std::uint32_t>(i);
+            record.parent_id = node.parent == 0 ? 0 : base + node.parent;
+            record.site_id = node.site;
+            record.tid = tid;
+            record.count = node.count;
+            record.total_ticks = node.total[kWall];
+            record.self_ticks = self[kWall];
+            record.total_task_clock_ns = node.total[kTaskClock];
+            record.self_task_clock_ns = self[kTaskClock];
+            record.total_allocated_heap_bytes = node.total[kAlloc];
+            record.self_allocated_heap_bytes = self[kAlloc];
+            record.total_deallocated_heap_bytes = node.total[kDealloc];
+            record.self_deallocated_heap_bytes = self[kDealloc];
+            writer->write(record);
+        }
+        next_id += static_cast<std::uint32_t>(nodes.size() - 1);
+    }
+    writer.reset();
+    return std::rename(temp_name.c_str(), options_.file_name.c_str()) == 0;
+}
+
+void CallTreeLog::dump_loop() {
+    std::unique_lock<std::mutex> lock(stop_mutex_);
+    while (!stop_cv_.wait_for(lock, options_.dump_interval,
+                              [this]() { return stop_; })) {
+        lock.unlock();
+        dump();
+        lock.lock();
+    }
+}
+
+}  // namespace neon
@@ -0,0 +1,80 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "recorder.h"
+#include "trace_writer.h"
+
+namespace neon {
+
+// Recording backend that keeps no events. Every thread folds its scopes into
+// a calling-context tree keyed by the path of sites from the thread's
+// outermost scope; a node accumulates call count and total time, task clock
+// and heap bytes. The trees of all threads are written to file_name
+// periodically and at shutdown, each dump replacing the previous one, so the
+// output grows with the number of distinct paths instead of calls.
+class CallTreeLog : public Recorder {
+   public:
+    struct CreateOption {
+        std::string file_name{"cxxtrace.bin"};
+        std::chrono::milliseconds dump_interval{1000};
+        ClockCalibration calibration{};
+    };
+    explicit CallTreeLog(CreateOption const& options);
+    ~CallTreeLog() override;
+
+    void record(TraceEvent const& event) override;
+    bool wants_scope_begin() const override { return true; }
+    // Writes the current trees; also called by the dump thread.
+    bool dump() override;
+    // lock_waits: record() found its tree locked by a dump
+    TraceContention contention() const override;
+
+   private:
+    friend struct TraceLocal;
+    enum Metric { kWall, kTaskClock, kAlloc, kDealloc, kMetricCount };
+    using Values = std::array<std::int64_t, kMetricCount>;
+    static constexpr std::uint32_t kNoNode = 0xffffffff;
+
+    struct Node {
+        TraceSiteId site;
+        std::uint32_t parent;
+        std::uint32_t first_child{kNoNode};
+        std::uint32_t next_sibling{kNoNode};
+        std::uint64_t count{0};
+        Values total{};
+    };
+    // Owned by one thread; mutex_ only guards against a concurrent dump.
+    struct ThreadTree {
+        std::mutex mutex;
+        std::uint32_t tid{0};
+        std::vector<Node> nodes;  // nodes[0] is the thread root
+        std::vector<std::uint32_t> stack;  // nodes of the open scopes
+    };
+    struct LocalTree;
+
+    ThreadTree* local_tree(std::uint32_t tid);
+    static std::uint32_t child(ThreadTree& tree, std::uint32_t parent,
+                               TraceSiteId site);
+    void dump_loop();
+
+    CreateOption options_;
+    std::mutex trees_mutex_;
+    std::vector<std::shared_ptr<ThreadTree>> trees_;
+    std::atomic<std::uint64_t> lock_waits_{0};
+    std::mutex dump_mutex_;
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stop_{false};
+    std::thread dumper_;
+};
+
+}  // namespace neon
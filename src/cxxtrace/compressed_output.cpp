@@ -0,0 +1,157 @@
+#include "compressed_output.h"
+
+#include <lz4.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "crc32c.h"
+
+namespace neon {
+
+constexpr std::size_t CompressedOutput::kBlockSize;
+
+CompressedOutput::CompressedOutput(std::unique_ptr<TraceOutput> inner,
+                                   unsigned threads)
+    : inner_{std::move(inner)},
+      threads_{std::max(1u, threads)},
+      max_pending_{2 * threads_ + 2} {
+    format::CompressedFileHeader header;
+    header.block_size = kBlockSize;
+    failed_ = !inner_->write(&header, sizeof(header));
+    current_.reset(new Block);
+    current_->raw.reserve(kBlockSize);
+    for (std::size_t i = 0; i < threads_; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+CompressedOutput::~CompressedOutput() {
+    if (!current_->raw.empty()) {
+        submit();
+    }
+    write_finished(true);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+bool CompressedOutput::write(const void* data, std::size_t size) {
+    auto bytes = static_cast<const char*>(data);
+    while (size > 0 && !failed_) {
+        std::vector<char>& raw = current_->raw;
+        const std::size_t chunk = std::min(size, kBlockSize - raw.size());
+        raw.insert(raw.end(), bytes, bytes + chunk);
+        bytes += chunk;
+        size -= chunk;
+        if (raw.size() == kBlockSize) {
+            submit();
+        }
+    }
+    return !failed_;
+}
+
+void CompressedOutput::flush() {
+    write_finished(false);
+    inner_->flush();
+}
+
+void CompressedOutput::submit() {
+    Block* block = current_.get();
+    pending_.push_back(std::move(current_));
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // with every worker busy, this one would wait for a whole block
+        if (queue_.size() < threads_) {
+            queue_.push_back(block);
+            queued = true;
+        }
+    }
+    if (queued) {
+        work_cv_.notify_one();
+    } else {
+        ++stored_blocks_;
+        block->header.codec = format::BlockCodec::kStored;
+        block->header.crc32c =
+            format::Crc32c(block->raw.data(), block->raw.size());
+        block->done = true;
+    }
+    write_finished(false);
+    current_.reset(new Block);
+    current_->raw.reserve(kBlockSize);
+}
+
+void CompressedOutput::write_finished(bool drain) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!pending_.empty()) {
+        Block* front = pending_.front().get();
+        if (!front->done) {
+            if (!drain && pending_.size() <= max_pending_) {
+                return;
+            }
+            done_cv_.wait(lock, [front]() { return front->done; });
+        }
+        auto block = std::move(pending_.front());
+        pending_.pop_front();
+        lock.unlock();
+        write_block(*block);
+        lock.lock();
+    }
+}
+
+void CompressedOutput::write_block(Block const& block) {
+    format::CompressedBlockHeader header = block.header;
+    const bool compressed = header.codec == format::BlockCodec::kLz4;
+    std::vector<char> const& data = compressed ? block.stored : block.raw;
+    header.stored_size = static_cast<std::uint32_t>(data.size());
+    header.raw_size = static_cast<std::uint32_t>(block.raw.size());
+    if (!failed_) {
+        failed_ = !inner_->write(&header, sizeof(header)) ||
+                  !inner_->write(data.data(), data.size());
+    }
+}
+
+void CompressedOutput::compress(Block& block) {
+    const int raw_size = static_cast<int>(block.raw.size());
+    block.stored.resize(static_cast<std::size_t>(LZ4_compressBound(raw_size)));
+    const int size =
+        LZ4_compress_default(block.raw.data(), block.stored.data(), raw_size,
+                             static_cast<int>(block.stored.size()));
+    if (size <= 0 || size >= raw_size) {
+        // incompressible, store it
+        block.stored.clear();
+        block.header.codec = format::BlockCodec::kStored;
+        block.header.crc32c =
+            format::Crc32c(block.raw.data(), block.raw.size());
+        return;
+    }
+    block.stored.resize(static_cast<std::size_t>(size));
+    block.header.codec = format::BlockCodec::kLz4;
+    block.header.crc32c =
+        format::Crc32c(block.stored.data(), block.stored.size());
+}
+
+void CompressedOutput::worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        Block* block = queue_.front();
+        queue_.pop_front();
+        lock.unlock();
+        compress(*block);
+        lock.lock();
+        block->done = true;
+        done_cv_.notify_all();
+    }
+}
+
+}  // namespace neon
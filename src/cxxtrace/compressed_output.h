@@ -0,0 +1,73 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace_format.h"
+#include "trace_output.h"
+
+namespace neon {
+
+// Compression stage in front of another output. The byte stream is cut
+// into independent blocks of kBlockSize that a pool of workers compresses
+// with LZ4; finished blocks are written to the inner output in stream
+// order, in the container described by format::CompressedFileHeader.
+//
+// write() never waits for compression: a block that finds every worker busy
+// and as many blocks queued is stored uncompressed instead. Only when
+// blocks pile up behind a slow one does write() wait for it, which bounds
+// the blocks in flight to 2 * threads + 2.
+class CompressedOutput : public TraceOutput {
+   public:
+    static constexpr std::size_t kBlockSize = 1 << 20;
+
+    CompressedOutput(std::unique_ptr<TraceOutput> inner, unsigned threads);
+    ~CompressedOutput() override;
+
+    bool write(const void* data, std::size_t size) override;
+    // Writes the blocks finished so far; the partial block stays until full.
+    void flush() override;
+
+    std::uint64_t stored_blocks() const { return stored_blocks_; }
+
+   private:
+    struct Block {
+        std::vector<char> raw;
+        std::vector<char> stored;  // the LZ4 block, empty to store raw
+        format::CompressedBlockHeader header{};
+        bool done{false};
+    };
+
+    // Hands the current block to the pool, or stores it if the pool is
+    // behind.
+    void submit();
+    // Writes finished blocks from the front; waits for the front one while
+    // more than max_pending_ are in flight, or for all if drain is set.
+    void write_finished(bool drain);
+    void write_block(Block const& block);
+    static void compress(Block& block);
+    void worker_loop();
+
+    std::unique_ptr<TraceOutput> inner_;
+    const std::size_t threads_;
+    const std::size_t max_pending_;
+    std::unique_ptr<Block> current_;
+    std::deque<std::unique_ptr<Block>> pending_;  // in stream order
+    std::uint64_t stored_blocks_{0};
+    bool failed_{false};
+
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    // guarded by mutex_
+    std::deque<Block*> queue_;  // waiting for a worker
+    bool stop_{false};
+    std::vector<std::thread> workers_;
+};
+
+}  // namespace neon
@@ -1,99 +1,271 @@
 #include "cxxtrace/cxxtrace.h"
 
-#include <chrono>
+#include <cmath>
 #include <iostream>
 #include <string>
 #include <thread>
 #include <tl/expected.hpp>
 
-#include "nlohmann/json.hpp"
+#include "call_tree_log.h"
+#include "flight_recorder_log.h"
+#include "jump_label.h"
+#include "latency_histogram.h"
+#include "malloc_hook.h"
+#include "ring_buffer_log.h"
+#include "sampler.h"
+#include "scope_stack.h"
+#include "self_overhead.h"
+#include "site_registry.h"
 #include "structlog.h"
 #include "thread_info.h"
+#include "trace_clock.h"
+#include "trace_event.h"
 
 namespace neon {
 
-struct TraceEvent {
-    enum class Type {
-        kScopeBegin,
-        kScopeEnd,
-    };
-    TraceEvent() noexcept = default;
-    TraceEvent(TraceEvent&& other) noexcept = default;
-    TraceEvent(TraceEvent const& other) noexcept = default;
-    TraceEvent& operator=(TraceEvent&& other) noexcept = default;
-    TraceEvent& operator=(TraceEvent const& other) noexcept = default;
-
-    TraceEvent(Type type, Tag tag, const Location& loc)
-        : type{type}, tag{tag}, loc{loc} {}
-    Type type{Type::kScopeBegin};
-    Tag tag{nullptr};
-    Location loc{};
-    std::uint32_t tid{0};
-    std::int64_t task_clock_ns{0};
-    std::int64_t allocated_heap_bytes{0};
-    std::int64_t deallocated_heap_bytes{0};
-    std::int64_t ts_ns{0};
-};
+namespace detail {
+std::atomic<std::uint32_t> g_trace_min_level_{0};
+std::atomic<TraceCategory> g_trace_categories_{kTraceAllCategories};
+}  // namespace detail
+
+static std::atomic<bool> g_trace_enabled_{false};
+static std::atomic<Recorder*> g_recorder_{nullptr};
+static std::atomic<TraceOption::Clock> g_clock_{TraceOption::Clock::kSteady};
+static std::atomic<bool> g_hardware_counters_{false};
+// TraceOption::min_duration_ns in clock ticks, 0 records every scope
+static std::atomic<std::int64_t> g_min_duration_ticks_{0};
+static std::atomic<bool> g_record_begins_{false};
+static std::atomic<bool> g_latency_histograms_{false};
 
-static std::int64_t now_timestamp_ns() {
-    auto now = std::chrono::steady_clock::now();
-    auto nanos = std::chrono::time_point_cast<std::chrono::nanoseconds>(now)
-                     .time_since_epoch();
-    return static_cast<std::int64_t>(nanos.count());
+static OutputOption output_option(TraceOption const& option) {
+    OutputOption output;
+    output.kind = option.output;
+    output.compression_threads = option.compression_threads;
+    output.rotate_bytes = option.rotate_bytes;
+    output.rotate_interval_ms = option.rotate_interval_ms;
+    output.max_total_bytes = option.max_total_bytes;
+    output.self_overhead = option.overhead_sample_rate != 0;
+    return output;
 }
 
-static std::atomic<bool> g_trace_enabled_{false};
-void TraceEnable() {
+static Recorder* create_recorder(TraceOption const& option) {
+    const ClockCalibration calibration =
+        TraceClock::calibrate(TraceClock::resolve(option.clock));
+    g_clock_ = calibration.clock;
+    const std::uint32_t counter_mask =
+        option.hardware_counters ? ThreadInfo::enable_hardware_counters() : 0;
+    g_hardware_counters_ = counter_mask != 0;
+    SiteRegistry::inst().set_default_sampling(option.sampling);
+    if (option.latency_histograms) {
+        LatencyHistograms::enable(calibration.ns_per_tick);
+        g_latency_histograms_ = true;
+    }
+    SelfOverhead::enable(option.overhead_sample_rate, calibration.clock);
+    // the call tree is already as small as the number of paths
+    if (option.backend != TraceOption::Backend::kCallTree) {
+        g_min_duration_ticks_ = static_cast<std::int64_t>(
+            std::ceil(option.min_duration_ns / calibration.ns_per_tick));
+    }
+    switch (option.backend) {
+        case TraceOption::Backend::kRingBuffer: {
+            RingBufferLog::CreateOption log_option;
+            log_option.capacity = option.ring_buffer_capacity;
+            log_option.overflow = option.overflow;
+            log_option.file_name = option.file_name;
+            log_option.calibration = calibration;
+            log_option.counter_mask = counter_mask;
+            log_option.output = output_option(option);
+            static RingBufferLog log{log_option};
+            return &log;
+        }
+        case TraceOption::Backend::kCallTree: {
+            CallTreeLog::CreateOption log_option;
+            log_option.file_name = option.file_name;
+            log_option.dump_interval =
+                std::chrono::milliseconds(option.dump_interval_ms);
+            log_option.calibration = calibration;
+            static CallTreeLog log{log_option};
+            return &log;
+        }
+        case TraceOption::Backend::kFlightRecorder: {
+            FlightRecorderLog::CreateOption log_option;
+            log_option.capacity = option.ring_buffer_capacity;
+            log_option.file_name = option.file_name;
+            log_option.window =
+                std::chrono::milliseconds(option.flight_recorder_window_ms);
+            log_option.dump_signal = option.dump_signal;
+            log_option.dump_on_crash = option.dump_on_crash;
+            log_option.calibration = calibration;
+            log_option.counter_mask = counter_mask;
+            static FlightRecorderLog log{log_option};
+            return &log;
+        }
+        case TraceOption::Backend::kStructLog:
+        default: {
+            StructLog::CreateOption log_option;
+            log_option.file_name = option.file_name;
+            log_option.calibration = calibration;
+            log_option.counter_mask = counter_mask;
+            log_option.output = output_option(option);
+            log_option.capacity = option.ring_buffer_capacity;
+            log_option.overflow = option.overflow;
+            static StructLog log{log_option};
+            return &log;
+        }
+    }
+}
+
+namespace {
+// Puts the malloc statistics listener under a SelfOverhead probe.
+class OverheadMallocListener : public MallocListener {
+   public:
+    void alloc(std::size_t bytes) override {
+        SelfOverhead::Probe probe{SelfOverhead::kMalloc};
+        inner_->alloc(bytes);
+    }
+    void dealloc(std::size_t bytes) override {
+        SelfOverhead::Probe probe{SelfOverhead::kMalloc};
+        inner_->dealloc(bytes);
+    }
+    void wrap(MallocListener* inner) {
+        if (inner && inner != this) {
+            inner_ = inner;
+            MallocInterposition::setListener(this);
+        }
+    }
+
+   private:
+    MallocListener* inner_{nullptr};
+};
+}  // namespace
+
+bool TraceEnable() { return TraceEnable(TraceOption{}); }
+
+bool TraceEnable(TraceOption const& option) {
+    static Recorder* recorder = create_recorder(option);
+    g_record_begins_ = recorder->wants_scope_begin();
+    g_recorder_ = recorder;
+    ScopeStack::new_epoch();
     g_trace_enabled_ = true;
     ThreadInfo::enable_malloc_statistics();
+    if (SelfOverhead::enabled()) {
+        static OverheadMallocListener listener;
+        listener.wrap(MallocInterposition::listener());
+    }
+    if (!JumpLabel::set(true)) {
+        std::cerr << "cxxtrace: TRACE_SCOPE sites could not be enabled, "
+                     "build with CXXTRACE_STATIC_KEYS=OFF here"
+                  << std::endl;
+        return false;
+    }
+    return true;
 }
 
 void TraceDisable() {
+    JumpLabel::set(false);
     ThreadInfo::disable_malloc_statistics();
     g_trace_enabled_ = false;
 }
 
-static nlohmann::json to_json(TraceEvent const& event) {
-    nlohmann::json json;
-    json["event"] = (event.type == TraceEvent::Type::kScopeBegin) ? "B" : "E";
-    json["tag"] = event.tag ? event.tag : "";
-    json["file"] = event.loc.filename();
-    json["line"] = event.loc.line();
-    json["tid"] = event.tid;
-    json["task_clock"] = event.task_clock_ns;
-    json["alloc"] = event.allocated_heap_bytes;
-    json["dealloc"] = event.deallocated_heap_bytes;
-    json["ts"] = event.ts_ns;
-    return json;
+std::uint64_t TraceDroppedEvents() {
+    Recorder* recorder = g_recorder_;
+    return recorder ? recorder->dropped_events() : 0;
 }
 
-void TraceSectionBegin(Tag tag, const Location& loc) {
-    if (!g_trace_enabled_) {
+TraceContention TraceContentionCounters() {
+    Recorder* recorder = g_recorder_;
+    return recorder ? recorder->contention() : TraceContention{};
+}
+
+bool TraceDump() {
+    Recorder* recorder = g_recorder_;
+    return recorder ? recorder->dump() : false;
+}
+
+void TraceSetLevel(TraceLevel level) {
+    detail::g_trace_min_level_ = static_cast<std::uint32_t>(level);
+}
+
+void TraceSetCategories(TraceCategory mask) {
+    detail::g_trace_categories_ = mask;
+}
+
+static void take_snapshot(TraceEvent& event) {
+    ThreadInfo const& thread = ThreadInfo::current();
+    event.tid = thread.tid();
+    event.task_clock_ns = thread.task_clock_ns();
+    event.allocated_heap_bytes = thread.allocated_heap_bytes();
+    event.deallocated_heap_bytes = thread.deallocated_heap_bytes();
+    if (g_hardware_counters_.load(std::memory_order_relaxed)) {
+        thread.hardware_counters(event.counters);
+    }
+    event.ts = TraceClock::now(g_clock_.load(std::memory_order_relaxed));
+}
+
+static void begin_section(TraceSiteId site) {
+    std::uint32_t weight = 1;
+    if (SiteRegistry::inst().sampling_active()) {
+        weight = Sampler::begin(site, ScopeStack::parent_weight());
+        if (weight == 0) {
+            ScopeStack::begin_sampled_out(site);
+            return;
+        }
+    }
+    TraceEvent event{TraceEvent::Type::kScopeBegin, site};
+    event.weight = weight;
+    take_snapshot(event);
+    ScopeStack::begin(event);
+    if (g_record_begins_.load(std::memory_order_relaxed)) {
+        g_recorder_.load(std::memory_order_relaxed)->record(event);
+    }
+}
+
+void TraceSectionBegin(TraceSiteId site) {
+    if (!g_trace_enabled_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    SelfOverhead::Probe probe{SelfOverhead::kScopeBegin};
+    if (!SiteRegistry::inst().enabled(site)) {
         return;
     }
-    TraceEvent event{TraceEvent::Type::kScopeBegin, tag, loc};
-    event.tid = ThreadInfo::current().tid();
-    event.task_clock_ns = ThreadInfo::current().task_clock_ns();
-    event.allocated_heap_bytes = ThreadInfo::current().allocated_heap_bytes();
-    event.deallocated_heap_bytes =
-        ThreadInfo::current().deallocated_heap_bytes();
-    event.ts_ns = now_timestamp_ns();
-    StructLog::inst().log(to_json(event));
+    begin_section(site);
 }
 
-void TraceSectionEnd(Tag tag, const Location& loc) {
-    if (!g_trace_enabled_) {
+void TraceEnabledSectionBegin(TraceSiteId site) {
+    if (!g_trace_enabled_.load(std::memory_order_relaxed)) {
         return;
     }
+    SelfOverhead::Probe probe{SelfOverhead::kScopeBegin};
+    begin_section(site);
+}
 
-    TraceEvent event{TraceEvent::Type::kScopeEnd, tag, loc};
-    event.tid = ThreadInfo::current().tid();
-    event.task_clock_ns = ThreadInfo::current().task_clock_ns();
-    event.allocated_heap_bytes = ThreadInfo::current().allocated_heap_bytes();
-    event.deallocated_heap_bytes =
-        ThreadInfo::current().deallocated_heap_bytes();
-    event.ts_ns = now_timestamp_ns();
-    StructLog::inst().log(to_json(event));
+void TraceSectionEnd(TraceSiteId site) {
+    if (!g_trace_enabled_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    SelfOverhead::Probe probe{SelfOverhead::kScopeEnd};
+    if (SiteRegistry::inst().sampling_active() &&
+        ScopeStack::end_sampled_out(site)) {
+        return;
+    }
+    TraceEvent event{TraceEvent::Type::kScopeComplete, site};
+    take_snapshot(event);
+    ScopeStack::end(event,
+                    g_min_duration_ticks_.load(std::memory_order_relaxed),
+                    g_latency_histograms_.load(std::memory_order_relaxed),
+                    *g_recorder_.load(std::memory_order_relaxed));
+}
+
+void TraceSectionBegin(Tag tag, const Location& loc) {
+    if (g_trace_enabled_) {
+        TraceSectionBegin(TraceRegisterSite(tag, loc));
+    }
+}
+
+void TraceSectionEnd(Tag tag, const Location& loc) {
+    if (g_trace_enabled_) {
+        TraceSectionEnd(TraceRegisterSite(tag, loc));
+    }
 }
 
 }  // namespace neon
@@ -0,0 +1,266 @@
+#include "flight_recorder_log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include "trace_local.h"
+
+#if !defined(_WIN32)
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace neon {
+
+// rings of exited threads kept for the next dumps, oldest dropped first
+static constexpr std::size_t kMaxRetiredRings = 64;
+static constexpr char kWakeDump = 'd';
+static constexpr char kWakeStop = 's';
+
+// Keeps the thread's ring alive; TraceLocal points to it. Events recorded
+// after the thread's destructors ran are dropped.
+struct FlightRecorderLog::LocalRing {
+    std::shared_ptr<ThreadRing> ring;
+    ~LocalRing() {
+        if (ring) {
+            ring->retired.store(true, std::memory_order_release);
+        }
+        t_trace_local_.flight_ring_owner = kTraceLocalExited;
+        t_trace_local_.flight_ring = nullptr;
+    }
+};
+
+#if !defined(_WIN32)
+static constexpr int kFatalSignals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE,
+                                        SIGABRT};
+static constexpr std::size_t kFatalSignalCount =
+    sizeof(kFatalSignals) / sizeof(kFatalSignals[0]);
+// a crashing thread waits at most this long for its dump
+static constexpr int kCrashDumpTimeoutMs = 3000;
+
+// the log the handlers act on, at most one installs them
+static std::atomic<FlightRecorderLog*> g_flight_recorder_{nullptr};
+static struct sigaction g_previous_dump_action_;
+static struct sigaction g_previous_fatal_actions_[kFatalSignalCount];
+static std::atomic<bool> g_crashing_{false};
+static thread_local bool t_dump_thread_ = false;
+#endif
+
+FlightRecorderLog::FlightRecorderLog(CreateOption const& options)
+    : options_{options} {
+#if !defined(_WIN32)
+    if (options_.dump_signal == 0 && !options_.dump_on_crash) {
+        return;
+    }
+    if (pipe(wake_fd_) != 0) {
+        std::cerr << "cxxtrace: flight recorder cannot create a pipe: "
+                  << std::strerror(errno) << '\n';
+        return;
+    }
+    dumper_ = std::thread([this]() { dump_loop(); });
+    install_signal_handlers();
+#endif
+}
+
+FlightRecorderLog::~FlightRecorderLog() {
+#if !defined(_WIN32)
+    if (!dumper_.joinable()) {
+        return;
+    }
+    restore_signal_handlers();
+    const char stop = kWakeStop;
+    if (write(wake_fd_[1], &stop, 1) == 1) {
+        dumper_.join();
+    } else {
+        dumper_.detach();
+    }
+    close(wake_fd_[0]);
+    close(wake_fd_[1]);
+#endif
+}
+
+FlightRecorderLog::ThreadRing* FlightRecorderLog::local_ring() {
+    TraceLocal& local = t_trace_local_;
+    if (CXXTRACE_UNLIKELY(local.flight_ring_owner != instance_)) {
+        if (local.flight_ring_owner == kTraceLocalExited) {
+            return nullptr;
+        }
+        static thread_local LocalRing holder;
+        auto ring = std::make_shared<ThreadRing>(options_.capacity);
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            const auto retired = std::count_if(
+                rings_.begin(), rings_.end(),
+                [](std::shared_ptr<ThreadRing> const& ring) {
+                    return ring->retired.load(std::memory_order_acquire);
+                });
+            if (static_cast<std::size_t>(retired) >= kMaxRetiredRings) {
+                rings_.erase(std::find_if(
+                    rings_.begin(), rings_.end(),
+                    [](std::shared_ptr<ThreadRing> const& ring) {
+                        return ring->retired.load(std::memory_order_acquire);
+                    }));
+            }
+            rings_.push_back(ring);
+        }
+        if (holder.ring) {
+            holder.ring->retired.store(true, std::memory_order_release);
+        }
+        holder.ring = std::move(ring);
+        local.flight_ring = holder.ring.get();
+        local.flight_ring_owner = instance_;
+    }
+    return local.flight_ring;
+}
+
+void FlightRecorderLog::record(TraceEvent const& event) {
+    if (ThreadRing* local = local_ring()) {
+        local->ring.push(event);
+    }
+}
+
+bool FlightRecorderLog::dump() {
+    std::lock_guard<std::mutex> dump_lock(dump_mutex_);
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings = rings_;
+    }
+    const std::string file_name =
+        NumberedFileName(options_.file_name, ++dumps_);
+    auto writer = TraceWriter::open(file_name, options_.calibration,
+                                    options_.counter_mask);
+    if (!writer) {
+        std::cerr << "cxxtrace: cannot write flight recorder dump "
+                  << file_name << '\n';
+        return false;
+    }
+    std::int64_t cutoff = std::numeric_limits<std::int64_t>::min();
+    if (options_.window.count() > 0) {
+        const double window_ns = options_.window.count() * 1e6;
+        cutoff = TraceClock::now(options_.calibration.clock) -
+                 static_cast<std::int64_t>(window_ns /
+                                           options_.calibration.ns_per_tick);
+    }
+    std::vector<TraceEvent> events;
+    for (auto const& ring : rings) {
+        ring->ring.snapshot(events);
+        for (TraceEvent const& event : events) {
+            if (event.ts + event.duration >= cutoff) {
+                writer->write(event);
+            }
+        }
+    }
+    return true;
+}
+
+#if !defined(_WIN32)
+
+void FlightRecorderLog::dump_loop() {
+    t_dump_thread_ = true;
+    char wake = 0;
+    while (true) {
+        const ssize_t n = read(wake_fd_[0], &wake, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || wake == kWakeStop) {
+            return;
+        }
+        dump();
+        signal_dumps_.fetch_add(1, std::memory_order_release);
+    }
+}
+
+// Signal handlers only do async-signal-safe work: the dump itself runs on
+// the dumper thread, woken through the pipe.
+void FlightRecorderLog::on_dump_signal(int) {
+    const int saved_errno = errno;
+    FlightRecorderLog* log = g_flight_recorder_.load();
+    if (log) {
+        const char wake = kWakeDump;
+        (void)!write(log->wake_fd_[1], &wake, 1);
+    }
+    errno = saved_errno;
+}
+
+void FlightRecorderLog::on_fatal_signal(int signal) {
+    FlightRecorderLog* log = g_flight_recorder_.load();
+    // a crash of the dumper thread itself, or a second crash, cannot wait
+    if (log && !t_dump_thread_ && !g_crashing_.exchange(true)) {
+        const std::uint32_t target =
+            log->signal_dumps_.load(std::memory_order_acquire) + 1;
+        const char wake = kWakeDump;
+        if (write(log->wake_fd_[1], &wake, 1) == 1) {
+            const timespec millisecond{0, 1000000};
+            for (int waited = 0;
+                 waited < kCrashDumpTimeoutMs &&
+                 log->signal_dumps_.load(std::memory_order_acquire) < target;
+                 ++waited) {
+                nanosleep(&millisecond, nullptr);
+            }
+        }
+    }
+    // hand the signal to whoever had it before, usually the default action
+    for (std::size_t i = 0; i < kFatalSignalCount; ++i) {
+        if (kFatalSignals[i] == signal) {
+            sigaction(signal, &g_previous_fatal_actions_[i], nullptr);
+        }
+    }
+    raise(signal);
+}
+
+void FlightRecorderLog::install_signal_handlers() {
+    FlightRecorderLog* expected = nullptr;
+    if (!g_flight_recorder_.compare_exchange_strong(expected, this)) {
+        return;
+    }
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    if (options_.dump_signal != 0) {
+        action.sa_handler = &FlightRecorderLog::on_dump_signal;
+        action.sa_flags = SA_RESTART;
+        sigaction(options_.dump_signal, &action, &g_previous_dump_action_);
+    }
+    if (options_.dump_on_crash) {
+        action.sa_handler = &FlightRecorderLog::on_fatal_signal;
+        action.sa_flags = 0;
+        for (std::size_t i = 0; i < kFatalSignalCount; ++i) {
+            sigaction(kFatalSignals[i], &action,
+                      &g_previous_fatal_actions_[i]);
+        }
+    }
+}
+
+void FlightRecorderLog::restore_signal_handlers() {
+    if (g_flight_recorder_.load() != this) {
+        return;
+    }
+    if (options_.dump_signal != 0) {
+        sigaction(options_.dump_signal, &g_previous_dump_action_, nullptr);
+    }
+    if (options_.dump_on_crash) {
+        for (std::size_t i = 0; i < kFatalSignalCount; ++i) {
+            sigaction(kFatalSignals[i], &g_previous_fatal_actions_[i],
+                      nullptr);
+        }
+    }
+    g_flight_recorder_.store(nullptr);
+}
+
+#else
+
+void FlightRecorderLog::dump_loop() {}
+void FlightRecorderLog::on_dump_signal(int) {}
+void FlightRecorderLog::on_fatal_signal(int) {}
+void FlightRecorderLog::install_signal_handlers() {}
+void FlightRecorderLog::restore_signal_handlers() {}
+
+#endif
+
+}  // namespace neon
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "overwrite_ring.h"
+#include "recorder.h"
+#include "trace_writer.h"
+
+namespace neon {
+
+// Recording backend that keeps the most recent events of every thread in a
+// fixed-size overwrite ring and writes nothing until a dump is triggered:
+// by dump(), by dump_signal, or by a fatal signal. Each dump snapshots the
+// rings while the traced threads keep running and writes a self-contained
+// trace to file_name with the dump number inserted before the extension
+// (cxxtrace.1.bin, cxxtrace.2.bin, ...).
+class FlightRecorderLog : public Recorder {
+   public:
+    struct CreateOption {
+        std::size_t capacity{8192};  // events per thread
+        std::string file_name{"cxxtrace.bin"};
+        // only events that ended within the window, 0 for the whole rings
+        std::chrono::milliseconds window{0};
+        // dumps on this signal, 0 installs no handler
+        int dump_signal{0};
+        // dumps on SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT before the
+        // default action runs
+        bool dump_on_crash{false};
+        ClockCalibration calibration{};
+        std::uint32_t counter_mask{0};
+    };
+    explicit FlightRecorderLog(CreateOption const& options);
+    ~FlightRecorderLog() override;
+
+    void record(TraceEvent const& event) override;
+    bool dump() override;
+
+   private:
+    friend struct TraceLocal;
+    struct ThreadRing {
+        explicit ThreadRing(std::size_t capacity) : ring{capacity} {}
+        OverwriteRing<TraceEvent> ring;
+        std::atomic<bool> retired{false};
+    };
+    struct LocalRing;
+
+    ThreadRing* local_ring();
+    void install_signal_handlers();
+    void restore_signal_handlers();
+    // woken through wake_fd_[0] by the signal handlers
+    void dump_loop();
+    static void on_dump_signal(int signal);
+    static void on_fatal_signal(int signal);
+
+    CreateOption options_;
+    std::mutex rings_mutex_;
+    std::vector<std::shared_ptr<ThreadRing>> rings_;
+    std::mutex dump_mutex_;
+    std::uint32_t dumps_{0};
+    std::atomic<std::uint32_t> signal_dumps_{0};
+    int wake_fd_[2]{-1, -1};
+    std::thread dumper_;
+};
+
+}  // namespace neon
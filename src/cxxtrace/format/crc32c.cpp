@@ -0,0 +1,73 @@
+#include "crc32c.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define CXXTRACE_CRC32C_SSE42 1
+#else
+#define CXXTRACE_CRC32C_SSE42 0
+#endif
+
+namespace neon {
+namespace format {
+
+static constexpr std::uint32_t kPolynomial = 0x82f63b78;  // reflected
+
+struct Crc32cTable {
+    std::uint32_t entries[256];
+    Crc32cTable() {
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = crc & 1 ? (crc >> 1) ^ kPolynomial : crc >> 1;
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+static std::uint32_t crc32c_table(const std::uint8_t* data, std::size_t size,
+                                  std::uint32_t crc) {
+    static const Crc32cTable table;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if CXXTRACE_CRC32C_SSE42
+__attribute__((target("sse4.2"))) static std::uint32_t crc32c_sse42(
+    const std::uint8_t* data, std::size_t size, std::uint32_t crc) {
+    std::uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, data += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<std::uint32_t>(crc64);
+    for (; size > 0; --size, ++data) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+static bool has_sse42() {
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+}
+#endif
+
+std::uint32_t Crc32c(const void* data, std::size_t size, std::uint32_t crc) {
+    auto bytes = static_cast<const std::uint8_t*>(data);
+    crc = ~crc;
+#if CXXTRACE_CRC32C_SSE42
+    if (has_sse42()) {
+        return ~crc32c_sse42(bytes, size, crc);
+    }
+#endif
+    return ~crc32c_table(bytes, size, crc);
+}
+
+}  // namespace format
+}  // namespace neon
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace neon {
+namespace format {
+
+// CRC-32C (Castagnoli) of data, continuing from crc for chained calls. Uses
+// the SSE4.2 crc32 instruction where the CPU has it.
+std::uint32_t Crc32c(const void* data, std::size_t size,
+                     std::uint32_t crc = 0);
+
+}  // namespace format
+}  // namespace neon
@@ -0,0 +1,226 @@
+#include "event_block.h"
+
+#include <cstring>
+
+#include "stream_vbyte.h"
+
+namespace neon {
+namespace format {
+
+namespace {
+enum Column {
+    kEndDelta,
+    kDuration,
+    kSiteId,
+    kDepth,
+    kWeight,
+    kFiltered,
+    kTaskClock,
+    kAllocated,
+    kDeallocated,
+    kCycles,
+    kInstructions,
+    kLlcMisses,
+    kBranchMisses,
+    kDtlbMisses,
+    kColumnCount,
+};
+}  // namespace
+static constexpr unsigned kColumnsWithCounters = Column::kColumnCount;
+static constexpr unsigned kColumnsWithoutCounters = Column::kCycles;
+
+static std::uint64_t zigzag(std::int64_t value) {
+    return (static_cast<std::uint64_t>(value) << 1) ^
+           static_cast<std::uint64_t>(value >> 63);
+}
+
+static std::int64_t unzigzag(std::uint64_t value) {
+    return static_cast<std::int64_t>(value >> 1) ^
+           -static_cast<std::int64_t>(value & 1);
+}
+
+static std::int64_t end_of(EventRecord const& event) {
+    return static_cast<std::int64_t>(static_cast<std::uint64_t>(event.ts) +
+                                     event.duration);
+}
+
+// The column value of an event, everything but kEndDelta.
+static std::uint64_t column_value(EventRecord const& event, unsigned column) {
+    switch (column) {
+        case kDuration:
+            return static_cast<std::uint64_t>(event.duration);
+        case kSiteId:
+            return event.site_id;
+        case kDepth:
+            return event.depth;
+        case kWeight:
+            // almost always 1, stored as 0
+            return static_cast<std::uint32_t>(event.weight - 1);
+        case kFiltered:
+            return event.filtered;
+        case kTaskClock:
+            return static_cast<std::uint64_t>(event.task_clock_ns);
+        case kAllocated:
+            return static_cast<std::uint64_t>(event.allocated_heap_bytes);
+        case kDeallocated:
+            return static_cast<std::uint64_t>(event.deallocated_heap_bytes);
+        case Column::kCycles:
+            return event.cycles;
+        case Column::kInstructions:
+            return event.instructions;
+        case Column::kLlcMisses:
+            return event.llc_misses;
+        case Column::kBranchMisses:
+            return event.branch_misses;
+        case Column::kDtlbMisses:
+        default:
+            return event.dtlb_misses;
+    }
+}
+
+static void set_column_value(EventRecord& event, unsigned column,
+                             std::uint64_t value) {
+    switch (column) {
+        case kDuration:
+            event.duration = static_cast<std::int64_t>(value);
+            break;
+        case kSiteId:
+            event.site_id = static_cast<std::uint32_t>(value);
+            break;
+        case kDepth:
+            event.depth = static_cast<std::uint16_t>(value);
+            break;
+        case kWeight:
+            event.weight = static_cast<std::uint32_t>(value) + 1;
+            break;
+        case kFiltered:
+            event.filtered = static_cast<std::uint32_t>(value);
+            break;
+        case kTaskClock:
+            event.task_clock_ns = static_cast<std::int64_t>(value);
+            break;
+        case kAllocated:
+            event.allocated_heap_bytes = static_cast<std::int64_t>(value);
+            break;
+        case kDeallocated:
+            event.deallocated_heap_bytes = static_cast<std::int64_t>(value);
+            break;
+        case Column::kCycles:
+            event.cycles = value;
+            break;
+        case Column::kInstructions:
+            event.instructions = value;
+            break;
+        case Column::kLlcMisses:
+            event.llc_misses = value;
+            break;
+        case Column::kBranchMisses:
+            event.branch_misses = value;
+            break;
+        case Column::kDtlbMisses:
+        default:
+            event.dtlb_misses = value;
+            break;
+    }
+}
+
+void EncodeEventBlock(const EventRecord* events, std::size_t count,
+                      bool counters, std::vector<std::uint8_t>& out) {
+    EventBlockHeader header{};
+    header.tid = count > 0 ? events[0].tid : 0;
+    header.count = static_cast<std::uint16_t>(count);
+    header.columns = static_cast<std::uint8_t>(
+        counters ? kColumnsWithCounters : kColumnsWithoutCounters);
+    header.first_end = count > 0 ? end_of(events[0]) : 0;
+
+    std::uint64_t values[kEventBlockEvents];
+    std::vector<std::uint32_t> words;
+    words.reserve(count * header.columns);
+    for (unsigned column = 0; column < header.columns; ++column) {
+        std::int64_t previous_end = header.first_end;
+        bool wide = false;
+        for (std::size_t i = 0; i < count; ++i) {
+            if (column == kEndDelta) {
+                const std::int64_t end = end_of(events[i]);
+                values[i] = zigzag(end - previous_end);
+                previous_end = end;
+            } else {
+                values[i] = column_value(events[i], column);
+            }
+            wide = wide || (values[i] >> 32) != 0;
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            words.push_back(static_cast<std::uint32_t>(values[i]));
+        }
+        if (wide) {
+            header.wide |= 1u << column;
+            for (std::size_t i = 0; i < count; ++i) {
+                words.push_back(static_cast<std::uint32_t>(values[i] >> 32));
+            }
+        }
+    }
+    const std::size_t offset = out.size();
+    out.resize(offset + sizeof(header));
+    std::memcpy(out.data() + offset, &header, sizeof(header));
+    StreamVByteEncode(words.data(), words.size(), out);
+}
+
+bool DecodeEventBlock(const void* payload, std::size_t size,
+                      std::vector<EventRecord>& out) {
+    EventBlockHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, payload, sizeof(header));
+    if (header.count > kEventBlockEvents || header.columns > kColumnCount ||
+        header.columns <= kEndDelta) {
+        return false;
+    }
+    const std::size_t count = header.count;
+    std::size_t streams = header.columns;
+    for (unsigned column = 0; column < header.columns; ++column) {
+        streams += (header.wide >> column) & 1;
+    }
+    std::vector<std::uint32_t> words(streams * count);
+    const auto data = static_cast<const std::uint8_t*>(payload);
+    if (count > 0 && StreamVByteDecode(data + sizeof(header),
+                                       size - sizeof(header), words.size(),
+                                       words.data()) == 0) {
+        return false;
+    }
+
+    const std::size_t first = out.size();
+    EventRecord blank{};
+    blank.type = EventType::kScopeComplete;
+    blank.tid = header.tid;
+    out.resize(first + count, blank);
+    EventRecord* events = out.data() + first;
+    const std::uint32_t* word = words.data();
+    std::int64_t end = header.first_end;
+    for (unsigned column = 0; column < header.columns; ++column) {
+        const std::uint32_t* high =
+            (header.wide >> column) & 1 ? word + count : nullptr;
+        for (std::size_t i = 0; i < count; ++i) {
+            std::uint64_t value = word[i];
+            if (high) {
+                value |= static_cast<std::uint64_t>(high[i]) << 32;
+            }
+            if (column == kEndDelta) {
+                end += unzigzag(value);
+                // ts is completed once the duration is known
+                events[i].ts = end;
+            } else {
+                set_column_value(events[i], column, value);
+            }
+        }
+        word += high ? 2 * count : count;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        events[i].ts = static_cast<std::int64_t>(
+            static_cast<std::uint64_t>(events[i].ts) - events[i].duration);
+    }
+    return true;
+}
+
+}  // namespace format
+}  // namespace neon
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "trace_format.h"
+
+namespace neon {
+namespace format {
+
+// Appends the kEventBlock payload of events[0, count) to out. All events
+// must be of one thread; count is at most kEventBlockEvents. The counter
+// columns are written when counters is set.
+void EncodeEventBlock(const EventRecord* events, std::size_t count,
+                      bool counters, std::vector<std::uint8_t>& out);
+
+// Appends the events of a kEventBlock payload to out; false if the payload
+// is malformed.
+bool DecodeEventBlock(const void* payload, std::size_t size,
+                      std::vector<EventRecord>& out);
+
+}  // namespace format
+}  // namespace neon
@@ -0,0 +1,130 @@
+#include "stream_vbyte.h"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <tmmintrin.h>
+#define CXXTRACE_SVB_SSSE3 1
+#else
+#define CXXTRACE_SVB_SSSE3 0
+#endif
+
+namespace neon {
+namespace format {
+
+static std::uint8_t length_code(std::uint32_t value) {
+    return value == 0 ? 0 : value < (1u << 8) ? 1 : value < (1u << 16) ? 2 : 3;
+}
+
+static std::size_t code_bytes(unsigned code) { return code == 3 ? 4 : code; }
+
+void StreamVByteEncode(const std::uint32_t* values, std::size_t count,
+                       std::vector<std::uint8_t>& out) {
+    const std::size_t control_bytes = (count + 3) / 4;
+    const std::size_t control = out.size();
+    out.resize(out.size() + control_bytes, 0);
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::uint32_t value = values[i];
+        const std::uint8_t code = length_code(value);
+        out[control + i / 4] |=
+            static_cast<std::uint8_t>(code << (2 * (i % 4)));
+        for (std::size_t b = 0; b < code_bytes(code); ++b) {
+            out.push_back(static_cast<std::uint8_t>(value >> (8 * b)));
+        }
+    }
+}
+
+// Decodes values [first, count) one at a time.
+static bool decode_scalar(const std::uint8_t* control,
+                          const std::uint8_t*& data, const std::uint8_t* end,
+                          std::size_t first, std::size_t count,
+                          std::uint32_t* values) {
+    for (std::size_t i = first; i < count; ++i) {
+        const unsigned code = (control[i / 4] >> (2 * (i % 4))) & 3;
+        const std::size_t bytes = code_bytes(code);
+        if (static_cast<std::size_t>(end - data) < bytes) {
+            return false;
+        }
+        std::uint32_t value = 0;
+        for (std::size_t b = 0; b < bytes; ++b) {
+            value |= static_cast<std::uint32_t>(data[b]) << (8 * b);
+        }
+        values[i] = value;
+        data += bytes;
+    }
+    return true;
+}
+
+#if CXXTRACE_SVB_SSSE3
+// For every control byte: the pshufb mask that moves its four values from
+// the data bytes into 32-bit lanes, and how many data bytes they take.
+struct ShuffleTable {
+    alignas(16) std::uint8_t shuffle[256][16];
+    std::uint8_t length[256];
+
+    ShuffleTable() {
+        for (unsigned control = 0; control < 256; ++control) {
+            std::uint8_t offset = 0;
+            for (unsigned lane = 0; lane < 4; ++lane) {
+                const std::size_t bytes =
+                    code_bytes((control >> (2 * lane)) & 3);
+                for (unsigned b = 0; b < 4; ++b) {
+                    shuffle[control][lane * 4 + b] =
+                        b < bytes ? static_cast<std::uint8_t>(offset + b)
+                                  : 0x80;  // zeroes the byte
+                }
+                offset = static_cast<std::uint8_t>(offset + bytes);
+            }
+            length[control] = offset;
+        }
+    }
+};
+
+// Decodes whole groups of four while 16 bytes can be loaded safely; returns
+// the number of values decoded.
+__attribute__((target("ssse3"))) static std::size_t decode_ssse3(
+    const std::uint8_t* control, const std::uint8_t*& data,
+    const std::uint8_t* end, std::size_t count, std::uint32_t* values) {
+    static const ShuffleTable table;
+    std::size_t i = 0;
+    for (; i + 4 <= count && end - data >= 16; i += 4) {
+        const std::uint8_t key = control[i / 4];
+        const __m128i bytes =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        const __m128i mask = _mm_load_si128(
+            reinterpret_cast<const __m128i*>(table.shuffle[key]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i),
+                         _mm_shuffle_epi8(bytes, mask));
+        data += table.length[key];
+    }
+    return i;
+}
+
+static bool has_ssse3() {
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+}
+#endif
+
+std::size_t StreamVByteDecode(const std::uint8_t* in, std::size_t size,
+                              std::size_t count, std::uint32_t* values) {
+    const std::size_t control_bytes = (count + 3) / 4;
+    if (size < control_bytes) {
+        return 0;
+    }
+    const std::uint8_t* end = in + size;
+    const std::uint8_t* data = in + control_bytes;
+    std::size_t decoded = 0;
+#if CXXTRACE_SVB_SSSE3
+    if (has_ssse3()) {
+        decoded = decode_ssse3(in, data, end, count, values);
+    }
+#endif
+    if (!decode_scalar(in, data, end, decoded, count, values)) {
+        return 0;
+    }
+    return static_cast<std::size_t>(data - in);
+}
+
+}  // namespace format
+}  // namespace neon
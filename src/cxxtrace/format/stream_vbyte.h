@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Stream VByte (Lemire et al.) with the "0124" length codes: each 32-bit
+// value takes 0, 1, 2 or 4 little-endian bytes, so zeros cost only their
+// 2-bit code. The encoding of count values is (count + 3) / 4 control
+// bytes, value i in bits 2 * (i % 4) of control byte i / 4, followed by the
+// data bytes of all values. Control and data are apart so that a decoder
+// can expand four values with one byte shuffle.
+namespace neon {
+namespace format {
+
+// Appends the encoding of values[0, count) to out.
+void StreamVByteEncode(const std::uint32_t* values, std::size_t count,
+                       std::vector<std::uint8_t>& out);
+
+// Decodes count values into values. Returns the bytes of in consumed, 0 if
+// size is too short for them. Uses SSSE3 where the CPU has it.
+std::size_t StreamVByteDecode(const std::uint8_t* in, std::size_t size,
+                              std::size_t count, std::uint32_t* values);
+
+}  // namespace format
+}  // namespace neon
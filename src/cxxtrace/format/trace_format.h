@@ -0,0 +1,272 @@
+#pragma once
+#include <cstdint>
+
+// On-disk layout of a cxxtrace binary trace. All integers are little-endian.
+//
+//   FileHeader
+//   { RecordHeader payload }*
+//
+// or that byte stream compressed, see CompressedFileHeader.
+//
+// Strings (tags, file names) are interned: a kString record defines an id
+// before the first record that refers to it. Likewise every call site is
+// described once by a kSite record and events only carry its id. Events
+// are written in kEventBlock records, see EventBlockHeader. Readers skip
+// record types they do not know by RecordHeader::size.
+namespace neon {
+namespace format {
+
+constexpr std::uint32_t kMagic = 0x52545843;  // "CXTR"
+constexpr std::uint16_t kVersion = 7;
+
+enum class ClockSource : std::uint8_t {
+    kSteady = 0,
+    kCpuCounter = 1,
+    kCpuCounterOrdered = 2,
+    kMonotonicCoarse = 3,
+};
+
+// Timestamps in records are raw ticks of `clock`:
+//   ns = base_ns + (ticks - base_ticks) * ns_per_tick
+// where ns is steady_clock time. A later kClockSync record gives a second
+// (ticks, ns) point measured over the whole recording and should be preferred
+// for ns_per_tick.
+struct FileHeader {
+    std::uint32_t magic{kMagic};
+    std::uint16_t version{kVersion};
+    std::uint16_t header_size{sizeof(FileHeader)};
+    ClockSource clock{ClockSource::kSteady};
+    std::uint8_t counters{0};  // CounterBits present in EventRecord
+    std::uint8_t reserved[6]{};
+    std::int64_t base_ticks{0};
+    std::int64_t base_ns{0};
+    double ns_per_tick{1.0};
+};
+static_assert(sizeof(FileHeader) == 40, "FileHeader layout changed");
+
+enum class RecordType : std::uint16_t {
+    kString = 1,
+    kEvent = 2,
+    kSite = 3,
+    kClockSync = 4,
+    kCallNode = 5,
+    kLatency = 6,
+    kEventBlock = 7,
+    kEventsLost = 8,
+    kOverhead = 9,
+    kOverheadSummary = 10,
+};
+
+struct RecordHeader {
+    RecordType type;
+    std::uint16_t reserved{0};
+    std::uint32_t size{0};  // payload bytes following this header
+};
+static_assert(sizeof(RecordHeader) == 8, "RecordHeader layout changed");
+
+// Payload: StringRecord followed by size - sizeof(StringRecord) bytes of
+// text, not NUL terminated.
+struct StringRecord {
+    std::uint32_t id;
+};
+
+struct SiteRecord {
+    std::uint32_t id;
+    std::uint32_t tag_id;
+    std::uint32_t file_id;
+    std::int32_t line;
+};
+static_assert(sizeof(SiteRecord) == 16, "SiteRecord layout changed");
+
+struct ClockSyncRecord {
+    std::int64_t ticks;
+    std::int64_t ns;
+};
+
+// Hardware counters of the recording thread, see FileHeader::counters.
+enum CounterBits : std::uint8_t {
+    kCycles = 0b1,
+    kInstructions = 0b10,
+    kLlcMisses = 0b100,
+    kBranchMisses = 0b1000,
+    kDtlbMisses = 0b10000,
+};
+
+enum class EventType : std::uint8_t {
+    // 0 and 1 were separate scope begin/end events before version 6
+    kScopeComplete = 2,
+};
+
+// One finished scope, as a kEvent record or decoded from a kEventBlock.
+// A thread's events are in the order its scopes ended,
+// so children precede their parent; depth counts the scopes that were open
+// around this one and is enough to rebuild the nesting without sorting.
+struct EventRecord {
+    EventType type;
+    std::uint8_t reserved;
+    std::uint16_t depth;
+    std::uint32_t site_id;
+    std::uint32_t tid;
+    std::uint32_t weight;  // calls a sampled scope stands for, 0 reads as 1
+    // scopes below the minimum duration that were dropped inside this one;
+    // their cost is part of this scope's own
+    std::uint32_t filtered;
+    std::uint32_t reserved2;
+    std::int64_t ts;        // start, ticks, see FileHeader
+    std::int64_t duration;  // ticks
+    // spent inside the scope, children included
+    std::int64_t task_clock_ns;
+    std::int64_t allocated_heap_bytes;
+    std::int64_t deallocated_heap_bytes;
+    // 0 unless the bit is set in FileHeader::counters
+    std::uint64_t cycles;
+    std::uint64_t instructions;
+    std::uint64_t llc_misses;
+    std::uint64_t branch_misses;
+    std::uint64_t dtlb_misses;
+};
+static_assert(sizeof(EventRecord) == 104, "EventRecord layout changed");
+
+// Up to kEventBlockEvents consecutive events of one thread, stored column by
+// column. Each block starts from first_end and needs nothing from earlier
+// blocks, so a reader can begin at any of them. The header is followed by
+// the columns below, in this order, as one Stream VByte sequence of 32-bit
+// words (see stream_vbyte.h):
+//   end delta   zigzag(end - previous end), the first from first_end, where
+//               end = ts + duration
+//   duration, site_id, depth, weight - 1, filtered, task_clock_ns,
+//   allocated_heap_bytes, deallocated_heap_bytes
+//   cycles, instructions, llc_misses, branch_misses, dtlb_misses
+//               only if FileHeader::counters is not 0
+// A column holds count words, or, if its bit in `wide` is set, count low
+// words followed by count high words.
+constexpr std::uint32_t kEventBlockEvents = 128;
+struct EventBlockHeader {
+    std::uint32_t tid;
+    std::uint16_t count;
+    std::uint8_t columns;
+    std::uint8_t reserved;
+    std::uint32_t wide;
+    std::uint32_t reserved2;
+    std::int64_t first_end;  // ticks
+};
+static_assert(sizeof(EventBlockHeader) == 24,
+              "EventBlockHeader layout changed");
+
+// Calling-context tree mode writes no events, only one kCallNode per distinct
+// scope path and thread, aggregated over all calls. Parents precede their
+// children; self = total minus the totals of the node's children.
+struct CallNodeRecord {
+    std::uint32_t id;
+    std::uint32_t parent_id;  // 0 for the outermost scopes of a thread
+    std::uint32_t site_id;
+    std::uint32_t tid;
+    std::uint64_t count;
+    std::int64_t total_ticks;  // wall time, see FileHeader
+    std::int64_t self_ticks;
+    std::int64_t total_task_clock_ns;
+    std::int64_t self_task_clock_ns;
+    std::int64_t total_allocated_heap_bytes;
+    std::int64_t self_allocated_heap_bytes;
+    std::int64_t total_deallocated_heap_bytes;
+    std::int64_t self_deallocated_heap_bytes;
+};
+static_assert(sizeof(CallNodeRecord) == 88, "CallNodeRecord layout changed");
+
+// Scope duration percentiles of one tag over the whole recording, written
+// when the trace is closed. Values are upper bounds of log-linear histogram
+// buckets, at most 1/32 above the exact value.
+struct LatencyRecord {
+    std::uint32_t tag_id;
+    std::uint32_t reserved;
+    std::uint64_t count;
+    std::int64_t wall_ns[5];  // p50, p90, p99, p99.9, max
+    std::int64_t task_clock_ns[5];
+};
+static_assert(sizeof(LatencyRecord) == 96, "LatencyRecord layout changed");
+
+// count events of thread tid were dropped because the backend queue was
+// full. They ended somewhere between after_ts and before_ts (ticks), so
+// the thread's timeline is incomplete in that interval. after_ts is 0 when
+// nothing of the thread was written before.
+struct EventsLostRecord {
+    std::uint32_t tid;
+    std::uint32_t reserved;
+    std::uint64_t count;
+    std::int64_t after_ts;
+    std::int64_t before_ts;
+};
+static_assert(sizeof(EventsLostRecord) == 32,
+              "EventsLostRecord layout changed");
+
+// Time the tracer itself took, see TraceOption::overhead_sample_rate.
+// Written with every clock sync, one per running thread and section, and
+// under tid 0 the sum of the threads that have exited, cumulative since
+// tracing was enabled. Of calls, sampled were measured and took
+// ticks and task_clock_ns; calls * ticks / sampled estimates the total.
+enum class OverheadSection : std::uint8_t {
+    kScopeBegin = 0,  // TraceSectionBegin
+    kScopeEnd = 1,    // TraceSectionEnd
+    kMalloc = 2,      // malloc hook
+    kWriter = 3,      // encoding on the backend's consumer thread
+};
+struct OverheadRecord {
+    std::uint32_t tid;
+    OverheadSection section;
+    std::uint8_t reserved[3];
+    std::uint64_t calls;
+    std::uint64_t sampled;
+    std::int64_t ticks;
+    std::int64_t task_clock_ns;
+};
+static_assert(sizeof(OverheadRecord) == 40, "OverheadRecord layout changed");
+
+// Written when the trace is closed, over all files of a rotated trace.
+struct OverheadSummaryRecord {
+    std::uint64_t events;       // written
+    std::uint64_t bytes;        // written, before compression
+    std::uint64_t lost;         // in kEventsLost records
+    std::int64_t duration_ns;   // since the trace was opened
+    std::int64_t overhead_ns;   // estimated, all threads and sections
+    double events_per_sec;
+    double ns_per_event;        // overhead_ns / events
+    double bytes_per_event;
+};
+static_assert(sizeof(OverheadSummaryRecord) == 64,
+              "OverheadSummaryRecord layout changed");
+
+// A compressed trace file is a CompressedFileHeader followed by blocks,
+// each a CompressedBlockHeader and stored_size bytes. Every block holds the
+// next raw_size bytes of the trace (FileHeader, records) and decompresses
+// on its own, so readers can decompress several at once; records span
+// blocks freely.
+constexpr std::uint32_t kCompressedMagic = 0x5a545843;  // "CXTZ"
+constexpr std::uint16_t kCompressedVersion = 1;
+
+struct CompressedFileHeader {
+    std::uint32_t magic{kCompressedMagic};
+    std::uint16_t version{kCompressedVersion};
+    std::uint16_t header_size{sizeof(CompressedFileHeader)};
+    std::uint32_t block_size{0};  // largest raw_size
+    std::uint32_t reserved{0};
+};
+static_assert(sizeof(CompressedFileHeader) == 16,
+              "CompressedFileHeader layout changed");
+
+enum class BlockCodec : std::uint8_t {
+    kStored = 0,  // raw_size bytes as they are
+    kLz4 = 1,     // one LZ4 block (LZ4_compress_default)
+};
+
+struct CompressedBlockHeader {
+    std::uint32_t stored_size;
+    std::uint32_t raw_size;  // never 0
+    std::uint32_t crc32c;  // of the stored_size bytes that follow
+    BlockCodec codec;
+    std::uint8_t reserved[3];
+};
+static_assert(sizeof(CompressedBlockHeader) == 16,
+              "CompressedBlockHeader layout changed");
+
+}  // namespace format
+}  // namespace neon
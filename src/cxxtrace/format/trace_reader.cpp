@@ -0,0 +1,235 @@
+#include "trace_reader.h"
+
+#include <lz4.h>
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <thread>
+
+#include "crc32c.h"
+#include "event_block.h"
+
+namespace neon {
+namespace format {
+
+tl::expected<TraceReader, std::string> TraceReader::open(
+    std::string const& path) {
+    TraceReader reader;
+    reader.file_.reset(std::fopen(path.c_str(), "rb"));
+    if (!reader.file_) {
+        return tl::make_unexpected("cannot open " + path);
+    }
+    std::FILE* file = reader.file_.get();
+    CompressedFileHeader container;
+    if (std::fread(&container.magic, sizeof(container.magic), 1, file) == 1 &&
+        container.magic == kCompressedMagic) {
+        if (std::fread(&container.version,
+                       sizeof(container) - sizeof(container.magic), 1,
+                       file) != 1 ||
+            container.version != kCompressedVersion) {
+            return tl::make_unexpected(
+                path + ": unsupported compressed trace version");
+        }
+        std::fseek(file, container.header_size, SEEK_SET);
+        reader.compressed_ = true;
+        reader.block_size_ = container.block_size;
+    } else {
+        std::rewind(file);
+    }
+    FileHeader& header = reader.header_;
+    if (reader.read_bytes(&header, sizeof(header)) != sizeof(header) ||
+        header.magic != kMagic) {
+        return tl::make_unexpected(path + " is not a cxxtrace binary trace");
+    }
+    if (header.version != kVersion) {
+        return tl::make_unexpected(
+            path + ": unsupported trace version " +
+            std::to_string(header.version) + ", expected " +
+            std::to_string(kVersion));
+    }
+    if (header.header_size > sizeof(header)) {
+        std::vector<char> rest(header.header_size - sizeof(header));
+        reader.read_bytes(rest.data(), rest.size());
+    }
+    return reader;
+}
+
+std::size_t TraceReader::read_bytes(void* data, std::size_t size) {
+    if (!compressed_) {
+        const std::size_t read = std::fread(data, 1, size, file_.get());
+        truncated_ = truncated_ || std::ferror(file_.get());
+        return read;
+    }
+    auto out = static_cast<char*>(data);
+    std::size_t read = 0;
+    while (read < size) {
+        if (blocks_.empty() && !read_blocks()) {
+            break;
+        }
+        std::vector<char> const& block = blocks_.front();
+        const std::size_t chunk =
+            std::min(size - read, block.size() - block_offset_);
+        std::memcpy(out + read, block.data() + block_offset_, chunk);
+        read += chunk;
+        block_offset_ += chunk;
+        if (block_offset_ == block.size()) {
+            blocks_.pop_front();
+            block_offset_ = 0;
+        }
+    }
+    return read;
+}
+
+// Reads the next few blocks and decompresses them in parallel. A block that
+// is cut short or fails its checksum ends the trace, as does an empty one:
+// the zeroed tail of a mapped file left by a crash would pass the checksum.
+bool TraceReader::read_blocks() {
+    if (blocks_end_) {
+        return false;
+    }
+    const std::size_t read_ahead = std::max(
+        1u, std::min(16u, std::thread::hardware_concurrency()));
+    std::vector<CompressedBlockHeader> headers;
+    std::vector<std::vector<char>> stored;
+    while (headers.size() < read_ahead) {
+        CompressedBlockHeader header;
+        const std::size_t got =
+            std::fread(&header, 1, sizeof(header), file_.get());
+        if (got != sizeof(header)) {
+            blocks_end_ = true;
+            truncated_ = truncated_ || got != 0 || std::ferror(file_.get());
+            break;
+        }
+        std::vector<char> data(header.stored_size);
+        if (header.raw_size == 0 || header.raw_size > block_size_ ||
+            (header.codec == BlockCodec::kStored &&
+             header.stored_size != header.raw_size) ||
+            std::fread(data.data(), 1, data.size(), file_.get()) !=
+                data.size() ||
+            Crc32c(data.data(), data.size()) != header.crc32c) {
+            blocks_end_ = true;
+            truncated_ = true;
+            break;
+        }
+        headers.push_back(header);
+        stored.push_back(std::move(data));
+    }
+    std::vector<std::future<std::vector<char>>> raw;
+    for (std::size_t i = 0; i < headers.size(); ++i) {
+        if (headers[i].codec == BlockCodec::kStored) {
+            std::promise<std::vector<char>> same;
+            same.set_value(std::move(stored[i]));
+            raw.push_back(same.get_future());
+            continue;
+        }
+        raw.push_back(std::async(
+            std::launch::async,
+            [](CompressedBlockHeader const& header,
+               std::vector<char> const& data) {
+                std::vector<char> bytes(header.raw_size);
+                const int size = LZ4_decompress_safe(
+                    data.data(), bytes.data(), static_cast<int>(data.size()),
+                    static_cast<int>(bytes.size()));
+                if (header.codec != BlockCodec::kLz4 ||
+                    size != static_cast<int>(bytes.size())) {
+                    bytes.clear();
+                }
+                return bytes;
+            },
+            std::cref(headers[i]), std::cref(stored[i])));
+    }
+    for (std::size_t i = 0; i < raw.size(); ++i) {
+        std::vector<char> bytes = raw[i].get();
+        if (bytes.size() != headers[i].raw_size) {
+            blocks_end_ = true;
+            truncated_ = true;
+            break;
+        }
+        if (!bytes.empty()) {
+            blocks_.push_back(std::move(bytes));
+        }
+    }
+    return !blocks_.empty();
+}
+
+bool TraceReader::read_record(Record& record) {
+    RecordHeader header;
+    const std::size_t got = read_bytes(&header, sizeof(header));
+    if (got != sizeof(header)) {
+        truncated_ = truncated_ || got != 0;
+        return false;
+    }
+    // No record has type 0: this is the zero-filled tail a mapped file
+    // keeps when its writer crashed before cutting it off.
+    if (static_cast<std::uint16_t>(header.type) == 0) {
+        truncated_ = true;
+        return false;
+    }
+    record.type = header.type;
+    record.payload.resize(header.size);
+    if (header.size != 0 &&
+        read_bytes(record.payload.data(), header.size) != header.size) {
+        truncated_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool TraceReader::next_block_event(Record& record) {
+    if (block_next_ == block_events_.size()) {
+        return false;
+    }
+    record.type = RecordType::kEvent;
+    record.payload.resize(sizeof(EventRecord));
+    std::memcpy(record.payload.data(), &block_events_[block_next_++],
+                sizeof(EventRecord));
+    return true;
+}
+
+bool TraceReader::next(Record& record) {
+    if (next_block_event(record)) {
+        return true;
+    }
+    while (read_record(record)) {
+        if (record.type == RecordType::kString) {
+            if (record.payload.size() >= sizeof(StringRecord)) {
+                auto const& str = record.as<StringRecord>();
+                strings_[str.id].assign(
+                    record.payload.data() + sizeof(StringRecord),
+                    record.payload.size() - sizeof(StringRecord));
+            }
+        } else if (record.type == RecordType::kSite) {
+            if (record.payload.size() >= sizeof(SiteRecord)) {
+                auto const& site = record.as<SiteRecord>();
+                sites_[site.id] = site;
+            }
+        } else if (record.type == RecordType::kEventBlock) {
+            block_events_.clear();
+            block_next_ = 0;
+            // a malformed block is skipped, the next one resyncs
+            if (DecodeEventBlock(record.payload.data(), record.payload.size(),
+                                 block_events_) &&
+                next_block_event(record)) {
+                return true;
+            }
+        } else {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string const& TraceReader::string(std::uint32_t id) const {
+    static const std::string empty;
+    auto it = strings_.find(id);
+    return it == strings_.end() ? empty : it->second;
+}
+
+SiteRecord const* TraceReader::site(std::uint32_t id) const {
+    auto it = sites_.find(id);
+    return it == sites_.end() ? nullptr : &it->second;
+}
+
+}  // namespace format
+}  // namespace neon
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <tl/expected.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "trace_format.h"
+
+namespace neon {
+namespace format {
+
+struct Record {
+    RecordType type;
+    std::vector<char> payload;
+
+    template <typename T>
+    T const& as() const {
+        return *reinterpret_cast<T const*>(payload.data());
+    }
+};
+
+// Converts record timestamps to steady_clock nanoseconds.
+class TickConverter {
+   public:
+    explicit TickConverter(FileHeader const& header)
+        : base_ticks_{header.base_ticks},
+          base_ns_{header.base_ns},
+          ns_per_tick_{header.ns_per_tick} {}
+    // Re-derives the tick rate from a sync point taken later in the trace.
+    void refine(ClockSyncRecord const& sync) {
+        if (sync.ticks > base_ticks_) {
+            ns_per_tick_ = static_cast<double>(sync.ns - base_ns_) /
+                           static_cast<double>(sync.ticks - base_ticks_);
+        }
+    }
+    std::int64_t to_ns(std::int64_t ticks) const {
+        return base_ns_ + static_cast<std::int64_t>(
+                              static_cast<double>(ticks - base_ticks_) *
+                              ns_per_tick_);
+    }
+    std::int64_t duration_ns(std::int64_t ticks) const {
+        return static_cast<std::int64_t>(static_cast<double>(ticks) *
+                                         ns_per_tick_);
+    }
+
+   private:
+    std::int64_t base_ticks_;
+    std::int64_t base_ns_;
+    double ns_per_tick_;
+};
+
+// Sequential reader for a binary trace, compressed or not. String and site
+// records are consumed
+// internally and exposed through string() and site(). Event blocks are
+// decoded and returned as one kEvent record per event; every other record
+// is returned by next() as is.
+class TraceReader {
+   public:
+    static tl::expected<TraceReader, std::string> open(std::string const& path);
+
+    FileHeader const& header() const noexcept { return header_; }
+    // Returns false at end of file. A record cut short by a crash, or the
+    // zeroed tail of a mapped file that was never cut off, ends the trace
+    // as well and sets truncated().
+    bool next(Record& record);
+    bool truncated() const noexcept { return truncated_; }
+    std::string const& string(std::uint32_t id) const;
+    // nullptr if the site was never defined
+    SiteRecord const* site(std::uint32_t id) const;
+
+   private:
+    struct FileCloser {
+        void operator()(std::FILE* file) const { std::fclose(file); }
+    };
+    TraceReader() = default;
+    // Like fread on the decompressed stream; returns the bytes read.
+    std::size_t read_bytes(void* data, std::size_t size);
+    bool read_blocks();
+    bool read_record(Record& record);
+    // Returns the next decoded event of the current block as record.
+    bool next_block_event(Record& record);
+
+    std::unique_ptr<std::FILE, FileCloser> file_;
+    FileHeader header_;
+    bool truncated_{false};
+    std::unordered_map<std::uint32_t, std::string> strings_;
+    std::unordered_map<std::uint32_t, SiteRecord> sites_;
+    std::vector<EventRecord> block_events_;
+    std::size_t block_next_{0};
+    // compressed traces: decompressed blocks not consumed yet
+    bool compressed_{false};
+    std::uint32_t block_size_{0};
+    std::deque<std::vector<char>> blocks_;
+    std::size_t block_offset_{0};
+    bool blocks_end_{false};
+};
+
+}  // namespace format
+}  // namespace neon
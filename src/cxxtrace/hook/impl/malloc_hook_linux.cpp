@@ -84,6 +84,7 @@ bool MallocInterposition::install() {
         if (plthook) {
             plthook_close(plthook);
         }
+        return true;
     });
     return true;
 }
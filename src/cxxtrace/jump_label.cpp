@@ -0,0 +1,356 @@
+#include "jump_label.h"
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+
+#if CXXTRACE_STATIC_KEYS
+#include <fcntl.h>
+#include <linux/membarrier.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#endif
+
+namespace neon {
+
+#if CXXTRACE_STATIC_KEYS
+
+static constexpr std::size_t kInsnSize = 5;
+static const std::uint8_t kNop[kInsnSize] = {0x0f, 0x1f, 0x44, 0x00, 0x00};
+static constexpr std::uint8_t kInt3 = 0xcc;
+
+namespace {
+
+struct Table {
+    TraceJumpEntry const* begin;
+    TraceJumpEntry const* end;
+};
+
+// Leaked, so that modules unregistering at exit still find them.
+struct Registry {
+    std::mutex mutex;
+    std::vector<Table> tables;
+    bool enabled{false};
+};
+
+Registry& registry() {
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+// A site being rewritten and where a thread that hits its int3 goes on.
+struct PatchSite {
+    std::uintptr_t code;
+    std::uintptr_t resume;
+};
+
+// The sites of the latest patch, sorted by code, for the SIGTRAP handler.
+// A thread may take the trap just before the int3 is replaced and enter
+// the handler later, so the sites of a patch stay published until the next
+// one and its buffer is reused only by the patch after that.
+std::vector<PatchSite> g_patch_buffers_[2];
+std::atomic<std::vector<PatchSite> const*> g_patch_{nullptr};
+struct sigaction g_previous_trap_;
+
+void on_trap(int signal, siginfo_t* info, void* context) {
+    auto* uc = static_cast<ucontext_t*>(context);
+    // the int3 has been executed, rip is past it
+    const auto address =
+        static_cast<std::uintptr_t>(uc->uc_mcontext.gregs[REG_RIP]) - 1;
+    if (auto const* sites = g_patch_.load(std::memory_order_acquire)) {
+        auto site = std::lower_bound(
+            sites->begin(), sites->end(), address,
+            [](PatchSite const& s, std::uintptr_t a) { return s.code < a; });
+        if (site != sites->end() && site->code == address) {
+            uc->uc_mcontext.gregs[REG_RIP] =
+                static_cast<greg_t>(site->resume);
+            return;
+        }
+    }
+    if (g_previous_trap_.sa_flags & SA_SIGINFO) {
+        g_previous_trap_.sa_sigaction(signal, info, context);
+    } else if (g_previous_trap_.sa_handler == SIG_DFL) {
+        ::signal(SIGTRAP, SIG_DFL);
+        raise(SIGTRAP);
+    } else if (g_previous_trap_.sa_handler != SIG_IGN) {
+        g_previous_trap_.sa_handler(signal);
+    }
+}
+
+// Once and for good: a thread that has hit an int3 may be delivered the
+// signal after the patch is over.
+bool install_trap_handler() {
+    static const bool installed = [] {
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_sigaction = on_trap;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        return sigaction(SIGTRAP, &action, &g_previous_trap_) == 0;
+    }();
+    return installed;
+}
+
+// Makes every thread of the process execute a serializing instruction, as
+// cross-modifying code requires before it may run the new bytes. Kernels
+// without the SYNC_CORE command still interrupt each running thread, and
+// return from the interrupt with iret, which serializes.
+void sync_cores() {
+    static const int command = [] {
+        if (syscall(
+                __NR_membarrier,
+                MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE, 0) == 0) {
+            return static_cast<int>(MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE);
+        }
+        if (syscall(__NR_membarrier,
+                    MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0) {
+            return static_cast<int>(MEMBARRIER_CMD_PRIVATE_EXPEDITED);
+        }
+        return static_cast<int>(MEMBARRIER_CMD_SHARED);
+    }();
+    syscall(__NR_membarrier, command, 0);
+}
+
+// Writes to the code either in place, once make_writable succeeded, or
+// through /proc/self/mem, which the kernel writes past the page protection
+// where W^X policies (SELinux execmem, PaX) refuse a writable mapping.
+class CodeWriter {
+   public:
+    ~CodeWriter() { close(); }
+
+    bool open(std::vector<std::uintptr_t> const& pages,
+              std::uintptr_t page_size) {
+        pages_ = pages;
+        page_size_ = page_size;
+        if (protect(true)) {
+            return true;
+        }
+        protect(false);
+        pages_.clear();
+        mem_fd_ = ::open("/proc/self/mem", O_RDWR | O_CLOEXEC);
+        if (mem_fd_ < 0) {
+            std::cerr << "cxxtrace: code is not writable: "
+                      << std::strerror(errno) << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    bool write(std::uintptr_t address, std::uint8_t const* bytes,
+               std::size_t size) {
+        if (mem_fd_ < 0) {
+            auto* code = reinterpret_cast<volatile std::uint8_t*>(address);
+            for (std::size_t i = 0; i < size; ++i) {
+                code[i] = bytes[i];
+            }
+            return true;
+        }
+        return pwrite(mem_fd_, bytes, size, static_cast<off_t>(address)) ==
+               static_cast<ssize_t>(size);
+    }
+
+    bool close() {
+        bool ok = pages_.empty() || protect(false);
+        pages_.clear();
+        if (mem_fd_ >= 0) {
+            ::close(mem_fd_);
+            mem_fd_ = -1;
+        }
+        return ok;
+    }
+
+   private:
+    bool protect(bool writable) {
+        const int prot =
+            PROT_READ | PROT_EXEC | (writable ? PROT_WRITE : PROT_NONE);
+        for (std::uintptr_t page : pages_) {
+            if (mprotect(reinterpret_cast<void*>(page), page_size_, prot) !=
+                0) {
+                if (!writable) {
+                    std::cerr << "cxxtrace: mprotect of code failed: "
+                              << std::strerror(errno) << '\n';
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::uintptr_t> pages_;
+    std::uintptr_t page_size_{0};
+    int mem_fd_{-1};
+};
+
+void instruction(TraceJumpEntry const& entry, bool enabled,
+                 std::uint8_t* insn) {
+    if (enabled) {
+        const std::int32_t rel = static_cast<std::int32_t>(
+            entry.target - (entry.code + kInsnSize));
+        insn[0] = 0xe9;
+        std::memcpy(insn + 1, &rel, sizeof(rel));
+    } else {
+        std::memcpy(insn, kNop, kInsnSize);
+    }
+}
+
+// Rewrites the sites of the tables whose instruction differs, with the
+// protocol x86 requires for code other threads may be running: an int3
+// goes over the first byte, then the rest of the instruction is written,
+// then its first byte, with all cores serialized after each step. A thread
+// reaching a site in between traps and continues where the new instruction
+// leads.
+bool patch(std::vector<Table> const& tables, bool enabled) {
+    struct Change {
+        std::uintptr_t code;
+        std::uintptr_t resume;
+        std::uint8_t insn[kInsnSize];
+    };
+    std::vector<Change> changes;
+    const auto page_size = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    std::vector<std::uintptr_t> pages;
+    for (Table const& table : tables) {
+        for (auto entry = table.begin; entry != table.end; ++entry) {
+            const std::intptr_t distance =
+                static_cast<std::intptr_t>(entry->target - entry->code);
+            if (distance > INT32_MAX || distance < INT32_MIN) {
+                std::cerr << "cxxtrace: jump label target out of range\n";
+                return false;
+            }
+            Change change;
+            change.code = entry->code;
+            change.resume = enabled ? entry->target : entry->code + kInsnSize;
+            instruction(*entry, enabled, change.insn);
+            if (std::memcmp(reinterpret_cast<void const*>(entry->code),
+                            change.insn, kInsnSize) == 0) {
+                continue;
+            }
+            changes.push_back(change);
+            // the instruction is 8 byte aligned, within one page
+            pages.push_back(entry->code & ~(page_size - 1));
+        }
+    }
+    if (changes.empty()) {
+        return true;
+    }
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+    std::vector<PatchSite>& sites =
+        g_patch_.load(std::memory_order_relaxed) == &g_patch_buffers_[0]
+            ? g_patch_buffers_[1]
+            : g_patch_buffers_[0];
+    sites.clear();
+    for (Change const& change : changes) {
+        sites.push_back(PatchSite{change.code, change.resume});
+    }
+    std::sort(sites.begin(), sites.end(),
+              [](PatchSite const& a, PatchSite const& b) {
+                  return a.code < b.code;
+              });
+    g_patch_.store(&sites, std::memory_order_release);
+    if (!install_trap_handler()) {
+        std::cerr << "cxxtrace: cannot install the SIGTRAP handler\n";
+        return false;
+    }
+
+    CodeWriter writer;
+    if (!writer.open(pages, page_size)) {
+        return false;
+    }
+    bool ok = true;
+    for (Change const& change : changes) {
+        ok = writer.write(change.code, &kInt3, 1) && ok;
+    }
+    sync_cores();
+    for (Change const& change : changes) {
+        ok = writer.write(change.code + 1, change.insn + 1, kInsnSize - 1) &&
+             ok;
+    }
+    sync_cores();
+    for (Change const& change : changes) {
+        ok = writer.write(change.code, change.insn, 1) && ok;
+    }
+    sync_cores();
+    return writer.close() && ok;
+}
+
+}  // namespace
+
+namespace detail {
+
+void RegisterJumpTable(TraceJumpEntry const* begin,
+                       TraceJumpEntry const* end) {
+    if (begin == end) {
+        return;
+    }
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (Table const& table : r.tables) {
+        if (table.begin == begin) {
+            return;
+        }
+    }
+    r.tables.push_back(Table{begin, end});
+    // a module loaded while tracing is enabled
+    if (r.enabled) {
+        patch({Table{begin, end}}, true);
+    }
+}
+
+void UnregisterJumpTable(TraceJumpEntry const* begin) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.tables.erase(std::remove_if(r.tables.begin(), r.tables.end(),
+                                  [begin](Table const& table) {
+                                      return table.begin == begin;
+                                  }),
+                   r.tables.end());
+}
+
+}  // namespace detail
+
+bool JumpLabel::set(bool enabled) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    if (!patch(r.tables, enabled)) {
+        return false;
+    }
+    r.enabled = enabled;
+    return true;
+}
+
+std::size_t JumpLabel::sites() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::size_t sites = 0;
+    for (Table const& table : r.tables) {
+        sites += static_cast<std::size_t>(table.end - table.begin);
+    }
+    return sites;
+}
+
+#else
+
+namespace detail {
+std::atomic<bool> g_trace_key_{false};
+}  // namespace detail
+
+bool JumpLabel::set(bool enabled) {
+    detail::g_trace_key_.store(enabled, std::memory_order_relaxed);
+    return true;
+}
+
+std::size_t JumpLabel::sites() { return 0; }
+
+#endif
+
+}  // namespace neon
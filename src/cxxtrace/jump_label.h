@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+
+#include "cxxtrace/trace_key.h"
+
+namespace neon {
+
+// Flips TraceKeyEnabled() at every site of the process. With static keys
+// this rewrites the code of all entries in the cxxtrace_jump_tables the
+// loaded modules registered; sites keep running while they are patched,
+// a thread that reaches one in the middle traps on an int3 and continues
+// where the new instruction leads.
+class JumpLabel {
+   public:
+    // false if the code could be written neither through an mprotect'ed
+    // mapping nor through /proc/self/mem; the sites keep their previous
+    // state then.
+    static bool set(bool enabled);
+    // number of patch sites in the registered modules, 0 without static keys
+    static std::size_t sites();
+};
+
+}  // namespace neon
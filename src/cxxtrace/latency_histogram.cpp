@@ -0,0 +1,187 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+
+#include "site_registry.h"
+#include "trace_local.h"
+
+namespace neon {
+
+constexpr int LatencyHistogram::kSubBucketBits;
+constexpr int LatencyHistogram::kValueBits;
+constexpr std::size_t LatencyHistogram::kBuckets;
+
+std::uint64_t LatencyHistogram::upper_bound(std::size_t index) noexcept {
+    if (index < (2u << kSubBucketBits)) {
+        return index;
+    }
+    const std::size_t shift = (index >> kSubBucketBits) - 1;
+    const std::uint64_t sub = index - (shift << kSubBucketBits);
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::add_to(std::vector<std::uint64_t>& counts,
+                              std::uint64_t& max) const {
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+        counts[i] += counts_[i].load(std::memory_order_relaxed);
+    }
+    max = std::max(max, max_.load(std::memory_order_relaxed));
+}
+
+std::uint64_t LatencyHistogram::quantile(
+    std::vector<std::uint64_t> const& counts, std::uint64_t total, double q,
+    std::uint64_t max) {
+    const auto rank = std::max<std::uint64_t>(
+        1, static_cast<std::uint64_t>(std::ceil(q * total)));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(upper_bound(i), max);
+        }
+    }
+    return max;
+}
+
+struct LatencyHistograms::State {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadHistograms>> threads;
+    std::atomic<double> ns_per_tick{1.0};
+    std::atomic<bool> enabled{false};
+};
+
+LatencyHistograms::State& LatencyHistograms::state() {
+    static State* state = new State();
+    return *state;
+}
+
+void LatencyHistograms::enable(double ns_per_tick) {
+    state().ns_per_tick = ns_per_tick;
+    state().enabled = true;
+}
+
+bool LatencyHistograms::enabled() { return state().enabled; }
+
+LatencyHistograms::ThreadHistograms& LatencyHistograms::local() {
+    TraceLocal& local = t_trace_local_;
+    if (CXXTRACE_UNLIKELY(!local.histograms)) {
+        auto thread = std::make_shared<ThreadHistograms>();
+        local.histograms = thread.get();
+        State& global = state();
+        std::lock_guard<std::mutex> lock(global.mutex);
+        global.threads.push_back(std::move(thread));
+    }
+    return *local.histograms;
+}
+
+LatencyHistograms::SiteHistograms& LatencyHistograms::add_site(
+    ThreadHistograms& thread, TraceSiteId site) {
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    if (site >= thread.sites.size()) {
+        thread.sites.resize(site + 1);
+    }
+    thread.sites[site].reset(new SiteHistograms());
+    return *thread.sites[site];
+}
+
+void LatencyHistograms::record(TraceSiteId site, std::int64_t wall_ticks,
+                               std::int64_t task_clock_ns,
+                               std::uint32_t weight) {
+    ThreadHistograms& thread = local();
+    SiteHistograms* histograms =
+        site < thread.sites.size() ? thread.sites[site].get() : nullptr;
+    if (!histograms) {
+        histograms = &add_site(thread, site);
+    }
+    const std::uint64_t count = std::max<std::uint32_t>(weight, 1);
+    histograms->wall.record(
+        static_cast<std::uint64_t>(std::max<std::int64_t>(wall_ticks, 0)),
+        count);
+    histograms->task_clock.record(
+        static_cast<std::uint64_t>(std::max<std::int64_t>(task_clock_ns, 0)),
+        count);
+}
+
+namespace {
+
+struct Merged {
+    Tag tag;
+    std::vector<std::uint64_t> wall =
+        std::vector<std::uint64_t>(LatencyHistogram::kBuckets);
+    std::vector<std::uint64_t> task_clock =
+        std::vector<std::uint64_t>(LatencyHistogram::kBuckets);
+    std::uint64_t wall_max{0};
+    std::uint64_t task_clock_max{0};
+};
+
+TraceLatency::Percentiles percentiles(std::vector<std::uint64_t> const& counts,
+                                      std::uint64_t total, std::uint64_t max,
+                                      double ns_per_unit) {
+    auto at = [&](double q) {
+        return static_cast<std::int64_t>(std::llround(
+            LatencyHistogram::quantile(counts, total, q, max) * ns_per_unit));
+    };
+    TraceLatency::Percentiles result;
+    result.p50 = at(0.5);
+    result.p90 = at(0.9);
+    result.p99 = at(0.99);
+    result.p999 = at(0.999);
+    result.max = static_cast<std::int64_t>(std::llround(max * ns_per_unit));
+    return result;
+}
+
+}  // namespace
+
+std::vector<TraceLatency> LatencyHistograms::summaries() {
+    State& global = state();
+    std::vector<std::shared_ptr<ThreadHistograms>> threads;
+    {
+        std::lock_guard<std::mutex> lock(global.mutex);
+        threads = global.threads;
+    }
+    std::map<std::string, Merged> tags;
+    for (auto const& thread : threads) {
+        std::lock_guard<std::mutex> lock(thread->mutex);
+        for (TraceSiteId site = 0; site < thread->sites.size(); ++site) {
+            SiteHistograms const* histograms = thread->sites[site].get();
+            SiteInfo const* info = SiteRegistry::inst().find(site);
+            if (!histograms || !info) {
+                continue;
+            }
+            Merged& merged = tags[info->tag ? info->tag : ""];
+            merged.tag = info->tag;
+            histograms->wall.add_to(merged.wall, merged.wall_max);
+            histograms->task_clock.add_to(merged.task_clock,
+                                          merged.task_clock_max);
+        }
+    }
+    const double ns_per_tick = global.ns_per_tick.load();
+    std::vector<TraceLatency> result;
+    for (auto const& entry : tags) {
+        Merged const& merged = entry.second;
+        TraceLatency latency;
+        latency.tag = merged.tag;
+        latency.count = 0;
+        for (std::uint64_t count : merged.wall) {
+            latency.count += count;
+        }
+        latency.wall_ns = percentiles(merged.wall, latency.count,
+                                      merged.wall_max, ns_per_tick);
+        latency.task_clock_ns = percentiles(
+            merged.task_clock, latency.count, merged.task_clock_max, 1.0);
+        result.push_back(latency);
+    }
+    return result;
+}
+
+std::vector<TraceLatency> TraceLatencies() {
+    if (!LatencyHistograms::enabled()) {
+        return {};
+    }
+    return LatencyHistograms::summaries();
+}
+
+}  // namespace neon
@@ -0,0 +1,109 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "cxxtrace/cxxtrace.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace neon {
+
+// Log-linear histogram in the style of HdrHistogram. Values below 64 have a
+// bucket each; above that, every power of two is split into 32 buckets, so
+// a bucket is at most 1/32 of its values wide. Values from 2^36 on share the
+// last bucket. Written by one thread and readable by any.
+class LatencyHistogram {
+   public:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr int kValueBits = 36;
+    static constexpr std::size_t kBuckets =
+        std::size_t{kValueBits - kSubBucketBits + 1} << kSubBucketBits;
+
+    static std::size_t index(std::uint64_t value) noexcept {
+        constexpr std::uint64_t kMaxValue = (1ull << kValueBits) - 1;
+        if (value > kMaxValue) {
+            value = kMaxValue;
+        }
+        if (value < (2u << kSubBucketBits)) {
+            return static_cast<std::size_t>(value);
+        }
+        const int shift = msb(value) - kSubBucketBits;
+        return (static_cast<std::size_t>(shift) << kSubBucketBits) +
+               static_cast<std::size_t>(value >> shift);
+    }
+    // largest value that falls into bucket index
+    static std::uint64_t upper_bound(std::size_t index) noexcept;
+
+    // Only the owning thread records; a plain load and store keep the
+    // counters readable by other threads without a locked add.
+    void record(std::uint64_t value, std::uint64_t count) noexcept {
+        std::atomic<std::uint64_t>& bucket = counts_[index(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + count,
+                     std::memory_order_relaxed);
+        if (value > max_.load(std::memory_order_relaxed)) {
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+    // Adds this histogram to counts, which has kBuckets entries.
+    void add_to(std::vector<std::uint64_t>& counts, std::uint64_t& max) const;
+    // Upper bound of the bucket holding quantile q, at most max.
+    static std::uint64_t quantile(std::vector<std::uint64_t> const& counts,
+                                  std::uint64_t total, double q,
+                                  std::uint64_t max);
+
+   private:
+    static int msb(std::uint64_t value) noexcept {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return static_cast<int>(index);
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+    std::array<std::atomic<std::uint64_t>, kBuckets> counts_{};
+    std::atomic<std::uint64_t> max_{0};
+};
+
+// Per-thread wall and task clock histograms of every site, see
+// TraceOption::latency_histograms.
+class LatencyHistograms {
+   public:
+    // ns_per_tick converts wall durations when they are exported
+    static void enable(double ns_per_tick);
+    static bool enabled();
+    // Called on the thread that ran the scope.
+    static void record(TraceSiteId site, std::int64_t wall_ticks,
+                       std::int64_t task_clock_ns, std::uint32_t weight);
+    // Merged over all threads and the sites of each tag.
+    static std::vector<TraceLatency> summaries();
+
+   private:
+    friend struct TraceLocal;
+    struct SiteHistograms {
+        LatencyHistogram wall;
+        LatencyHistogram task_clock;
+    };
+    // Sites is only resized by the owning thread, under mutex. Kept by
+    // State after the thread exits; TraceLocal points to the thread's own.
+    struct ThreadHistograms {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<SiteHistograms>> sites;
+    };
+    struct State;
+
+    static State& state();
+    static ThreadHistograms& local();
+    static SiteHistograms& add_site(ThreadHistograms& thread,
+                                    TraceSiteId site);
+};
+
+}  // namespace neon
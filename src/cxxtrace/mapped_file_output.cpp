@@ -0,0 +1,199 @@
+#include "mapped_file_output.h"
+
+#if !defined(_WIN32)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace neon {
+
+static std::size_t round_up_to_pages(std::size_t size) {
+    const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    return std::max(page, (size + page - 1) / page * page);
+}
+
+std::unique_ptr<MappedFileOutput> MappedFileOutput::open(
+    std::string const& file_name) {
+    return open(file_name, CreateOption{});
+}
+
+std::unique_ptr<MappedFileOutput> MappedFileOutput::open(
+    std::string const& file_name, CreateOption const& options) {
+    const int fd = ::open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return nullptr;
+    }
+    CreateOption rounded = options;
+    rounded.segment_size = round_up_to_pages(options.segment_size);
+    rounded.max_pending_segments = std::max<std::size_t>(
+        1, options.max_pending_segments);
+    Segment first;
+    if (!map_segment(fd, 0, rounded.segment_size, first)) {
+        close(fd);
+        return nullptr;
+    }
+    return std::unique_ptr<MappedFileOutput>(
+        new MappedFileOutput(fd, rounded, first));
+}
+
+MappedFileOutput::MappedFileOutput(int fd, CreateOption const& options,
+                                   Segment first)
+    : fd_{fd}, options_{options}, current_{first} {
+    worker_ = std::thread([this]() { worker_loop(); });
+}
+
+MappedFileOutput::~MappedFileOutput() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_.data) {
+            retired_.emplace_back(current_, used_);
+            current_ = Segment{};
+        }
+        stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+    // drop the preallocated tail
+    if (ftruncate(fd_, static_cast<off_t>(offset_ + used_)) != 0) {
+        std::cerr << "cxxtrace: cannot truncate trace file: "
+                  << std::strerror(errno) << '\n';
+    }
+    close(fd_);
+}
+
+// Allocates the blocks before mapping them: a store to a hole the file
+// system then cannot fill would raise SIGBUS instead of failing here.
+bool MappedFileOutput::map_segment(int fd, std::uint64_t offset,
+                                   std::size_t size, Segment& segment) {
+    const auto end = static_cast<off_t>(offset + size);
+    int error = -1;
+#if defined(__linux__)
+    error = fallocate(fd, 0, static_cast<off_t>(offset),
+                      static_cast<off_t>(size));
+#endif
+    if (error != 0 && ftruncate(fd, end) != 0) {
+        std::cerr << "cxxtrace: cannot extend trace file: "
+                  << std::strerror(errno) << '\n';
+        return false;
+    }
+    int flags = MAP_SHARED;
+#if defined(__linux__)
+    // fault the pages in here, on the worker, not on the first stores
+    flags |= MAP_POPULATE;
+#endif
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd,
+                      static_cast<off_t>(offset));
+    if (data == MAP_FAILED) {
+        std::cerr << "cxxtrace: cannot map trace file: "
+                  << std::strerror(errno) << '\n';
+        return false;
+    }
+    segment.data = static_cast<char*>(data);
+    segment.offset = offset;
+    return true;
+}
+
+bool MappedFileOutput::write(const void* data, std::size_t size) {
+    auto bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        if (failed_) {
+            return false;
+        }
+        if (used_ == options_.segment_size && !next_segment()) {
+            failed_ = true;
+            return false;
+        }
+        const std::size_t chunk =
+            std::min(size, options_.segment_size - used_);
+        std::memcpy(current_.data + used_, bytes, chunk);
+        used_ += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+void MappedFileOutput::flush() {
+    if (current_.data && used_ > 0) {
+        msync(current_.data, used_, MS_ASYNC);
+    }
+}
+
+bool MappedFileOutput::next_segment() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    retired_.emplace_back(current_, used_);
+    offset_ += options_.segment_size;
+    current_ = Segment{};
+    used_ = 0;
+    cv_.notify_all();
+    cv_.wait(lock, [this]() {
+        return map_failed_ ||
+               (next_ready_ &&
+                retired_.size() <= options_.max_pending_segments);
+    });
+    if (!next_ready_) {
+        return false;
+    }
+    current_ = next_;
+    next_ready_ = false;
+    cv_.notify_all();
+    return true;
+}
+
+void MappedFileOutput::worker_loop() {
+    std::uint64_t next_offset = options_.segment_size;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this]() {
+            return stop_ || !retired_.empty() ||
+                   (!next_ready_ && !map_failed_);
+        });
+        if (!retired_.empty()) {
+            const auto retired = retired_.front();
+            lock.unlock();
+            Segment const& segment = retired.first;
+            msync(segment.data, retired.second, MS_ASYNC);
+#if defined(__linux__)
+            // MS_ASYNC does nothing on Linux; start the writeback so that
+            // dirty pages do not pile up in the page cache
+            sync_file_range(fd_, static_cast<off_t>(segment.offset),
+                            static_cast<off_t>(retired.second),
+                            SYNC_FILE_RANGE_WRITE);
+#endif
+            munmap(segment.data, options_.segment_size);
+            lock.lock();
+            retired_.pop_front();
+            cv_.notify_all();
+        } else if (stop_) {
+            break;
+        } else if (!next_ready_ && !map_failed_) {
+            lock.unlock();
+            Segment segment;
+            const bool mapped = map_segment(fd_, next_offset,
+                                            options_.segment_size, segment);
+            lock.lock();
+            if (mapped) {
+                next_ = segment;
+                next_ready_ = true;
+                next_offset += options_.segment_size;
+            } else {
+                map_failed_ = true;
+            }
+            cv_.notify_all();
+        }
+    }
+    if (next_ready_) {
+        munmap(next_.data, options_.segment_size);
+        next_ready_ = false;
+    }
+}
+
+}  // namespace neon
+
+#endif
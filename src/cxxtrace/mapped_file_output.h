@@ -0,0 +1,72 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "trace_output.h"
+
+namespace neon {
+
+// Trace file written through shared memory mappings, one segment at a time.
+// write() is a memcpy into the current segment. A background thread keeps
+// the next segment allocated on disk and mapped ahead of the writer, and
+// starts writeback of filled segments before unmapping them, so the writer
+// only waits when it gets more than max_pending_segments ahead of the disk.
+// Mapped memory stays below (max_pending_segments + 2) * segment_size.
+// The file is cut to the bytes written when the output is destroyed.
+// Not available on Windows.
+class MappedFileOutput : public TraceOutput {
+   public:
+    struct CreateOption {
+        std::size_t segment_size{32 << 20};  // rounded up to whole pages
+        std::size_t max_pending_segments{2};
+    };
+    static std::unique_ptr<MappedFileOutput> open(
+        std::string const& file_name);
+    static std::unique_ptr<MappedFileOutput> open(
+        std::string const& file_name, CreateOption const& options);
+    ~MappedFileOutput() override;
+
+    bool write(const void* data, std::size_t size) override;
+    void flush() override;
+    // bytes written so far
+    std::uint64_t size() const { return offset_ + used_; }
+
+   private:
+    struct Segment {
+        char* data{nullptr};
+        std::uint64_t offset{0};
+    };
+
+    MappedFileOutput(int fd, CreateOption const& options, Segment first);
+    static bool map_segment(int fd, std::uint64_t offset, std::size_t size,
+                            Segment& segment);
+    // Hands the full current segment to the worker and takes the next one.
+    bool next_segment();
+    void worker_loop();
+
+    const int fd_;
+    const CreateOption options_;
+    Segment current_;
+    std::uint64_t offset_{0};  // file offset of current_
+    std::size_t used_{0};      // bytes of current_ written
+    bool failed_{false};
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    // guarded by mutex_
+    Segment next_;
+    bool next_ready_{false};
+    bool map_failed_{false};
+    // filled segments and how many of their bytes are data
+    std::deque<std::pair<Segment, std::size_t>> retired_;
+    bool stop_{false};
+    std::thread worker_;
+};
+
+}  // namespace neon
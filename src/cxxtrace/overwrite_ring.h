@@ -0,0 +1,88 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace neon {
+
+// Bounded ring that never refuses a record: once full, the oldest one is
+// overwritten. The producer is a single thread and never waits for readers.
+// Any thread may take a snapshot concurrently; records the producer could
+// have been overwriting during the copy are left out of it.
+template <typename T>
+class OverwriteRing {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "OverwriteRing only holds trivially copyable records");
+
+   public:
+    explicit OverwriteRing(std::size_t capacity)
+        : capacity_{round_up_pow2(capacity)},
+          mask_{capacity_ - 1},
+          slots_{new T[capacity_]} {}
+    OverwriteRing(OverwriteRing const&) = delete;
+    OverwriteRing& operator=(OverwriteRing const&) = delete;
+
+    std::size_t capacity() const noexcept { return capacity_; }
+    // records pushed so far, including overwritten ones
+    std::uint64_t pushed() const noexcept {
+        return head_.load(std::memory_order_acquire);
+    }
+
+    void push(T const& value) noexcept {
+        const std::uint64_t head = head_.load(std::memory_order_relaxed);
+        slots_[head & mask_] = value;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // Replaces out by the readable records, oldest first.
+    void snapshot(std::vector<T>& out) const { read_from(0, out); }
+
+    // Replaces out by the readable records from number `from` on, oldest
+    // first, and returns the number of out[0]. Records between from and
+    // that number were overwritten before they could be read.
+    std::uint64_t read_from(std::uint64_t from, std::vector<T>& out) const {
+        const std::uint64_t end = head_.load(std::memory_order_acquire);
+        std::uint64_t begin = end > capacity_ ? end - capacity_ : 0;
+        begin = std::max(begin, std::min(from, end));
+        out.resize(static_cast<std::size_t>(end - begin));
+        for (std::uint64_t i = begin; i != end; ++i) {
+            std::memcpy(static_cast<void*>(&out[i - begin]),
+                        &slots_[i & mask_], sizeof(T));
+        }
+        // Like a seqlock reader: the copies above must complete before head
+        // is read again. The producer may already be writing record `head`,
+        // which reuses the slot of record head - capacity.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const std::uint64_t head = head_.load(std::memory_order_relaxed);
+        const std::uint64_t valid =
+            head + 1 > capacity_ ? head + 1 - capacity_ : 0;
+        if (valid > begin) {
+            const auto stale = static_cast<std::size_t>(
+                std::min<std::uint64_t>(valid - begin, out.size()));
+            out.erase(out.begin(), out.begin() + stale);
+            begin += stale;
+        }
+        return begin;
+    }
+
+   private:
+    static std::size_t round_up_pow2(std::size_t n) {
+        std::size_t capacity = 2;
+        while (capacity < n) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    const std::size_t capacity_;
+    const std::size_t mask_;
+    std::unique_ptr<T[]> slots_;
+    alignas(64) std::atomic<std::uint64_t> head_{0};
+};
+
+}  // namespace neon
@@ -2,8 +2,13 @@
 
 #include <linux/perf_event.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <sstream>
@@ -17,32 +22,35 @@ long perf_event_open(struct perf_event_attr* hw_event, pid_t pid, int cpu,
 
 PerfEvent::PerfEvent(const Option& option) : self_{option} {}
 
-PerfEvent::PerfEvent(PerfEvent&& other) {
-    if (self_.fd > 0) {
-        close(self_.fd);
-    }
-    self_ = other.self_;
+PerfEvent::PerfEvent(PerfEvent&& other) : self_{other.self_} {
     other.self_.fd = -1;
+    other.self_.user_page = nullptr;
 }
 
-PerfEvent::~PerfEvent() {
-    if (self_.fd > 0) {
-        ioctl(self_.fd, PERF_EVENT_IOC_DISABLE, 0);
-        close(self_.fd);
-    }
-}
+PerfEvent::~PerfEvent() { release(); }
 
 PerfEvent& PerfEvent::operator=(PerfEvent&& other) {
     if (this == &other) {
         return *this;
     }
-    if (self_.fd != other.self_.fd && self_.fd > 0) {
-        close(self_.fd);
-    }
+    release();
     self_ = other.self_;
     other.self_.fd = -1;
+    other.self_.user_page = nullptr;
     return *this;
 }
+
+void PerfEvent::release() {
+    if (self_.user_page) {
+        munmap(self_.user_page, sysconf(_SC_PAGESIZE));
+        self_.user_page = nullptr;
+    }
+    if (self_.fd > 0) {
+        ioctl(self_.fd, PERF_EVENT_IOC_DISABLE, 0);
+        close(self_.fd);
+        self_.fd = -1;
+    }
+}
 const std::string& PerfEvent::to_string(TypeID type_id) {
     static const std::unordered_map<TypeID, std::string> names{
         {TypeID::HARDWARE, "HARDWARE"},
@@ -63,6 +71,12 @@ const std::string& PerfEvent::to_string(TypeID type_id, Config config) {
              {
                  {Config::HW_CPU_CYCLES, "HW_CPU_CYCLES"},
                  {Config::HW_INSTRUCTIONS, "HW_INSTRUCTIONS"},
+                 {Config::HW_CACHE_MISSES, "HW_CACHE_MISSES"},
+                 {Config::HW_BRANCH_MISSES, "HW_BRANCH_MISSES"},
+             }},
+            {TypeID::HW_CACHE,
+             {
+                 {Config::HW_CACHE_DTLB_READ_MISS, "HW_CACHE_DTLB_READ_MISS"},
              }},
             {TypeID::SOFTWARE,
              {
@@ -96,13 +110,8 @@ std::string PerfEvent::name() const {
            ":" + domainName(self_.domain) + ":" + std::to_string(self_.id);
 }
 
-std::unique_ptr<PerfEvent> PerfEvent::create(TypeID type, Config config,
-                                             Domain domain) {
-    Option option;
-    option.type = type;
-    option.config = config;
-    option.domain = domain;
-    struct perf_event_attr attr;
+void PerfEvent::fill_attr(perf_event_attr& attr, TypeID type, Config config,
+                          Domain domain) {
     memset(&attr, 0, sizeof(struct perf_event_attr));
     attr.type = static_cast<std::uint32_t>(type);
     attr.size = sizeof(struct perf_event_attr);
@@ -112,15 +121,32 @@ std::unique_ptr<PerfEvent> PerfEvent::create(TypeID type, Config config,
     attr.exclude_kernel = !(domain & KERNEL);
     attr.exclude_idle = !(domain & IDLE);
     attr.exclude_hv = !(domain & HYPERVISOR);
-    // attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
-    // PERF_FORMAT_TOTAL_TIME_RUNNING;
-    attr.read_format = 0;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+}
+
+std::unique_ptr<PerfEvent> PerfEvent::create(TypeID type, Config config,
+                                             Domain domain,
+                                             ReadMode read_mode) {
+    Option option;
+    option.type = type;
+    option.config = config;
+    option.domain = domain;
+    struct perf_event_attr attr;
+    fill_attr(attr, type, config, domain);
 
     option.fd = static_cast<int>(perf_event_open(&attr, 0, -1, -1, 0));
     if (option.fd < 0) {
         return nullptr;
     }
     ioctl(option.fd, PERF_EVENT_IOC_ID, &option.id);
+    if (read_mode == ReadMode::kUserPage) {
+        void* page = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ,
+                          MAP_SHARED, option.fd, 0);
+        if (page != MAP_FAILED) {
+            option.user_page = static_cast<perf_event_mmap_page*>(page);
+        }
+    }
 
     return std::make_unique<PerfEvent>(option);
 }
@@ -130,7 +156,91 @@ void PerfEvent::enable() const {
     assert(ioctl(self_.fd, PERF_EVENT_IOC_ENABLE, 0) == 0);
 }
 
+static inline void compiler_barrier() { asm volatile("" ::: "memory"); }
+
+#if defined(__x86_64__)
+static inline std::uint64_t read_cpu_counter() { return __rdtsc(); }
+#endif
+
+// Computes the count in user space from the mmap'd control page, following
+// the protocol documented in <linux/perf_event.h>. The kernel refreshes the
+// page whenever it schedules the event in, software events included, so
+// with cap_user_time the enabled and running times extend to now from the
+// TSC. The counter value (with_value) also needs the event to sit on a
+// hardware counter (index != 0) and rdpmc; software events never do and
+// always read it with read().
+bool PerfEvent::readUserPage(Count& count, bool with_value) const {
+#if defined(__x86_64__)
+    volatile perf_event_mmap_page* page = self_.user_page;
+    std::uint32_t seq;
+    std::uint32_t index;
+    std::uint64_t offset{0};
+    std::uint64_t enabled;
+    std::uint64_t running;
+    std::uint64_t cycles;
+    std::uint64_t time_offset;
+    std::uint32_t time_mult;
+    std::uint16_t time_shift;
+    std::int64_t pmc{0};
+    do {
+        seq = page->lock;
+        compiler_barrier();
+        if (!page->cap_user_time) {
+            return false;
+        }
+        index = page->index;
+        if (with_value) {
+            if (!index || !page->cap_user_rdpmc) {
+                return false;
+            }
+            offset = page->offset;
+            const std::uint16_t width = page->pmc_width;
+            pmc = static_cast<std::int64_t>(__rdpmc(index - 1));
+            pmc <<= 64 - width;
+            pmc >>= 64 - width;
+        }
+        enabled = page->time_enabled;
+        running = page->time_running;
+        cycles = read_cpu_counter();
+        time_offset = page->time_offset;
+        time_mult = page->time_mult;
+        time_shift = page->time_shift;
+        compiler_barrier();
+    } while (page->lock != seq);
+
+    const std::uint64_t quot = cycles >> time_shift;
+    const std::uint64_t rem = cycles & ((1ull << time_shift) - 1);
+    const std::uint64_t delta =
+        time_offset + quot * time_mult + ((rem * time_mult) >> time_shift);
+    count.value = offset + pmc;
+    count.time_enabled = enabled + delta;
+    // a hardware event without an index is multiplexed off the PMU and not
+    // running; a software event runs whenever its thread does
+    if (index || self_.type == TypeID::SOFTWARE) {
+        running += delta;
+    }
+    count.time_running = running;
+    return true;
+#else
+    return false;
+#endif
+}
+
 bool PerfEvent::now(Count& count) const {
+    if (self_.user_page && readUserPage(count, true)) {
+        return true;
+    }
+    return now_syscall(count);
+}
+
+bool PerfEvent::now_times(Count& count) const {
+    if (self_.user_page && readUserPage(count, false)) {
+        return true;
+    }
+    return now_syscall(count);
+}
+
+bool PerfEvent::now_syscall(Count& count) const {
     int bytes = read(self_.fd, &count, sizeof(Count));
     return bytes == sizeof(Count);
 }
@@ -146,4 +256,71 @@ PerfEvent::TypeID PerfEvent::type() const noexcept { return self_.type; }
 PerfEvent::Config PerfEvent::config() const noexcept { return self_.config; }
 
 PerfEvent::Domain PerfEvent::domain() const noexcept { return self_.domain; }
+
+constexpr std::size_t PerfEventGroup::kMaxMembers;
+
+std::unique_ptr<PerfEventGroup> PerfEventGroup::create(
+    std::vector<Member> const& members, PerfEvent::Domain domain) {
+    std::unique_ptr<PerfEventGroup> group{new PerfEventGroup()};
+    group->members_ = std::min(members.size(), kMaxMembers);
+    for (std::size_t i = 0; i < group->members_; ++i) {
+        struct perf_event_attr attr;
+        PerfEvent::fill_attr(attr, members[i].type, members[i].config, domain);
+        attr.read_format |= PERF_FORMAT_GROUP;
+        // members follow the leader's enable state
+        attr.disabled = group->fds_.empty();
+        int fd = static_cast<int>(
+            perf_event_open(&attr, 0, -1, group->leader(), 0));
+        if (fd < 0) {
+            continue;
+        }
+        group->fds_.push_back(fd);
+        group->slots_.push_back(i);
+    }
+    if (group->fds_.empty()) {
+        return nullptr;
+    }
+    return group;
+}
+
+PerfEventGroup::~PerfEventGroup() {
+    // members first, the leader owns the group
+    for (auto it = fds_.rbegin(); it != fds_.rend(); ++it) {
+        close(*it);
+    }
+}
+
+bool PerfEventGroup::opened(std::size_t member) const noexcept {
+    return std::find(slots_.begin(), slots_.end(), member) != slots_.end();
+}
+
+void PerfEventGroup::enable() const {
+    ioctl(leader(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfEventGroup::disable() const {
+    ioctl(leader(), PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+bool PerfEventGroup::now(std::uint64_t* values) const {
+    // { nr, time_enabled, time_running, value[nr] }
+    std::uint64_t data[3 + kMaxMembers];
+    const std::size_t expected = (3 + fds_.size()) * sizeof(std::uint64_t);
+    if (read(leader(), data, expected) != static_cast<ssize_t>(expected)) {
+        return false;
+    }
+    const std::uint64_t enabled = data[1];
+    const std::uint64_t running = data[2];
+    std::fill(values, values + members_, 0);
+    for (std::size_t i = 0; i < fds_.size() && i < data[0]; ++i) {
+        std::uint64_t value = data[3 + i];
+        if (running != 0 && running < enabled) {
+            value = static_cast<std::uint64_t>(
+                static_cast<double>(value) * enabled / running);
+        }
+        values[slots_[i]] = value;
+    }
+    return true;
+}
 }  // namespace neon
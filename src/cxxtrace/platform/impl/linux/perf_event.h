@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace neon {
 
@@ -28,24 +29,35 @@ class PerfEvent {
     enum class Config : std::uint64_t {
         HW_CPU_CYCLES = PERF_COUNT_HW_CPU_CYCLES,
         HW_INSTRUCTIONS = PERF_COUNT_HW_INSTRUCTIONS,
+        HW_CACHE_MISSES = PERF_COUNT_HW_CACHE_MISSES,
+        HW_BRANCH_MISSES = PERF_COUNT_HW_BRANCH_MISSES,
+        HW_CACHE_DTLB_READ_MISS =
+            PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
         SW_CPU_CLOCK = PERF_COUNT_SW_CPU_CLOCK,
         SW_TASK_CLOCK = PERF_COUNT_SW_TASK_CLOCK,
         SW_DUMMY = PERF_COUNT_SW_DUMMY,
     };
     struct Count {
         std::uint64_t value;
-        // std::uint64_t time_enabled;
-        // std::uint64_t time_running;
+        std::uint64_t time_enabled;
+        std::uint64_t time_running;
 
         double operator-(const Count& other) const;
     };
 
+    enum class ReadMode {
+        kSyscall,   // read() on the event fd
+        kUserPage,  // mmap'd perf_event_mmap_page, falls back to read()
+    };
+
     struct Option {
         int fd{-1};
         int id{0};
         TypeID type;
         Config config;
         Domain domain;
+        perf_event_mmap_page* user_page{nullptr};
     };
     PerfEvent(const Option& option);
     PerfEvent(const PerfEvent&) = delete;
@@ -55,20 +67,67 @@ class PerfEvent {
     PerfEvent& operator=(PerfEvent&& other);
 
     std::string name() const;
-    static std::unique_ptr<PerfEvent> create(TypeID type, Config config,
-                                             Domain domain);
+    static std::unique_ptr<PerfEvent> create(
+        TypeID type, Config config, Domain domain,
+        ReadMode read_mode = ReadMode::kSyscall);
     void enable() const;
     bool now(Count& count) const;
+    // Only time_enabled and time_running are meant, which with kUserPage
+    // come from the page for any event, without rdpmc and without an index.
+    bool now_times(Count& count) const;
+    // read() on the fd, whatever the read mode
+    bool now_syscall(Count& count) const;
     void disable() const;
     int id() const noexcept;
     TypeID type() const noexcept;
     Config config() const noexcept;
     Domain domain() const noexcept;
+    bool has_user_page() const noexcept { return self_.user_page != nullptr; }
 
    private:
+    friend class PerfEventGroup;
+    static void fill_attr(perf_event_attr& attr, TypeID type, Config config,
+                          Domain domain);
     static const std::string& to_string(TypeID type_id);
     static const std::string& to_string(TypeID type_id, Config config);
     static std::string domainName(Domain domain);
+    bool readUserPage(Count& count, bool with_value) const;
+    void release();
     Option self_;
 };
+
+// Counters of the calling thread opened as one perf group
+// (PERF_FORMAT_GROUP): the kernel schedules them onto the PMU together and a
+// single read() returns all of them, so they describe the same interval.
+class PerfEventGroup {
+   public:
+    static constexpr std::size_t kMaxMembers = 8;
+    struct Member {
+        PerfEvent::TypeID type;
+        PerfEvent::Config config;
+    };
+    // Members the kernel rejects (unsupported event, no PMU in a VM, ...) are
+    // left out. Returns nullptr when none of them could be opened.
+    static std::unique_ptr<PerfEventGroup> create(
+        std::vector<Member> const& members, PerfEvent::Domain domain);
+    PerfEventGroup(const PerfEventGroup&) = delete;
+    PerfEventGroup& operator=(const PerfEventGroup&) = delete;
+    ~PerfEventGroup();
+
+    bool opened(std::size_t member) const noexcept;
+    void enable() const;
+    void disable() const;
+    // values[i] receives member i (0 for members that are not opened). Counts
+    // are scaled by time_enabled / time_running when the PMU multiplexed the
+    // group.
+    bool now(std::uint64_t* values) const;
+
+   private:
+    PerfEventGroup() = default;
+    int leader() const noexcept { return fds_.empty() ? -1 : fds_.front(); }
+
+    std::vector<int> fds_;            // opened events, leader first
+    std::vector<std::size_t> slots_;  // member index of fds_[i]
+    std::size_t members_{0};
+};
 }  // namespace neon
@@ -4,37 +4,47 @@
 
 #include <atomic>
 #include <iostream>
+#include <vector>
 
 #include "malloc_hook.h"
 #include "perf_event.h"
 
 namespace neon {
 
+static std::atomic<bool> g_hardware_counters_enabled_{false};
+
+// in HardwareCounters::Mask bit order
+static const std::vector<PerfEventGroup::Member> kCounterMembers{
+    {PerfEvent::TypeID::HARDWARE, PerfEvent::Config::HW_CPU_CYCLES},
+    {PerfEvent::TypeID::HARDWARE, PerfEvent::Config::HW_INSTRUCTIONS},
+    {PerfEvent::TypeID::HARDWARE, PerfEvent::Config::HW_CACHE_MISSES},
+    {PerfEvent::TypeID::HARDWARE, PerfEvent::Config::HW_BRANCH_MISSES},
+    {PerfEvent::TypeID::HW_CACHE, PerfEvent::Config::HW_CACHE_DTLB_READ_MISS},
+};
+
 class ThreadInfo::Impl {
+   public:
     Impl() {
-        tid_ = next_tid();
         thread_ = pthread_self();
-        event_ = PerfEvent::create(PerfEvent::TypeID::SOFTWARE,
-                                   PerfEvent::Config::SW_TASK_CLOCK,
-                                   PerfEvent::Domain::ALL);
+        // The task clock's times are read from its user page without a
+        // syscall where the kernel allows it; it takes no PMU counter away
+        // from the hardware counter group.
+        event_ = PerfEvent::create(
+            PerfEvent::TypeID::SOFTWARE, PerfEvent::Config::SW_TASK_CLOCK,
+            PerfEvent::Domain::ALL, PerfEvent::ReadMode::kUserPage);
         if (event_) {
             event_->enable();
         }
     }
-
-   public:
     ~Impl() {
         if (event_) {
             event_->disable();
         }
+        if (counters_) {
+            counters_->disable();
+        }
     }
 
-    static Impl& current() {
-        static thread_local Impl instance;
-        return instance;
-    }
-
-    std::uint32_t tid() const { return tid_; }
     std::string name() const {
         char name[256]{0};
         pthread_getname_np(thread_, name, sizeof(name));
@@ -42,34 +52,67 @@ class ThreadInfo::Impl {
     }
     std::int64_t task_clock_ns() const {
         PerfEvent::Count count;
-        if (event_ && event_->now(count)) {
-            return count.value;
+        // a per-thread event is enabled exactly while its thread runs
+        if (!event_ || !event_->now_times(count)) {
+            return 0;
         }
-        return 0;
+        return count.time_enabled;
     }
-    std::uint64_t allocated_heap_bytes() const { return allocated_bytes_; }
-    std::uint64_t deallocated_heap_bytes() const { return deallocated_bytes_; }
-
-    void add_allocate_heap_bytes(std::size_t bytes) {
-        allocated_bytes_ += bytes;
+    // Opened on first use so threads that never trace pay nothing.
+    PerfEventGroup const* counter_group() {
+        if (!counters_opened_) {
+            counters_opened_ = true;
+            counters_ = PerfEventGroup::create(kCounterMembers,
+                                               PerfEvent::Domain::USER);
+            if (counters_) {
+                counters_->enable();
+            }
+        }
+        return counters_.get();
     }
-    void add_deallocate_heap_bytes(std::size_t bytes) {
-        deallocated_bytes_ += bytes;
+    bool hardware_counters(HardwareCounters& counters) {
+        if (!g_hardware_counters_enabled_.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        PerfEventGroup const* group = counter_group();
+        std::uint64_t values[PerfEventGroup::kMaxMembers];
+        if (!group || !group->now(values)) {
+            return false;
+        }
+        counters.cycles = values[0];
+        counters.instructions = values[1];
+        counters.llc_misses = values[2];
+        counters.branch_misses = values[3];
+        counters.dtlb_misses = values[4];
+        return true;
     }
 
    private:
-    static std::uint32_t next_tid() {
-        static std::atomic<std::uint32_t> next_tid_{1};
-        return next_tid_.fetch_add(1, std::memory_order::memory_order_relaxed);
-    }
     std::unique_ptr<PerfEvent> event_;
-    std::uint32_t tid_;
+    std::unique_ptr<PerfEventGroup> counters_;
+    bool counters_opened_{false};
     std::string name_;
     pthread_t thread_;
-    std::uint64_t allocated_bytes_{0};
-    std::uint64_t deallocated_bytes_{0};
 };
 
+CXXTRACE_THREAD_LOCAL ThreadInfo ThreadInfo::t_current_ CXXTRACE_INITIAL_EXEC;
+
+// Releases the thread's Impl when it exits. The block stays, with its tid,
+// so that late scopes and allocations still find it.
+struct ThreadInfo::Owner {
+    std::unique_ptr<Impl> impl;
+    ~Owner() { t_current_.impl_ = nullptr; }
+};
+
+void ThreadInfo::init() {
+    static std::atomic<std::uint32_t> next_tid{1};
+    static thread_local Owner owner;
+    // first, so that the allocations below find the thread set up
+    tid_ = next_tid.fetch_add(1, std::memory_order_relaxed);
+    owner.impl.reset(new Impl());
+    impl_ = owner.impl.get();
+}
+
 class ThreadMemoryStatistics : public MallocListener {
    public:
     ThreadMemoryStatistics() = default;
@@ -79,27 +122,16 @@ class ThreadMemoryStatistics : public MallocListener {
     }
 
     void alloc(std::size_t bytes) override {
-        ThreadInfo::Impl::current().add_allocate_heap_bytes(bytes);
+        ThreadInfo::t_current_.allocated_heap_bytes_ += bytes;
     }
     void dealloc(std::size_t bytes) override {
-        ThreadInfo::Impl::current().add_deallocate_heap_bytes(bytes);
+        ThreadInfo::t_current_.deallocated_heap_bytes_ += bytes;
     }
 };
 
-ThreadInfo::ThreadInfo() : impl_{Impl::current()} {}
-
-ThreadInfo const& ThreadInfo::current() {
-    static thread_local ThreadInfo instance;
-    return instance;
-}
-std::uint32_t ThreadInfo::tid() const { return impl_.tid(); }
-std::string ThreadInfo::name() const { return impl_.name(); }
-std::int64_t ThreadInfo::task_clock_ns() const { return impl_.task_clock_ns(); }
-std::uint64_t ThreadInfo::allocated_heap_bytes() const {
-    return impl_.allocated_heap_bytes();
-}
-std::uint64_t ThreadInfo::deallocated_heap_bytes() const {
-    return impl_.deallocated_heap_bytes();
+std::string ThreadInfo::name() const { return impl_ ? impl_->name() : ""; }
+std::int64_t ThreadInfo::task_clock_ns() const {
+    return impl_ ? impl_->task_clock_ns() : 0;
 }
 
 void ThreadInfo::enable_malloc_statistics() {
@@ -112,4 +144,28 @@ void ThreadInfo::disable_malloc_statistics() {
     MallocInterposition::setListener(nullptr);
 }
 
+bool ThreadInfo::hardware_counters(HardwareCounters& counters) const {
+    return impl_ && impl_->hardware_counters(counters);
+}
+
+std::uint32_t ThreadInfo::enable_hardware_counters() {
+    g_hardware_counters_enabled_ = true;
+    Impl* impl = current().impl_;
+    PerfEventGroup const* group = impl ? impl->counter_group() : nullptr;
+    std::uint32_t mask = 0;
+    for (std::size_t i = 0; group && i < kCounterMembers.size(); ++i) {
+        if (group->opened(i)) {
+            mask |= 1u << i;
+        }
+    }
+    if (!mask) {
+        std::cerr << "hardware counters are not available" << std::endl;
+    }
+    return mask;
+}
+
+void ThreadInfo::disable_hardware_counters() {
+    g_hardware_counters_enabled_ = false;
+}
+
 }  // namespace neon
@@ -16,20 +16,10 @@
 namespace neon {
 
 class ThreadInfo::Impl {
-    Impl() {
-        tid_ = next_tid();
-        thread_ = pthread_mach_thread_np(pthread_self());
-    }
-
    public:
+    Impl() { thread_ = pthread_mach_thread_np(pthread_self()); }
     ~Impl() {}
 
-    static Impl& current() {
-        static thread_local Impl instance;
-        return instance;
-    }
-
-    std::uint32_t tid() const { return tid_; }
     std::string name() const {
         char name[256]{0};
         pthread_getname_np(pthread_from_mach_thread_np(thread_), name,
@@ -48,29 +38,30 @@ class ThreadInfo::Impl {
         return basic_info.user_time.seconds * TIME_MICROS_MAX +
                basic_info.user_time.microseconds;
     }
-    std::uint64_t allocated_heap_bytes() const { return allocated_bytes_; }
-    std::uint64_t deallocated_heap_bytes() const { return deallocated_bytes_; }
-
-    void add_allocate_heap_bytes(std::size_t bytes) {
-        allocated_bytes_ += bytes;
-    }
-    void add_deallocate_heap_bytes(std::size_t bytes) {
-        deallocated_bytes_ += bytes;
-    }
 
    private:
-    static std::uint32_t next_tid() {
-        static std::atomic<std::uint32_t> next_tid_{0};
-        next_tid_++;
-        return next_tid_;
-    }
-    std::uint32_t tid_;
     std::string name_;
     thread_port_t thread_;
-    std::uint64_t allocated_bytes_{0};
-    std::uint64_t deallocated_bytes_{0};
 };
 
+CXXTRACE_THREAD_LOCAL ThreadInfo ThreadInfo::t_current_ CXXTRACE_INITIAL_EXEC;
+
+// Releases the thread's Impl when it exits. The block stays, with its tid,
+// so that late scopes and allocations still find it.
+struct ThreadInfo::Owner {
+    std::unique_ptr<Impl> impl;
+    ~Owner() { t_current_.impl_ = nullptr; }
+};
+
+void ThreadInfo::init() {
+    static std::atomic<std::uint32_t> next_tid{1};
+    static thread_local Owner owner;
+    // first, so that the allocations below find the thread set up
+    tid_ = next_tid.fetch_add(1, std::memory_order_relaxed);
+    owner.impl.reset(new Impl());
+    impl_ = owner.impl.get();
+}
+
 class ThreadMemoryStatistics : public MallocListener {
    public:
     ThreadMemoryStatistics() = default;
@@ -80,27 +71,16 @@ class ThreadMemoryStatistics : public MallocListener {
     }
 
     void alloc(std::size_t bytes) override {
-        ThreadInfo::Impl::current().add_allocate_heap_bytes(bytes);
+        ThreadInfo::t_current_.allocated_heap_bytes_ += bytes;
     }
     void dealloc(std::size_t bytes) override {
-        ThreadInfo::Impl::current().add_deallocate_heap_bytes(bytes);
+        ThreadInfo::t_current_.deallocated_heap_bytes_ += bytes;
     }
 };
 
-ThreadInfo::ThreadInfo() : impl_{Impl::current()} {}
-
-ThreadInfo const& ThreadInfo::current() {
-    static thread_local ThreadInfo instance;
-    return instance;
-}
-std::uint32_t ThreadInfo::tid() const { return impl_.tid(); }
-std::string ThreadInfo::name() const { return impl_.name(); }
-std::int64_t ThreadInfo::task_clock_ns() const { return impl_.task_clock_ns(); }
-std::uint64_t ThreadInfo::allocated_heap_bytes() const {
-    return impl_.allocated_heap_bytes();
-}
-std::uint64_t ThreadInfo::deallocated_heap_bytes() const {
-    return impl_.deallocated_heap_bytes();
+std::string ThreadInfo::name() const { return impl_ ? impl_->name() : ""; }
+std::int64_t ThreadInfo::task_clock_ns() const {
+    return impl_ ? impl_->task_clock_ns() : 0;
 }
 
 void ThreadInfo::enable_malloc_statistics() {
@@ -113,4 +93,9 @@ void ThreadInfo::disable_malloc_statistics() {
     MallocInterposition::setListener(nullptr);
 }
 
+// kperf needs root, hardware counters are not collected on Apple platforms.
+bool ThreadInfo::hardware_counters(HardwareCounters&) const { return false; }
+std::uint32_t ThreadInfo::enable_hardware_counters() { return 0; }
+void ThreadInfo::disable_hardware_counters() {}
+
 }  // namespace neon
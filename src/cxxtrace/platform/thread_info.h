@@ -3,31 +3,98 @@
 #include <memory>
 #include <string>
 
+// Per-thread state the tracer reads on every event lives in small blocks of
+// initial-exec TLS: a fixed offset from the thread pointer, reached without
+// __tls_get_addr even when the library ends up in a shared object (the
+// linker turns it into local-exec in an executable). The blocks are
+// trivially constructible and never destroyed, so unlike a thread_local
+// object they need no guard, no init function and stay usable while the
+// thread's destructors run.
+#if defined(__GNUC__) && !defined(_WIN32)
+#define CXXTRACE_THREAD_LOCAL __thread
+#define CXXTRACE_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define CXXTRACE_THREAD_LOCAL thread_local
+#define CXXTRACE_UNLIKELY(x) (x)
+#endif
+// TLS models are an ELF notion; Mach-O has a single one
+#if defined(__GNUC__) && defined(__ELF__)
+#define CXXTRACE_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define CXXTRACE_INITIAL_EXEC
+#endif
+
 namespace neon {
 
-class ThreadInfo {
+// Hardware counters of the calling thread, counted in user mode since the
+// thread first read them.
+struct HardwareCounters {
+    enum Mask : std::uint32_t {
+        kCycles = 0b1,
+        kInstructions = 0b10,
+        kLlcMisses = 0b100,
+        kBranchMisses = 0b1000,
+        kDtlbMisses = 0b10000,
+    };
+    std::uint64_t cycles{0};
+    std::uint64_t instructions{0};
+    std::uint64_t llc_misses{0};
+    std::uint64_t branch_misses{0};
+    std::uint64_t dtlb_misses{0};
+};
+
+// The calling thread's block: one cache line with what every event reads.
+// It is set up by the thread's first current() call; the perf handles live
+// in Impl, which the block points to and which is released when the thread
+// exits. The malloc hook counts into the block directly.
+class alignas(64) ThreadInfo {
    public:
     class Impl;
-    static ThreadInfo const& current();
-    std::uint32_t tid() const;
+    static ThreadInfo const& current() {
+        ThreadInfo& info = t_current_;
+        if (CXXTRACE_UNLIKELY(info.tid_ == 0)) {
+            info.init();
+        }
+        return info;
+    }
+    std::uint32_t tid() const { return tid_; }
     std::string name() const;
     std::int64_t task_clock_ns() const;
-    std::uint64_t allocated_heap_bytes() const;
-    std::uint64_t deallocated_heap_bytes() const;
+    std::uint64_t allocated_heap_bytes() const {
+        return allocated_heap_bytes_;
+    }
+    std::uint64_t deallocated_heap_bytes() const {
+        return deallocated_heap_bytes_;
+    }
     static void enable_malloc_statistics();
     static void disable_malloc_statistics();
+    // All counters are read with one group read. Returns false when hardware
+    // counters are disabled or unavailable on this thread.
+    bool hardware_counters(HardwareCounters& counters) const;
+    // Returns the HardwareCounters::Mask bits the PMU provides, 0 if none.
+    static std::uint32_t enable_hardware_counters();
+    static void disable_hardware_counters();
 
-    ~ThreadInfo() = default;
+   private:
+    friend class ThreadMemoryStatistics;
+    struct Owner;
 
-   protected:
-    ThreadInfo();
+    ThreadInfo() = default;
     ThreadInfo(ThreadInfo&& other) = delete;
     ThreadInfo& operator=(ThreadInfo&& other) = delete;
     ThreadInfo(ThreadInfo const& other) = delete;
     ThreadInfo& operator=(ThreadInfo const& other) = delete;
 
-   private:
-    Impl& impl_;
+    // cold: numbers the thread and opens its perf handles
+    void init();
+
+    // zero until init, like every field: TLS starts out zeroed
+    std::uint32_t tid_;
+    std::uint64_t allocated_heap_bytes_;
+    std::uint64_t deallocated_heap_bytes_;
+    Impl* impl_;  // null before init and once the thread has exited
+
+    static CXXTRACE_THREAD_LOCAL ThreadInfo t_current_ CXXTRACE_INITIAL_EXEC;
 };
 
 }  // namespace neon
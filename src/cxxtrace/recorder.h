@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include "trace_event.h"
+
+namespace neon {
+
+// A recording backend. record() is called on the traced thread for every
+// finished scope, so implementations must keep it cheap.
+class Recorder {
+   public:
+    virtual ~Recorder() = default;
+    virtual void record(TraceEvent const& event) = 0;
+    // Backends that need to know the open scopes also get kScopeBegin
+    // events; checked once when the backend is installed.
+    virtual bool wants_scope_begin() const { return false; }
+    virtual std::uint64_t dropped_events() const { return 0; }
+    virtual TraceContention contention() const { return {}; }
+    // Writes what the backend holds in memory now; false when it has nothing
+    // to write on demand or the write failed.
+    virtual bool dump() { return false; }
+
+   protected:
+    Recorder() : instance_{next_instance()} {}
+
+    // Backends are told apart by number, not address: a test may create one
+    // where another was destroyed. The owner of the thread's state in
+    // TraceLocal; never 0.
+    const std::uint64_t instance_;
+
+   private:
+    static std::uint64_t next_instance() {
+        static std::atomic<std::uint64_t> next{1};
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+}  // namespace neon
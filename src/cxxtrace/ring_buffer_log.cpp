@@ -0,0 +1,197 @@
+#include "ring_buffer_log.h"
+
+#include <algorithm>
+
+#include "trace_local.h"
+
+namespace neon {
+
+// Keeps the thread's ring alive; TraceLocal points to it. Events recorded
+// after the thread's destructors ran are dropped.
+struct RingBufferLog::LocalRing {
+    std::shared_ptr<ThreadRing> ring;
+    ~LocalRing() {
+        if (ring) {
+            ring->retired.store(true, std::memory_order_release);
+        }
+        t_trace_local_.ring_owner = kTraceLocalExited;
+        t_trace_local_.ring = nullptr;
+    }
+};
+
+RingBufferLog::ThreadRing::ThreadRing(std::size_t capacity, bool overwrites,
+                                      std::uint32_t tid)
+    : queue{overwrites ? 0 : capacity},
+      overwrite{overwrites ? capacity : 0},
+      overwrites{overwrites},
+      tid{tid} {}
+
+RingBufferLog::RingBufferLog(CreateOption const& options) : options_{options} {
+    if (!options_.file_name.empty()) {
+        writer_ = TraceWriter::open(options_.file_name, options_.calibration,
+                                    options_.counter_mask, options_.output);
+    }
+    drainer_ = std::thread([this]() { drain_loop(); });
+}
+
+RingBufferLog::~RingBufferLog() {
+    stop_.store(true, std::memory_order_release);
+    if (drainer_.joinable()) {
+        drainer_.join();
+    }
+}
+
+RingBufferLog::ThreadRing* RingBufferLog::local_ring(std::uint32_t tid) {
+    TraceLocal& local = t_trace_local_;
+    if (CXXTRACE_UNLIKELY(local.ring_owner != instance_)) {
+        if (local.ring_owner == kTraceLocalExited) {
+            return nullptr;
+        }
+        static thread_local LocalRing holder;
+        auto ring = std::make_shared<ThreadRing>(
+            options_.capacity,
+            options_.overflow == TraceOption::Overflow::kOverwriteOldest, tid);
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            rings_.push_back(ring);
+        }
+        if (holder.ring) {
+            holder.ring->retired.store(true, std::memory_order_release);
+        }
+        holder.ring = std::move(ring);
+        local.ring = holder.ring.get();
+        local.ring_owner = instance_;
+    }
+    return local.ring;
+}
+
+void RingBufferLog::record(TraceEvent const& event) {
+    ThreadRing* local = local_ring(event.tid);
+    if (!local) {
+        return;
+    }
+    ThreadRing& ring = *local;
+    if (ring.overwrites) {
+        ring.overwrite.push(event);
+        return;
+    }
+    if (ring.queue.try_push(event)) {
+        return;
+    }
+    if (options_.overflow == TraceOption::Overflow::kBlock) {
+        full_waits_.fetch_add(1, std::memory_order_relaxed);
+    }
+    do {
+        // nothing drains the rings once stop_ is set
+        if (options_.overflow != TraceOption::Overflow::kBlock ||
+            stop_.load(std::memory_order_relaxed)) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::this_thread::yield();
+    } while (!ring.queue.try_push(event));
+}
+
+std::uint64_t RingBufferLog::dropped_events() const {
+    std::uint64_t dropped = retired_dropped_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    for (auto const& ring : rings_) {
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+TraceContention RingBufferLog::contention() const {
+    TraceContention contention;
+    contention.full_waits = full_waits_.load(std::memory_order_relaxed);
+    return contention;
+}
+
+std::size_t RingBufferLog::drain(ThreadRing& ring) {
+    auto write = [this, &ring](TraceEvent const& event) {
+        if (writer_) {
+            writer_->write(event);
+        }
+        ring.last_end = event.ts + event.duration;
+    };
+    if (ring.overwrites) {
+        const std::uint64_t first =
+            ring.overwrite.read_from(ring.read, read_buffer_);
+        if (first != ring.read) {
+            // older than everything read now
+            const std::uint64_t lost = first - ring.read;
+            ring.dropped.fetch_add(lost, std::memory_order_relaxed);
+            ring.reported += lost;
+            if (writer_) {
+                writer_->write_lost(ring.tid, lost, ring.last_end,
+                                    read_buffer_.empty()
+                                        ? TraceClock::now(
+                                              options_.calibration.clock)
+                                        : read_buffer_.front().ts);
+            }
+        }
+        ring.read = first + read_buffer_.size();
+        for (TraceEvent const& event : read_buffer_) {
+            write(event);
+        }
+        return read_buffer_.size();
+    }
+    const std::size_t drained = ring.queue.consume_all(write);
+    // refused while the ring was full, after what was in it
+    const std::uint64_t dropped = ring.dropped.load(std::memory_order_relaxed);
+    if (dropped != ring.reported) {
+        if (writer_) {
+            writer_->write_lost(ring.tid, dropped - ring.reported,
+                                ring.last_end,
+                                TraceClock::now(options_.calibration.clock));
+        }
+        ring.reported = dropped;
+    }
+    return drained;
+}
+
+std::size_t RingBufferLog::drain() {
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings = rings_;
+    }
+    std::size_t drained = 0;
+    bool has_retired = false;
+    for (auto const& ring : rings) {
+        // a retired ring gets no further pushes, so one more pass empties it
+        has_retired |= ring->retired.load(std::memory_order_acquire);
+        drained += drain(*ring);
+    }
+    if (has_retired) {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        auto it = std::remove_if(
+            rings_.begin(), rings_.end(),
+            [this](std::shared_ptr<ThreadRing> const& ring) {
+                if (!ring->retired.load(std::memory_order_acquire) ||
+                    (ring->overwrites ? ring->read != ring->overwrite.pushed()
+                                      : !ring->queue.empty())) {
+                    return false;
+                }
+                retired_dropped_.fetch_add(ring->dropped.load(),
+                                           std::memory_order_relaxed);
+                return true;
+            });
+        rings_.erase(it, rings_.end());
+    }
+    return drained;
+}
+
+void RingBufferLog::drain_loop() {
+    while (!stop_.load(std::memory_order_acquire)) {
+        if (drain() == 0) {
+            if (writer_) {
+                writer_->flush();
+            }
+            std::this_thread::sleep_for(options_.drain_interval);
+        }
+    }
+    drain();
+}
+
+}  // namespace neon
@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "overwrite_ring.h"
+#include "recorder.h"
+#include "spsc_ring.h"
+#include "trace_writer.h"
+
+namespace neon {
+
+// Recording backend where every thread owns a lock-free SPSC ring of raw
+// TraceEvent records. Producers never allocate or lock after their ring is
+// registered; a single drainer thread encodes the rings into file_name.
+// With kOverwriteOldest the rings are OverwriteRings the drainer reads
+// behind the producer; events overwritten before it got to them count as
+// lost, like the ones kDropNewest refuses.
+class RingBufferLog : public Recorder {
+   public:
+    struct CreateOption {
+        std::size_t capacity{8192};
+        TraceOption::Overflow overflow{TraceOption::Overflow::kDropNewest};
+        std::string file_name{"cxxtrace.bin"};
+        std::chrono::milliseconds drain_interval{10};
+        ClockCalibration calibration{};
+        std::uint32_t counter_mask{0};
+        OutputOption output{};
+    };
+    explicit RingBufferLog(CreateOption const& options);
+    ~RingBufferLog() override;
+
+    void record(TraceEvent const& event) override;
+    std::uint64_t dropped_events() const override;
+    // only full_waits: the rings share nothing on the recording path
+    TraceContention contention() const override;
+
+   private:
+    friend struct TraceLocal;
+    struct ThreadRing {
+        ThreadRing(std::size_t capacity, bool overwrites, std::uint32_t tid);
+        // one of the two is used, the other has the minimum capacity
+        SpscRing<TraceEvent> queue;
+        OverwriteRing<TraceEvent> overwrite;
+        const bool overwrites;
+        const std::uint32_t tid;
+        std::atomic<std::uint64_t> dropped{0};
+        std::atomic<bool> retired{false};
+        // drainer only
+        std::uint64_t read{0};  // next record of overwrite
+        std::uint64_t reported{0};  // dropped already marked in the trace
+        std::int64_t last_end{0};  // of the last event written
+    };
+    struct LocalRing;
+
+    ThreadRing* local_ring(std::uint32_t tid);
+    // events of one ring, then the marker for what it lost meanwhile
+    std::size_t drain(ThreadRing& ring);
+    std::size_t drain();
+    void drain_loop();
+
+    CreateOption options_;
+    std::unique_ptr<TraceWriter> writer_;
+    std::vector<TraceEvent> read_buffer_;  // drainer scratch
+    mutable std::mutex rings_mutex_;
+    std::vector<std::shared_ptr<ThreadRing>> rings_;
+    std::atomic<std::uint64_t> retired_dropped_{0};
+    std::atomic<std::uint64_t> full_waits_{0};
+    std::atomic<bool> stop_{false};
+    std::thread drainer_;
+};
+
+}  // namespace neon
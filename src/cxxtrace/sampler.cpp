@@ -0,0 +1,124 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <thread>
+
+#include "site_registry.h"
+#include "trace_clock.h"
+#include "trace_local.h"
+
+namespace neon {
+
+// Frees the thread's table when it exits. A scope sampled by a destructor
+// that runs later sets up a new one, which is left to the process.
+struct Sampler::Owner {
+    ~Owner() {
+        TraceLocal& local = t_trace_local_;
+        delete[] local.sampler_sites;
+        local.sampler_sites = nullptr;
+        local.sampler_site_count = 0;
+        local.sampler_random = 0;
+    }
+};
+
+TraceLocal& Sampler::local() {
+    TraceLocal& local = t_trace_local_;
+    if (CXXTRACE_UNLIKELY(local.sampler_random == 0)) {
+        static thread_local Owner owner;
+        local.sampler_random =
+            std::hash<std::thread::id>{}(std::this_thread::get_id()) ^
+            static_cast<std::uint64_t>(TraceClock::steady_ns()) ^
+            0x9e3779b97f4a7c15ull;
+    }
+    return local;
+}
+
+void Sampler::grow(TraceLocal& local, TraceSiteId site) {
+    const std::uint32_t count =
+        std::max<std::uint32_t>({64, local.sampler_site_count * 2, site + 1});
+    SiteState* sites = new SiteState[count];
+    std::copy(local.sampler_sites,
+              local.sampler_sites + local.sampler_site_count, sites);
+    delete[] local.sampler_sites;
+    local.sampler_sites = sites;
+    local.sampler_site_count = count;
+}
+
+// xorshift64*, uniform in (0, 1]
+double Sampler::uniform(TraceLocal& local) {
+    std::uint64_t& random = local.sampler_random;
+    random ^= random >> 12;
+    random ^= random << 25;
+    random ^= random >> 27;
+    const std::uint64_t bits = (random * 0x2545f4914f6cdd1dull) >> 11;
+    return static_cast<double>(bits + 1) / 9007199254740992.0;
+}
+
+std::uint64_t Sampler::skip(TraceLocal& local, std::uint32_t period) {
+    return static_cast<std::uint64_t>(std::log(uniform(local)) /
+                                      std::log1p(-1.0 / period));
+}
+
+std::uint32_t Sampler::sample(TraceLocal& local, TraceSiteId site,
+                              TraceSampling const& sampling) {
+    const std::uint32_t period = std::max<std::uint32_t>(sampling.period, 1);
+    if (sampling.mode == TraceSampling::Mode::kAll || period == 1) {
+        return 1;
+    }
+    if (CXXTRACE_UNLIKELY(site >= local.sampler_site_count)) {
+        grow(local, site);
+    }
+    SiteState& site_state = local.sampler_sites[site];
+    switch (sampling.mode) {
+        case TraceSampling::Mode::kEveryN:
+            return site_state.calls++ % period == 0 ? period : 0;
+        case TraceSampling::Mode::kPoisson:
+            // geometric skip lengths give each call probability 1 / period
+            // for one random draw per recorded call
+            if (site_state.calls++ == 0) {
+                site_state.countdown = skip(local, period);
+            }
+            if (site_state.countdown > 0) {
+                --site_state.countdown;
+                return 0;
+            }
+            site_state.countdown = skip(local, period);
+            return period;
+        case TraceSampling::Mode::kInterval: {
+            ++site_state.calls;
+            const std::int64_t now = TraceClock::steady_ns();
+            if (site_state.last_ns != 0 &&
+                now - site_state.last_ns < std::int64_t{period} * 1000) {
+                return 0;
+            }
+            // stands for the calls skipped since the previous sample
+            const std::uint64_t weight = site_state.calls;
+            site_state.calls = 0;
+            site_state.last_ns = now;
+            return static_cast<std::uint32_t>(std::min<std::uint64_t>(
+                weight, std::numeric_limits<std::uint32_t>::max()));
+        }
+        case TraceSampling::Mode::kAll:
+        default:
+            return 1;
+    }
+}
+
+std::uint32_t Sampler::begin(TraceSiteId site, std::uint32_t parent) {
+    const TraceSampling sampling = SiteRegistry::inst().sampling(site);
+    // an independent site's own decision is all its calls pass through
+    if (sampling.independent) {
+        parent = 1;
+    } else if (parent == 0) {
+        return 0;
+    }
+    const std::uint64_t own = sample(local(), site, sampling);
+    const std::uint64_t weight = std::uint64_t{parent} * own;
+    return static_cast<std::uint32_t>(std::min<std::uint64_t>(
+        weight, std::numeric_limits<std::uint32_t>::max()));
+}
+
+}  // namespace neon
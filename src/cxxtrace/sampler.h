@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+
+#include "cxxtrace/cxxtrace.h"
+
+namespace neon {
+
+struct TraceLocal;
+
+// Per-thread sampling decisions for TraceSampling. A scope nested in one
+// that was sampled out is dropped too; the decisions live in the ScopeStack
+// frames, so that the end of a scope is recorded exactly when its begin was.
+class Sampler {
+   public:
+    // Weight of this call of site, opening inside a scope of weight parent
+    // (1 outside any): the number of calls the recorded scope stands for, 0
+    // if it is sampled out.
+    static std::uint32_t begin(TraceSiteId site, std::uint32_t parent);
+
+   private:
+    friend struct TraceLocal;
+    // Per-site state, indexed by the site id; ids are dense.
+    struct SiteState {
+        std::uint64_t calls{0};      // since the last recorded call
+        std::uint64_t countdown{0};  // kPoisson: calls to skip
+        std::int64_t last_ns{0};     // kInterval: last recorded call
+    };
+    // The table and the random state are in TraceLocal; the table is
+    // released at thread exit.
+    struct Owner;
+
+    static TraceLocal& local();
+    // cold: makes the table cover site
+    static void grow(TraceLocal& local, TraceSiteId site);
+    // weight of this call of site, 0 if it is not sampled
+    static std::uint32_t sample(TraceLocal& local, TraceSiteId site,
+                                TraceSampling const& sampling);
+    static double uniform(TraceLocal& local);
+    // kPoisson: number of calls before the next sampled one
+    static std::uint64_t skip(TraceLocal& local, std::uint32_t period);
+};
+
+}  // namespace neon
@@ -0,0 +1,161 @@
+#include "scope_stack.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+
+#include "latency_histogram.h"
+#include "trace_local.h"
+
+namespace neon {
+
+static std::atomic<std::uint32_t> g_epoch_{0};
+
+// Frees the thread's frames when it exits. A scope opened by a destructor
+// that runs later grows a new array, which is left to the process.
+struct ScopeStack::Owner {
+    ~Owner() {
+        TraceLocal& local = t_trace_local_;
+        delete[] local.frames;
+        local.frames = nullptr;
+        local.frame_count = 0;
+        local.frame_capacity = 0;
+    }
+};
+
+void ScopeStack::new_epoch() {
+    g_epoch_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ScopeStack::sync_epoch(TraceLocal& local) {
+    const std::uint32_t epoch = g_epoch_.load(std::memory_order_relaxed);
+    if (CXXTRACE_UNLIKELY(local.frame_epoch != epoch)) {
+        local.frame_epoch = epoch;
+        local.frame_count = 0;
+    }
+}
+
+void ScopeStack::grow(TraceLocal& local) {
+    static thread_local Owner owner;
+    const std::uint32_t capacity =
+        std::max<std::uint32_t>(16, local.frame_capacity * 2);
+    Frame* frames = new Frame[capacity];
+    std::copy(local.frames, local.frames + local.frame_count, frames);
+    delete[] local.frames;
+    local.frames = frames;
+    local.frame_capacity = capacity;
+}
+
+ScopeStack::Frame& ScopeStack::push(TraceLocal& local) {
+    sync_epoch(local);
+    if (CXXTRACE_UNLIKELY(local.frame_count == local.frame_capacity)) {
+        grow(local);
+    }
+    std::uint32_t depth = 0;
+    if (local.frame_count != 0) {
+        Frame const& parent = local.frames[local.frame_count - 1];
+        depth = parent.depth + (parent.begin.weight != 0 ? 1 : 0);
+    }
+    Frame& frame = local.frames[local.frame_count++];
+    frame.filtered = 0;
+    frame.depth = depth;
+    return frame;
+}
+
+void ScopeStack::begin(TraceEvent const& event) {
+    push(t_trace_local_).begin = event;
+}
+
+void ScopeStack::begin_sampled_out(TraceSiteId site) {
+    TraceEvent& begin = push(t_trace_local_).begin;
+    begin.site = site;
+    begin.weight = 0;
+}
+
+std::uint32_t ScopeStack::parent_weight() {
+    TraceLocal& local = t_trace_local_;
+    sync_epoch(local);
+    return local.frame_count == 0
+               ? 1
+               : local.frames[local.frame_count - 1].begin.weight;
+}
+
+bool ScopeStack::end_sampled_out(TraceSiteId site) {
+    TraceLocal& local = t_trace_local_;
+    sync_epoch(local);
+    if (local.frame_count == 0) {
+        return false;
+    }
+    TraceEvent const& begin = local.frames[local.frame_count - 1].begin;
+    if (begin.site != site || begin.weight != 0) {
+        return false;
+    }
+    --local.frame_count;
+    return true;
+}
+
+static HardwareCounters operator-(HardwareCounters const& end,
+                                  HardwareCounters const& begin) {
+    HardwareCounters spent;
+    spent.cycles = end.cycles - begin.cycles;
+    spent.instructions = end.instructions - begin.instructions;
+    spent.llc_misses = end.llc_misses - begin.llc_misses;
+    spent.branch_misses = end.branch_misses - begin.branch_misses;
+    spent.dtlb_misses = end.dtlb_misses - begin.dtlb_misses;
+    return spent;
+}
+
+void ScopeStack::end(TraceEvent const& end, std::int64_t min_ticks,
+                     bool histograms, Recorder& recorder) {
+    TraceLocal& local = t_trace_local_;
+    // Scopes open when tracing was turned off go first, below a match too:
+    // they would add to the depth of everything after them.
+    sync_epoch(local);
+    const std::reverse_iterator<Frame*> top{local.frames + local.frame_count};
+    const std::reverse_iterator<Frame*> bottom{local.frames};
+    // Matched by site from the top: frames above the match are scopes whose
+    // end was never seen (a TraceSectionBegin without its end) and are
+    // discarded. An end without a begin (tracing enabled inside the scope)
+    // is dropped.
+    auto found = std::find_if(top, bottom, [&end](Frame const& frame) {
+        return frame.begin.site == end.site;
+    });
+    if (found == bottom) {
+        return;
+    }
+    Frame* frame = std::prev(found.base());
+    local.frame_count = static_cast<std::uint32_t>(frame - local.frames);
+    TraceEvent const& begin = frame->begin;
+    if (begin.weight == 0) {
+        return;
+    }
+    TraceEvent event{TraceEvent::Type::kScopeComplete, end.site};
+    event.tid = end.tid;
+    event.weight = begin.weight;
+    event.filtered = frame->filtered;
+    event.depth = frame->depth;
+    event.task_clock_ns = end.task_clock_ns - begin.task_clock_ns;
+    event.allocated_heap_bytes =
+        end.allocated_heap_bytes - begin.allocated_heap_bytes;
+    event.deallocated_heap_bytes =
+        end.deallocated_heap_bytes - begin.deallocated_heap_bytes;
+    event.counters = end.counters - begin.counters;
+    event.ts = begin.ts;
+    event.duration = end.ts - begin.ts;
+    if (histograms) {
+        LatencyHistograms::record(event.site, event.duration,
+                                  event.task_clock_ns, event.weight);
+    }
+    if (min_ticks > 0 && event.duration < min_ticks) {
+        for (std::uint32_t i = local.frame_count; i != 0; --i) {
+            if (local.frames[i - 1].begin.weight != 0) {
+                local.frames[i - 1].filtered += 1 + event.filtered;
+                break;
+            }
+        }
+        return;
+    }
+    recorder.record(event);
+}
+
+}  // namespace neon
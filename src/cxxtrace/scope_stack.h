@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+
+#include "recorder.h"
+#include "trace_event.h"
+
+namespace neon {
+
+struct TraceLocal;
+
+// Per-thread shadow stack of open scopes. A scope is recorded once, when it
+// ends, as a kScopeComplete event with its start, duration and the metrics
+// spent inside it. Events therefore come out in end order, children before
+// their parent, and carry their depth to rebuild the nesting.
+// Scopes that TraceSampling left out stay on the stack with weight 0: their
+// children know to drop themselves, and their ends are matched without
+// being recorded.
+class ScopeStack {
+   public:
+    // Called when tracing is enabled. Scopes left open from before, whose
+    // ends were lost while tracing was off, are dropped by each thread at
+    // its next scope instead of nesting everything after them.
+    static void new_epoch();
+
+    static void begin(TraceEvent const& event);
+    // a scope sampled out at site: no snapshot, nothing is recorded for it
+    static void begin_sampled_out(TraceSiteId site);
+    // weight of the innermost open scope, 1 outside any
+    static std::uint32_t parent_weight();
+    // Ends the innermost scope if it was sampled out at site and returns
+    // true; its end then needs no snapshot. Otherwise end() follows.
+    static bool end_sampled_out(TraceSiteId site);
+    // end: snapshot taken when the scope ends; the event gets the weight of
+    // its begin. Scopes shorter than min_ticks are not recorded but counted
+    // in the enclosing recorded scope's `filtered`.
+    // histograms: also add every finished scope to LatencyHistograms.
+    static void end(TraceEvent const& end, std::int64_t min_ticks,
+                    bool histograms, Recorder& recorder);
+
+   private:
+    friend struct TraceLocal;
+    struct Frame {
+        TraceEvent begin;  // weight 0: sampled out
+        std::uint32_t filtered;
+        std::uint32_t depth;  // recorded scopes below it
+    };
+    // The open scopes of the calling thread are in TraceLocal. frames is
+    // grown on the heap and released at thread exit.
+    struct Owner;
+
+    // drops the frames of an earlier epoch
+    static void sync_epoch(TraceLocal& local);
+    // cold: makes room for one more frame
+    static void grow(TraceLocal& local);
+    static Frame& push(TraceLocal& local);
+};
+
+}  // namespace neon
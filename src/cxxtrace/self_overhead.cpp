@@ -0,0 +1,160 @@
+#include "self_overhead.h"
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+
+#include "malloc_hook_disable_guard.h"
+#include "thread_info.h"
+#include "trace_clock.h"
+#include "trace_local.h"
+
+namespace neon {
+
+std::atomic<std::uint32_t> SelfOverhead::sample_rate_{0};
+static std::atomic<TraceOption::Clock> g_clock_{TraceOption::Clock::kSteady};
+
+// Written by the owning thread only, with a plain load and store.
+struct SelfOverhead::Counters {
+    std::atomic<std::uint64_t> calls{0};
+    std::atomic<std::uint64_t> sampled{0};
+    std::atomic<std::int64_t> ticks{0};
+    std::atomic<std::int64_t> task_clock_ns{0};
+    // calls until the next sampled one, per section so that alternating
+    // sections do not always sample the same one; 0 before the first call,
+    // which starts a full period: it pays for the thread's setup
+    std::uint32_t countdown{0};
+
+    void add_to(Totals& to) const {
+        to.calls += calls.load(std::memory_order_relaxed);
+        to.sampled += sampled.load(std::memory_order_relaxed);
+        to.ticks += ticks.load(std::memory_order_relaxed);
+        to.task_clock_ns += task_clock_ns.load(std::memory_order_relaxed);
+    }
+};
+
+struct SelfOverhead::ThreadState {
+    std::uint32_t tid{0};
+    Counters sections[kSectionCount];
+};
+
+struct SelfOverhead::Registry {
+    std::mutex mutex;
+    std::vector<ThreadState*> threads;  // running
+    Totals exited[kSectionCount];
+};
+
+// TraceLocal points here after the thread's Owner has run; the malloc hook
+// may still probe from later destructors, those calls are not counted.
+static char g_exited_thread_;
+
+SelfOverhead::Registry& SelfOverhead::registry() {
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+namespace {
+template <typename T>
+void add(std::atomic<T>& counter, T value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+}
+}  // namespace
+
+void SelfOverhead::enable(std::uint32_t sample_rate,
+                          TraceOption::Clock clock) {
+    g_clock_ = clock;
+    sample_rate_ = sample_rate;
+}
+
+struct SelfOverhead::Owner {
+    static ThreadState* exited() {
+        return reinterpret_cast<ThreadState*>(&g_exited_thread_);
+    }
+
+    ~Owner() {
+        TraceLocal& local = t_trace_local_;
+        std::unique_ptr<ThreadState> state(local.overhead);
+        local.overhead = exited();
+        MallocHookDisableGuard guard;
+        Registry& global = registry();
+        std::lock_guard<std::mutex> lock(global.mutex);
+        global.threads.erase(std::find(global.threads.begin(),
+                                       global.threads.end(), state.get()));
+        for (int i = 0; i < kSectionCount; ++i) {
+            state->sections[i].add_to(global.exited[i]);
+        }
+    }
+};
+
+// In TraceLocal, which needs no destructor; Owner releases it.
+SelfOverhead::ThreadState* SelfOverhead::local() {
+    TraceLocal& local = t_trace_local_;
+    if (CXXTRACE_UNLIKELY(!local.overhead)) {
+        // the allocations below must not come back here through the hook
+        MallocHookDisableGuard guard;
+        static thread_local Owner owner;
+        std::unique_ptr<ThreadState> state(new ThreadState());
+        state->tid = ThreadInfo::current().tid();
+        Registry& global = registry();
+        std::lock_guard<std::mutex> lock(global.mutex);
+        global.threads.push_back(state.get());
+        local.overhead = state.release();
+    }
+    return local.overhead == Owner::exited() ? nullptr : local.overhead;
+}
+
+void SelfOverhead::Probe::start(Section section) noexcept {
+    ThreadState* state = local();
+    if (!state) {
+        return;
+    }
+    Counters& counters = state->sections[section];
+    add<std::uint64_t>(counters.calls, 1);
+    const std::uint32_t rate = sample_rate_.load(std::memory_order_relaxed);
+    if (counters.countdown == 0) {
+        counters.countdown = rate;
+    }
+    if (--counters.countdown != 0) {
+        return;
+    }
+    counters.countdown = rate;
+    counters_ = &counters;
+    start_task_clock_ns_ = ThreadInfo::current().task_clock_ns();
+    start_ticks_ = TraceClock::now(g_clock_.load(std::memory_order_relaxed));
+}
+
+void SelfOverhead::Probe::stop() noexcept {
+    const std::int64_t ticks =
+        TraceClock::now(g_clock_.load(std::memory_order_relaxed)) -
+        start_ticks_;
+    const std::int64_t task_clock_ns =
+        ThreadInfo::current().task_clock_ns() - start_task_clock_ns_;
+    add<std::uint64_t>(counters_->sampled, 1);
+    add<std::int64_t>(counters_->ticks, ticks);
+    add<std::int64_t>(counters_->task_clock_ns, task_clock_ns);
+}
+
+std::vector<SelfOverhead::ThreadTotals> SelfOverhead::totals() {
+    std::vector<ThreadTotals> totals;
+    Registry& global = registry();
+    std::lock_guard<std::mutex> lock(global.mutex);
+    for (auto const& thread : global.threads) {
+        ThreadTotals thread_totals;
+        thread_totals.tid = thread->tid;
+        for (int i = 0; i < kSectionCount; ++i) {
+            thread->sections[i].add_to(thread_totals.sections[i]);
+        }
+        totals.push_back(thread_totals);
+    }
+    ThreadTotals exited;
+    std::copy(std::begin(global.exited), std::end(global.exited),
+              std::begin(exited.sections));
+    if (std::any_of(std::begin(exited.sections), std::end(exited.sections),
+                    [](Totals const& section) { return section.calls != 0; })) {
+        totals.push_back(exited);
+    }
+    return totals;
+}
+
+}  // namespace neon
@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "cxxtrace/cxxtrace.h"
+
+namespace neon {
+
+// Sampled accounting of the time the tracer itself takes, see
+// TraceOption::overhead_sample_rate. Each thread counts every call of a
+// section and measures one in sample_rate of them with two clock reads and
+// two task clock reads; calls * ticks / sampled estimates the total.
+class SelfOverhead {
+    struct Counters;
+
+   public:
+    enum Section : std::uint8_t {
+        kScopeBegin,  // TraceSectionBegin
+        kScopeEnd,    // TraceSectionEnd
+        kMalloc,      // the malloc hook listener
+        kWriter,      // TraceWriter on the backend's consumer thread
+        kSectionCount,
+    };
+    struct Totals {
+        std::uint64_t calls{0};
+        std::uint64_t sampled{0};
+        std::int64_t ticks{0};  // of the sampled calls
+        std::int64_t task_clock_ns{0};
+    };
+    struct ThreadTotals {
+        std::uint32_t tid{0};
+        Totals sections[kSectionCount];
+    };
+
+    // clock is the one the trace timestamps use; a sample_rate of 0
+    // turns the accounting off.
+    static void enable(std::uint32_t sample_rate, TraceOption::Clock clock);
+    static bool enabled() {
+        return sample_rate_.load(std::memory_order_relaxed) != 0;
+    }
+    // Since enable, of every running thread that ran a section, and under
+    // tid 0 those of the threads that have exited, summed.
+    static std::vector<ThreadTotals> totals();
+
+    // Measures its own lifetime when the thread's turn to sample has come.
+    class Probe {
+       public:
+        explicit Probe(Section section) noexcept {
+            if (enabled()) {
+                start(section);
+            }
+        }
+        ~Probe() {
+            if (counters_) {
+                stop();
+            }
+        }
+        Probe(Probe const&) = delete;
+        Probe& operator=(Probe const&) = delete;
+
+       private:
+        void start(Section section) noexcept;
+        void stop() noexcept;
+
+        Counters* counters_{nullptr};
+        std::int64_t start_ticks_{0};
+        std::int64_t start_task_clock_ns_{0};
+    };
+
+   private:
+    friend struct TraceLocal;
+    struct ThreadState;
+    struct Registry;
+    // folds the thread's counters into the exited totals at thread exit
+    struct Owner;
+    // nullptr once the thread's destructors have released its state
+    static ThreadState* local();
+    static Registry& registry();
+
+    static std::atomic<std::uint32_t> sample_rate_;
+};
+
+}  // namespace neon
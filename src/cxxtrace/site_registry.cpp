@@ -0,0 +1,220 @@
+#include "site_registry.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace neon {
+
+constexpr std::size_t SiteRegistry::kChunkBits;
+constexpr std::size_t SiteRegistry::kChunkSize;
+constexpr std::size_t SiteRegistry::kMaxChunks;
+
+SiteRegistry::SiteRegistry() {
+    if (const char* rules = std::getenv("CXXTRACE_TAGS")) {
+        set_tag_filter(rules);
+    }
+}
+
+SiteRegistry& SiteRegistry::inst() {
+    static SiteRegistry* registry = new SiteRegistry();
+    return *registry;
+}
+
+TraceSiteId SiteRegistry::register_site(Tag tag, const Location& loc) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto key = std::make_tuple(tag, loc.filepath(), loc.line());
+    auto it = ids_.find(key);
+    if (it != ids_.end()) {
+        return it->second;
+    }
+    TraceSiteId id = size_.load(std::memory_order_relaxed);
+    std::size_t chunk = id >> kChunkBits;
+    if (chunk >= kMaxChunks) {
+        return kInvalidTraceSite;
+    }
+    if (!chunks_storage_[chunk]) {
+        chunks_storage_[chunk].reset(new SiteInfo[kChunkSize]);
+        chunks_[chunk].store(chunks_storage_[chunk].get(),
+                             std::memory_order_release);
+    }
+    SiteInfo& info = chunks_storage_[chunk][id & (kChunkSize - 1)];
+    info.tag = tag;
+    info.loc = loc;
+    info.sampling.store(pack(sampling_for(tag)), std::memory_order_relaxed);
+    info.enabled.store(enabled_for(tag), std::memory_order_relaxed);
+    ids_.emplace(key, id);
+    size_.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+TraceSiteId SiteRegistry::attach(TraceSite& site) {
+    const TraceSiteId id = register_site(site.tag, site.loc);
+    if (id == kInvalidTraceSite) {
+        return kTraceSiteDisabled;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    const TraceSiteId state =
+        enabled_for(site.tag) ? id : id | kTraceSiteDisabled;
+    // several threads may register the same site at once
+    if (site.state.exchange(state, std::memory_order_relaxed) ==
+        kInvalidTraceSite) {
+        attached_.emplace_back(id, &site);
+    }
+    return state;
+}
+
+SiteInfo const* SiteRegistry::find(TraceSiteId id) const noexcept {
+    if (id == kInvalidTraceSite || id >= end_id()) {
+        return nullptr;
+    }
+    SiteInfo const* chunk =
+        chunks_[id >> kChunkBits].load(std::memory_order_acquire);
+    return &chunk[id & (kChunkSize - 1)];
+}
+
+std::uint64_t SiteRegistry::pack(TraceSampling const& sampling) noexcept {
+    return std::uint64_t{sampling.period} |
+           (static_cast<std::uint64_t>(sampling.mode) << 32) |
+           (std::uint64_t{sampling.independent} << 40);
+}
+
+TraceSampling SiteRegistry::sampling(TraceSiteId id) const noexcept {
+    TraceSampling sampling;
+    SiteInfo const* info = find(id);
+    if (!info) {
+        return sampling;
+    }
+    const std::uint64_t packed = info->sampling.load(std::memory_order_relaxed);
+    sampling.period = static_cast<std::uint32_t>(packed);
+    sampling.mode = static_cast<TraceSampling::Mode>((packed >> 32) & 0xff);
+    sampling.independent = (packed >> 40) & 1;
+    return sampling;
+}
+
+TraceSampling const& SiteRegistry::sampling_for(Tag tag) const {
+    auto it = tag_sampling_.find(tag ? tag : "");
+    return it != tag_sampling_.end() ? it->second : default_sampling_;
+}
+
+void SiteRegistry::update_sampling() {
+    bool active = default_sampling_.mode != TraceSampling::Mode::kAll;
+    for (auto const& entry : tag_sampling_) {
+        active |= entry.second.mode != TraceSampling::Mode::kAll;
+    }
+    const TraceSiteId end = size_.load(std::memory_order_relaxed);
+    for (TraceSiteId id = 1; id < end; ++id) {
+        SiteInfo& info =
+            chunks_storage_[id >> kChunkBits][id & (kChunkSize - 1)];
+        info.sampling.store(pack(sampling_for(info.tag)),
+                            std::memory_order_relaxed);
+    }
+    sampling_active_.store(active, std::memory_order_relaxed);
+}
+
+void SiteRegistry::set_sampling(Tag tag, TraceSampling const& sampling) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tag_sampling_[tag ? tag : ""] = sampling;
+    update_sampling();
+}
+
+void SiteRegistry::set_default_sampling(TraceSampling const& sampling) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    default_sampling_ = sampling;
+    update_sampling();
+}
+
+static bool tag_matches(std::string const& pattern, Tag tag) {
+    const std::string name = tag ? tag : "";
+    if (!pattern.empty() && pattern.back() == '*') {
+        return name.compare(0, pattern.size() - 1, pattern, 0,
+                            pattern.size() - 1) == 0;
+    }
+    return name == pattern;
+}
+
+bool SiteRegistry::enabled_for(Tag tag) const {
+    bool enabled = true;
+    for (auto const& rule : tag_rules_) {
+        if (tag_matches(rule.first, tag)) {
+            enabled = rule.second;
+        }
+    }
+    return enabled;
+}
+
+void SiteRegistry::update_enabled() {
+    const TraceSiteId end = size_.load(std::memory_order_relaxed);
+    for (TraceSiteId id = 1; id < end; ++id) {
+        SiteInfo& info =
+            chunks_storage_[id >> kChunkBits][id & (kChunkSize - 1)];
+        info.enabled.store(enabled_for(info.tag), std::memory_order_relaxed);
+    }
+    for (auto const& entry : attached_) {
+        SiteInfo const* info = find(entry.first);
+        const bool enabled = info->enabled.load(std::memory_order_relaxed);
+        entry.second->state.store(
+            enabled ? entry.first : entry.first | kTraceSiteDisabled,
+            std::memory_order_relaxed);
+    }
+}
+
+void SiteRegistry::add_tag_rule(std::string pattern, bool enabled) {
+    // a pattern set again moves to the end, it is the newest rule
+    tag_rules_.erase(
+        std::remove_if(tag_rules_.begin(), tag_rules_.end(),
+                       [&pattern](std::pair<std::string, bool> const& rule) {
+                           return rule.first == pattern;
+                       }),
+        tag_rules_.end());
+    tag_rules_.emplace_back(std::move(pattern), enabled);
+}
+
+void SiteRegistry::set_tag_enabled(std::string const& pattern, bool enabled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    add_tag_rule(pattern, enabled);
+    update_enabled();
+}
+
+void SiteRegistry::set_tag_filter(std::string const& rules) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tag_rules_.clear();
+    std::size_t begin = 0;
+    while (begin <= rules.size()) {
+        std::size_t end = rules.find(',', begin);
+        if (end == std::string::npos) {
+            end = rules.size();
+        }
+        std::string pattern = rules.substr(begin, end - begin);
+        begin = end + 1;
+        const bool enabled = pattern.empty() || pattern[0] != '-';
+        if (!enabled) {
+            pattern.erase(0, 1);
+        }
+        if (!pattern.empty()) {
+            add_tag_rule(std::move(pattern), enabled);
+        }
+    }
+    update_enabled();
+}
+
+TraceSiteId TraceRegisterSite(Tag tag, const Location& loc) {
+    return SiteRegistry::inst().register_site(tag, loc);
+}
+
+TraceSiteId TraceRegisterSite(TraceSite& site) {
+    return SiteRegistry::inst().attach(site);
+}
+
+void TraceSetSampling(Tag tag, TraceSampling const& sampling) {
+    SiteRegistry::inst().set_sampling(tag, sampling);
+}
+
+void TraceSetTagEnabled(const char* pattern, bool enabled) {
+    SiteRegistry::inst().set_tag_enabled(pattern ? pattern : "", enabled);
+}
+
+void TraceSetTagFilter(const char* rules) {
+    SiteRegistry::inst().set_tag_filter(rules ? rules : "");
+}
+
+}  // namespace neon
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "cxxtrace/cxxtrace.h"
+
+namespace neon {
+
+struct SiteInfo {
+    Tag tag;
+    Location loc;
+    // TraceSampling packed by SiteRegistry::pack, changed at runtime
+    std::atomic<std::uint64_t> sampling{0};
+    // false while the tag filter disables the tag
+    std::atomic<bool> enabled{true};
+};
+
+// Process-wide table of trace call sites. Registration takes a lock and runs
+// once per site; lookups by id are lock-free so the writer thread can resolve
+// ids while new sites are being added.
+class SiteRegistry {
+   public:
+    static SiteRegistry& inst();
+
+    TraceSiteId register_site(Tag tag, const Location& loc);
+    // Registers a TRACE_SCOPE site and keeps its state in sync with the tag
+    // filter from now on. Returns the new state.
+    TraceSiteId attach(TraceSite& site);
+    // nullptr for ids that were never handed out
+    SiteInfo const* find(TraceSiteId id) const noexcept;
+    // one past the largest registered id
+    TraceSiteId end_id() const noexcept {
+        return size_.load(std::memory_order_acquire);
+    }
+
+    void set_sampling(Tag tag, TraceSampling const& sampling);
+    void set_default_sampling(TraceSampling const& sampling);
+    // false while every site records all calls, lets the hot path skip the
+    // sampler entirely
+    bool sampling_active() const noexcept {
+        return sampling_active_.load(std::memory_order_relaxed);
+    }
+    TraceSampling sampling(TraceSiteId id) const noexcept;
+
+    void set_tag_enabled(std::string const& pattern, bool enabled);
+    // see TraceSetTagFilter
+    void set_tag_filter(std::string const& rules);
+    bool enabled(TraceSiteId id) const noexcept {
+        SiteInfo const* info = find(id);
+        return !info || info->enabled.load(std::memory_order_relaxed);
+    }
+
+   private:
+    static constexpr std::size_t kChunkBits = 10;
+    static constexpr std::size_t kChunkSize = std::size_t{1} << kChunkBits;
+    static constexpr std::size_t kMaxChunks = 1024;
+
+    SiteRegistry();
+    static std::uint64_t pack(TraceSampling const& sampling) noexcept;
+    // caller holds mutex_
+    TraceSampling const& sampling_for(Tag tag) const;
+    void update_sampling();
+    // caller holds mutex_
+    bool enabled_for(Tag tag) const;
+    void update_enabled();
+    void add_tag_rule(std::string pattern, bool enabled);
+
+    std::mutex mutex_;
+    std::map<std::tuple<const char*, const char*, int>, TraceSiteId> ids_;
+    std::map<std::string, TraceSampling> tag_sampling_;
+    TraceSampling default_sampling_;
+    std::atomic<bool> sampling_active_{false};
+    std::vector<std::pair<std::string, bool>> tag_rules_;
+    std::vector<std::pair<TraceSiteId, TraceSite*>> attached_;
+    std::unique_ptr<SiteInfo[]> chunks_storage_[kMaxChunks];
+    std::atomic<SiteInfo*> chunks_[kMaxChunks]{};
+    // id 0 is reserved as "no site"
+    std::atomic<TraceSiteId> size_{1};
+};
+
+}  // namespace neon
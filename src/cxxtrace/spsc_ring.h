@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+namespace neon {
+
+// Bounded single-producer/single-consumer ring. The producer only writes
+// head_, the consumer only writes tail_; each side caches the other's index so
+// the common case touches no shared cache line.
+template <typename T>
+class SpscRing {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "SpscRing only holds trivially copyable records");
+
+   public:
+    explicit SpscRing(std::size_t capacity)
+        : capacity_{round_up_pow2(capacity)},
+          mask_{capacity_ - 1},
+          slots_{new T[capacity_]} {}
+    SpscRing(SpscRing const&) = delete;
+    SpscRing& operator=(SpscRing const&) = delete;
+
+    std::size_t capacity() const noexcept { return capacity_; }
+
+    bool try_push(T const& value) noexcept {
+        const std::uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - cached_tail_ >= capacity_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head - cached_tail_ >= capacity_) {
+                return false;
+            }
+        }
+        slots_[head & mask_] = value;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& value) noexcept {
+        const std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == cached_head_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail == cached_head_) {
+                return false;
+            }
+        }
+        value = slots_[tail & mask_];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: hands every readable record to fn and releases them in
+    // one store. Returns the number of records consumed.
+    template <typename Fn>
+    std::size_t consume_all(Fn&& fn) {
+        const std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+        cached_head_ = head_.load(std::memory_order_acquire);
+        for (std::uint64_t i = tail; i != cached_head_; ++i) {
+            fn(slots_[i & mask_]);
+        }
+        tail_.store(cached_head_, std::memory_order_release);
+        return static_cast<std::size_t>(cached_head_ - tail);
+    }
+
+    bool empty() const noexcept {
+        return head_.load(std::memory_order_acquire) ==
+               tail_.load(std::memory_order_acquire);
+    }
+
+   private:
+    static std::size_t round_up_pow2(std::size_t n) {
+        std::size_t capacity = 2;
+        while (capacity < n) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    const std::size_t capacity_;
+    const std::size_t mask_;
+    std::unique_ptr<T[]> slots_;
+
+    alignas(64) std::atomic<std::uint64_t> head_{0};
+    std::uint64_t cached_tail_{0};
+    alignas(64) std::atomic<std::uint64_t> tail_{0};
+    std::uint64_t cached_head_{0};
+};
+
+}  // namespace neon
@@ -1,41 +1,143 @@
 #include "structlog.h"
 
-#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include "spdlog/sinks/base_sink.h"
+#include "trace_local.h"
+#include "trace_writer.h"
 
 namespace neon {
 
-StructLog::StructLog(CreateOption const& options) {
-    std::vector<spdlog::sink_ptr> sinks;
-    if (options.enable_stdout) {
-        sinks.emplace_back(
-            std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
-    }
-    if (!options.file_name.empty()) {
-        spdlog::file_event_handlers handlers;
-        ;
-        handlers.after_open = [](spdlog::filename_t filename,
-                                 std::FILE* fstream) { fputs("[\n", fstream); };
-        handlers.before_close = [](spdlog::filename_t filename,
-                                   std::FILE* fstream) {
-            fputs("{}]", fstream);
-        };
-        auto file_sink = std::make_shared<spdlog::sinks::basic_file_sink_mt>(
-            options.file_name, true, handlers);
-        sinks.emplace_back(file_sink);
-        file_sink->set_pattern("    %v,");
-    }
-    if (sinks.empty()) {
+// The log message payload is the raw bytes of one QueuedEvent.
+struct QueuedEvent {
+    TraceEvent event;
+    std::uint64_t seq;  // per thread and StructLog
+};
+
+class TraceFileSink : public spdlog::sinks::base_sink<std::mutex> {
+   public:
+    TraceFileSink(std::unique_ptr<TraceWriter> writer,
+                  std::shared_ptr<StructLog::Queue> queue, bool counted)
+        : writer_{std::move(writer)},
+          queue_{std::move(queue)},
+          counted_{counted} {}
+
+   protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override {
+        if (msg.payload.size() != sizeof(QueuedEvent)) {
+            return;
+        }
+        QueuedEvent queued;
+        std::memcpy(&queued, msg.payload.data(), sizeof(queued));
+        if (counted_) {
+            queue_->queued.fetch_sub(1, std::memory_order_relaxed);
+        }
+        TraceEvent const& event = queued.event;
+        ThreadState& thread = threads_[event.tid];
+        if (queued.seq != thread.next_seq) {
+            writer_->write_lost(event.tid, queued.seq - thread.next_seq,
+                                thread.last_end, event.ts);
+        }
+        thread.next_seq = queued.seq + 1;
+        thread.last_end = event.ts + event.duration;
+        writer_->write(event);
+    }
+    void flush_() override { writer_->flush(); }
+
+   private:
+    struct ThreadState {
+        std::uint64_t next_seq{0};
+        std::int64_t last_end{0};
+    };
+
+    std::unique_ptr<TraceWriter> writer_;
+    std::shared_ptr<StructLog::Queue> queue_;
+    const bool counted_;
+    std::unordered_map<std::uint32_t, ThreadState> threads_;
+};
+
+StructLog::StructLog(CreateOption const& options)
+    : capacity_{options.capacity},
+      overflow_{options.overflow},
+      queue_{std::make_shared<Queue>()} {
+    if (options.file_name.empty()) {
+        return;
+    }
+    auto writer = TraceWriter::open(options.file_name, options.calibration,
+                                    options.counter_mask, options.output);
+    if (!writer) {
         return;
     }
-    spdlog::init_thread_pool(8192, 1);
+    const bool counted = overflow_ != TraceOption::Overflow::kOverwriteOldest;
+    auto file_sink =
+        std::make_shared<TraceFileSink>(std::move(writer), queue_, counted);
+    spdlog::init_thread_pool(capacity_, 1);
+    thread_pool_ = spdlog::thread_pool();
+    // kDropNewest never lets the queue fill, blocking is only a backstop
     async_logger_ = std::make_shared<spdlog::async_logger>(
-        "cxxtrace", sinks.begin(), sinks.end(), spdlog::thread_pool(),
-        spdlog::async_overflow_policy::block);
+        "cxxtrace", file_sink, thread_pool_,
+        overflow_ == TraceOption::Overflow::kOverwriteOldest
+            ? spdlog::async_overflow_policy::overrun_oldest
+            : spdlog::async_overflow_policy::block);
 }
 
-void StructLog::log(nlohmann::json&& msg) const {
-    if (async_logger_) {
-        async_logger_->info(msg.dump());
+void StructLog::record(TraceEvent const& event) {
+    if (!async_logger_) {
+        return;
+    }
+    TraceLocal& local = t_trace_local_;
+    if (CXXTRACE_UNLIKELY(local.sequence_owner != instance_)) {
+        local.sequence_owner = instance_;
+        local.sequence_next = 0;
     }
+    QueuedEvent queued{event, local.sequence_next++};
+    if (overflow_ != TraceOption::Overflow::kOverwriteOldest && !reserve()) {
+        return;
+    }
+    async_logger_->log(
+        spdlog::level::info,
+        spdlog::string_view_t(reinterpret_cast<const char*>(&queued),
+                              sizeof(queued)));
+}
+
+bool StructLog::reserve() {
+    const std::size_t queued =
+        queue_->queued.fetch_add(1, std::memory_order_relaxed);
+    if (queued < capacity_) {
+        // a racing thread may store a lower peak over a higher one; the
+        // peak is a gauge, not a count
+        if (queued + 1 > queue_peak_.load(std::memory_order_relaxed)) {
+            queue_peak_.store(queued + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+    if (overflow_ == TraceOption::Overflow::kDropNewest) {
+        queue_->queued.fetch_sub(1, std::memory_order_relaxed);
+        queue_->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // kBlock: spdlog's enqueue waits for the worker to make room
+    full_waits_.fetch_add(1, std::memory_order_relaxed);
+    if (queue_peak_.load(std::memory_order_relaxed) < capacity_) {
+        queue_peak_.store(capacity_, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+std::uint64_t StructLog::dropped_events() const {
+    std::uint64_t dropped = queue_->dropped.load(std::memory_order_relaxed);
+    if (thread_pool_) {
+        dropped += thread_pool_->overrun_counter();
+    }
+    return dropped;
+}
+
+TraceContention StructLog::contention() const {
+    TraceContention contention;
+    contention.full_waits = full_waits_.load(std::memory_order_relaxed);
+    contention.queue_peak = queue_peak_.load(std::memory_order_relaxed);
+    return contention;
 }
 }  // namespace neon
@@ -1,32 +1,63 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
-#include "nlohmann/json.hpp"
+#include "recorder.h"
+#include "trace_clock.h"
+#include "trace_output.h"
 #include "spdlog/async.h"
-#include "spdlog/sinks/basic_file_sink.h"
-#include "spdlog/sinks/rotating_file_sink.h"
-#include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
 
 namespace neon {
 
-class StructLog {
+// Recording backend that ships raw TraceEvents through spdlog's shared async
+// queue; the queue worker encodes them with a TraceWriter.
+//
+// Every event carries a per-thread sequence number, so the worker sees the
+// gap left by events that were dropped (kDropNewest, counted against
+// capacity before enqueueing) or overwritten in the queue
+// (kOverwriteOldest) and marks it in the trace.
+//
+// All threads share the one queue: a place in it is reserved with one
+// fetch_add on the count of queued events. contention() reports the
+// highest count seen and the producers that found the queue full under
+// kBlock.
+class StructLog : public Recorder {
    public:
     struct CreateOption {
-        bool enable_stdout{false};
         std::string file_name{""};
+        ClockCalibration calibration{};
+        std::uint32_t counter_mask{0};
+        OutputOption output{};
+        std::size_t capacity{8192};
+        TraceOption::Overflow overflow{TraceOption::Overflow::kDropNewest};
     };
     StructLog(CreateOption const& options);
-    ~StructLog() = default;
-    static StructLog const& inst() {
-        static StructLog inst{CreateOption{true, "cxxtrace.json"}};
-        return inst;
-    }
-    void log(nlohmann::json&& msg) const;
+    ~StructLog() override = default;
+    void record(TraceEvent const& event) override;
+    std::uint64_t dropped_events() const override;
+    TraceContention contention() const override;
+
+    // shared with the sink, which may outlive this
+    struct Queue {
+        std::atomic<std::size_t> queued{0};
+        std::atomic<std::uint64_t> dropped{0};
+    };
 
    private:
+    // reserves a place for one event, false when it is dropped instead
+    bool reserve();
+
+    std::size_t capacity_{0};
+    TraceOption::Overflow overflow_{TraceOption::Overflow::kDropNewest};
+    std::shared_ptr<Queue> queue_;
+    std::atomic<std::uint64_t> full_waits_{0};
+    // only written when a reservation goes above it, at most capacity times
+    std::atomic<std::uint64_t> queue_peak_{0};
+    std::shared_ptr<spdlog::details::thread_pool> thread_pool_;
     std::shared_ptr<spdlog::async_logger> async_logger_;
 };
 }  // namespace neon
@@ -0,0 +1,71 @@
+#include "trace_clock.h"
+
+#include <thread>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+namespace neon {
+
+static bool cpu_counter_usable() {
+#if defined(__aarch64__)
+    return true;
+#elif CXXTRACE_HAS_CPU_COUNTER && !defined(_MSC_VER)
+    // Invariant TSC: ticks at a constant rate across P-/C-states and is
+    // synchronized between cores, otherwise raw ticks cannot be compared.
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (edx & (1u << 8)) != 0;
+#else
+    return false;
+#endif
+}
+
+TraceClock::Source TraceClock::resolve(Source requested) {
+    switch (requested) {
+        case Source::kCpuCounter:
+        case Source::kCpuCounterOrdered:
+            return cpu_counter_usable() ? requested : Source::kSteady;
+        case Source::kMonotonicCoarse:
+#ifdef CLOCK_MONOTONIC_COARSE
+            return requested;
+#else
+            return Source::kSteady;
+#endif
+        default:
+            return Source::kSteady;
+    }
+}
+
+ClockCalibration TraceClock::calibrate(Source source) {
+    ClockCalibration calibration;
+    calibration.clock = source;
+    calibration.base_ns = steady_ns();
+    calibration.base_ticks = now(source);
+    if (source != Source::kCpuCounter && source != Source::kCpuCounterOrdered) {
+        // ticks are nanoseconds already
+        return calibration;
+    }
+#if defined(__aarch64__)
+    std::uint64_t frequency;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+    if (frequency != 0) {
+        calibration.ns_per_tick = 1e9 / static_cast<double>(frequency);
+        return calibration;
+    }
+#endif
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const std::int64_t end_ns = steady_ns();
+    const std::int64_t end_ticks = now(source);
+    if (end_ticks > calibration.base_ticks) {
+        calibration.ns_per_tick =
+            static_cast<double>(end_ns - calibration.base_ns) /
+            static_cast<double>(end_ticks - calibration.base_ticks);
+    }
+    return calibration;
+}
+
+}  // namespace neon
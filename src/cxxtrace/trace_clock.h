@@ -0,0 +1,96 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+#include "cxxtrace/cxxtrace.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define CXXTRACE_HAS_CPU_COUNTER 1
+#elif defined(__aarch64__)
+#define CXXTRACE_HAS_CPU_COUNTER 1
+#else
+#define CXXTRACE_HAS_CPU_COUNTER 0
+#endif
+
+namespace neon {
+
+// Maps raw ticks of one clock to steady_clock nanoseconds:
+//   ns = base_ns + (ticks - base_ticks) * ns_per_tick
+struct ClockCalibration {
+    TraceOption::Clock clock{TraceOption::Clock::kSteady};
+    std::int64_t base_ticks{0};
+    std::int64_t base_ns{0};
+    double ns_per_tick{1.0};
+};
+
+class TraceClock {
+   public:
+    using Source = TraceOption::Clock;
+
+    // The requested source if this build and CPU support it, kSteady
+    // otherwise.
+    static Source resolve(Source requested);
+    // Measures the tick rate of source against steady_clock. Blocks for a
+    // few milliseconds for the cpu counters.
+    static ClockCalibration calibrate(Source source);
+
+    static std::int64_t steady_ns() noexcept {
+        auto now = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   now.time_since_epoch())
+            .count();
+    }
+
+    static std::int64_t now(Source source) noexcept {
+        switch (source) {
+#if CXXTRACE_HAS_CPU_COUNTER
+            case Source::kCpuCounter:
+                return cpu_counter();
+            case Source::kCpuCounterOrdered:
+                return cpu_counter_ordered();
+#endif
+#ifdef CLOCK_MONOTONIC_COARSE
+            case Source::kMonotonicCoarse: {
+                timespec ts;
+                clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+                return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 +
+                       ts.tv_nsec;
+            }
+#endif
+            default:
+                return steady_ns();
+        }
+    }
+
+#if CXXTRACE_HAS_CPU_COUNTER
+    static std::int64_t cpu_counter() noexcept {
+#if defined(__aarch64__)
+        std::uint64_t value;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+        return static_cast<std::int64_t>(value);
+#else
+        return static_cast<std::int64_t>(__rdtsc());
+#endif
+    }
+
+    // Waits for earlier instructions to retire before reading the counter.
+    static std::int64_t cpu_counter_ordered() noexcept {
+#if defined(__aarch64__)
+        std::uint64_t value;
+        asm volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(value)::"memory");
+        return static_cast<std::int64_t>(value);
+#else
+        unsigned int aux;
+        return static_cast<std::int64_t>(__rdtscp(&aux));
+#endif
+    }
+#endif
+};
+
+}  // namespace neon
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+
+#include "cxxtrace/cxxtrace.h"
+#include "thread_info.h"
+
+namespace neon {
+
+struct TraceEvent {
+    enum class Type {
+        kScopeBegin,     // snapshot at the start of a scope
+        kScopeComplete,  // one finished scope
+    };
+    TraceEvent() noexcept = default;
+    TraceEvent(TraceEvent&& other) noexcept = default;
+    TraceEvent(TraceEvent const& other) noexcept = default;
+    TraceEvent& operator=(TraceEvent&& other) noexcept = default;
+    TraceEvent& operator=(TraceEvent const& other) noexcept = default;
+
+    TraceEvent(Type type, TraceSiteId site) : type{type}, site{site} {}
+    Type type{Type::kScopeBegin};
+    TraceSiteId site{kInvalidTraceSite};
+    std::uint32_t tid{0};
+    std::uint32_t weight{1};    // calls this sampled event stands for
+    std::uint32_t filtered{0};  // short scopes folded into this one
+    std::uint32_t depth{0};     // open enclosing scopes on the thread
+    // kScopeBegin: running values of the thread; kScopeComplete: spent
+    // inside the scope
+    std::int64_t task_clock_ns{0};
+    std::int64_t allocated_heap_bytes{0};
+    std::int64_t deallocated_heap_bytes{0};
+    HardwareCounters counters{};
+    std::int64_t ts{0};  // raw ticks of the selected TraceOption::Clock
+    std::int64_t duration{0};  // kScopeComplete, in ticks
+};
+
+}  // namespace neon
@@ -0,0 +1,7 @@
+#include "trace_local.h"
+
+namespace neon {
+
+CXXTRACE_THREAD_LOCAL TraceLocal t_trace_local_ CXXTRACE_INITIAL_EXEC;
+
+}  // namespace neon
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "call_tree_log.h"
+#include "flight_recorder_log.h"
+#include "latency_histogram.h"
+#include "ring_buffer_log.h"
+#include "sampler.h"
+#include "scope_stack.h"
+#include "self_overhead.h"
+#include "thread_info.h"
+
+namespace neon {
+
+// Owner of a backend buffer once the thread's destructors have released
+// it; late events of the thread are dropped.
+constexpr std::uint64_t kTraceLocalExited = ~std::uint64_t{0};
+
+// What the tracer keeps per thread besides ThreadInfo, in one flat block of
+// initial-exec TLS (see thread_info.h): the shadow stack, the sampler, and
+// the buffer the backend records the thread's events into, with the number
+// of the log it belongs to. The pointed-to objects are owned elsewhere;
+// each module releases its part at thread exit through a thread_local that
+// only its cold path touches. The first cache line is what a sampled scope
+// recorded into a RingBufferLog needs.
+struct alignas(64) TraceLocal {
+    // ScopeStack
+    ScopeStack::Frame* frames;
+    std::uint32_t frame_count;
+    std::uint32_t frame_capacity;
+    std::uint32_t frame_epoch;  // TraceEnable the frames were opened under
+    // Sampler: the per-site table, by id, and the random state
+    std::uint32_t sampler_site_count;
+    Sampler::SiteState* sampler_sites;
+    std::uint64_t sampler_random;
+    SelfOverhead::ThreadState* overhead;
+    // RingBufferLog
+    std::uint64_t ring_owner;
+    RingBufferLog::ThreadRing* ring;
+    LatencyHistograms::ThreadHistograms* histograms;
+    // CallTreeLog
+    std::uint64_t tree_owner;
+    CallTreeLog::ThreadTree* tree;
+    // FlightRecorderLog
+    std::uint64_t flight_ring_owner;
+    FlightRecorderLog::ThreadRing* flight_ring;
+    // StructLog: the thread's next sequence number
+    std::uint64_t sequence_owner;
+    std::uint64_t sequence_next;
+};
+
+extern CXXTRACE_THREAD_LOCAL TraceLocal t_trace_local_ CXXTRACE_INITIAL_EXEC;
+
+static_assert(offsetof(TraceLocal, histograms) == 64,
+              "the first cache line of TraceLocal changed");
+
+}  // namespace neon
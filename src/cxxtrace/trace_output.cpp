@@ -0,0 +1,159 @@
+#include "trace_output.h"
+
+#include <algorithm>
+#include <cctype>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "compressed_output.h"
+#include "mapped_file_output.h"
+#if defined(__linux__)
+#include "uring_output.h"
+#endif
+
+namespace neon {
+
+static constexpr std::size_t kWriteBufferSize = 1 << 20;
+
+std::unique_ptr<TraceOutput> TraceOutput::open(std::string const& file_name,
+                                               TraceOption::Output kind) {
+#if defined(__linux__)
+    if (kind == TraceOption::Output::kUring) {
+        return UringOutput::open(file_name);
+    }
+#endif
+#if !defined(_WIN32)
+    if (kind == TraceOption::Output::kMappedFile ||
+        kind == TraceOption::Output::kUring) {
+        return MappedFileOutput::open(file_name);
+    }
+#endif
+    return StdioOutput::open(file_name);
+}
+
+std::unique_ptr<TraceOutput> TraceOutput::open(std::string const& file_name,
+                                               OutputOption const& option) {
+    auto output = open(file_name, option.kind);
+    if (output && option.compression_threads > 0) {
+        output.reset(new CompressedOutput(std::move(output),
+                                          option.compression_threads));
+    }
+    return output;
+}
+
+// where NumberedFileName puts the number
+static std::size_t number_position(std::string const& file_name) {
+    auto dot = file_name.find_last_of('.');
+    auto slash = file_name.find_last_of("/\\");
+    if (dot == std::string::npos ||
+        (slash != std::string::npos && dot < slash)) {
+        dot = file_name.size();
+    }
+    return dot;
+}
+
+std::string NumberedFileName(std::string const& file_name,
+                             std::uint32_t number) {
+    const std::size_t dot = number_position(file_name);
+    return file_name.substr(0, dot) + "." + std::to_string(number) +
+           file_name.substr(dot);
+}
+
+// The number of name, an entry of the directory of file_name, if it is
+// one of the numbered names of file_name, else 0.
+static std::uint32_t file_number(std::string const& file_name,
+                                 std::string const& dir,
+                                 std::string const& name) {
+    const std::string path = dir + name;
+    const std::size_t dot = number_position(file_name);
+    const std::string prefix = file_name.substr(0, dot) + ".";
+    const std::string suffix = file_name.substr(dot);
+    if (path.size() <= prefix.size() + suffix.size() ||
+        path.compare(0, prefix.size(), prefix) != 0 ||
+        path.compare(path.size() - suffix.size(), suffix.size(), suffix) !=
+            0) {
+        return 0;
+    }
+    const std::string digits = path.substr(
+        prefix.size(), path.size() - prefix.size() - suffix.size());
+    if (digits.size() > 9 ||
+        !std::all_of(digits.begin(), digits.end(), [](char c) {
+            return std::isdigit(static_cast<unsigned char>(c)) != 0;
+        })) {
+        return 0;
+    }
+    return static_cast<std::uint32_t>(std::stoul(digits));
+}
+
+std::vector<NumberedFile> FindNumberedFiles(std::string const& file_name) {
+    std::vector<NumberedFile> files;
+    const auto slash = file_name.find_last_of("/\\");
+    const std::string dir =
+        slash == std::string::npos ? "" : file_name.substr(0, slash + 1);
+#if defined(_WIN32)
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA((dir + "*").c_str(), &entry);
+    if (find == INVALID_HANDLE_VALUE) {
+        return files;
+    }
+    do {
+        const std::uint32_t number =
+            file_number(file_name, dir, entry.cFileName);
+        if (number != 0) {
+            files.push_back(NumberedFile{
+                number, dir + entry.cFileName,
+                (std::uint64_t{entry.nFileSizeHigh} << 32) |
+                    entry.nFileSizeLow});
+        }
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    DIR* entries = opendir(dir.empty() ? "." : dir.c_str());
+    if (!entries) {
+        return files;
+    }
+    while (dirent* entry = readdir(entries)) {
+        const std::uint32_t number = file_number(file_name, dir, entry->d_name);
+        struct stat info;
+        const std::string path = dir + entry->d_name;
+        if (number != 0 && stat(path.c_str(), &info) == 0) {
+            files.push_back(NumberedFile{
+                number, path, static_cast<std::uint64_t>(info.st_size)});
+        }
+    }
+    closedir(entries);
+#endif
+    std::sort(files.begin(), files.end(),
+              [](NumberedFile const& a, NumberedFile const& b) {
+                  return a.number < b.number;
+              });
+    return files;
+}
+
+std::unique_ptr<StdioOutput> StdioOutput::open(std::string const& file_name) {
+    std::FILE* file = std::fopen(file_name.c_str(), "wb");
+    if (!file) {
+        return nullptr;
+    }
+    return std::unique_ptr<StdioOutput>(new StdioOutput(file));
+}
+
+StdioOutput::StdioOutput(std::FILE* file)
+    : file_{file}, buffer_{new char[kWriteBufferSize]} {
+    std::setvbuf(file_, buffer_.get(), _IOFBF, kWriteBufferSize);
+}
+
+StdioOutput::~StdioOutput() { std::fclose(file_); }
+
+bool StdioOutput::write(const void* data, std::size_t size) {
+    return std::fwrite(data, 1, size, file_) == size;
+}
+
+void StdioOutput::flush() { std::fflush(file_); }
+
+}  // namespace neon
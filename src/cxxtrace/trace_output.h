@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cxxtrace/cxxtrace.h"
+
+namespace neon {
+
+// How a backend writes its trace file.
+struct OutputOption {
+    TraceOption::Output kind{TraceOption::Output::kStdio};
+    // LZ4 block compression on this many threads, 0 for none
+    unsigned compression_threads{0};
+    // Rotation, done by TraceWriter; see TraceOption for the meaning.
+    std::uint64_t rotate_bytes{0};
+    std::uint32_t rotate_interval_ms{0};
+    std::uint64_t max_total_bytes{0};
+    // TraceWriter adds the SelfOverhead totals to every clock sync and a
+    // summary at the end
+    bool self_overhead{false};
+};
+
+// file_name with number before the extension: cxxtrace.bin -> cxxtrace.3.bin
+std::string NumberedFileName(std::string const& file_name,
+                             std::uint32_t number);
+
+struct NumberedFile {
+    std::uint32_t number;
+    std::string name;
+    std::uint64_t size;
+};
+// The numbered files of file_name on disk, lowest number first, such as
+// the ones an earlier process rotated out.
+std::vector<NumberedFile> FindNumberedFiles(std::string const& file_name);
+
+// Where a TraceWriter puts its bytes. Used from one thread at a time.
+class TraceOutput {
+   public:
+    // Kinds the platform lacks fall back to kMappedFile, then kStdio.
+    // nullptr if the file cannot be created.
+    static std::unique_ptr<TraceOutput> open(std::string const& file_name,
+                                             TraceOption::Output kind);
+    // Adds the compression stage if the option asks for it.
+    static std::unique_ptr<TraceOutput> open(std::string const& file_name,
+                                             OutputOption const& option);
+    virtual ~TraceOutput() = default;
+
+    // Appends size bytes; false once the output has failed.
+    virtual bool write(const void* data, std::size_t size) = 0;
+    // Makes the bytes written so far reach the file soon, without waiting.
+    virtual void flush() {}
+};
+
+// fwrite through a 1 MiB stdio buffer.
+class StdioOutput : public TraceOutput {
+   public:
+    static std::unique_ptr<StdioOutput> open(std::string const& file_name);
+    ~StdioOutput() override;
+
+    bool write(const void* data, std::size_t size) override;
+    void flush() override;
+
+   private:
+    explicit StdioOutput(std::FILE* file);
+
+    std::FILE* file_;
+    std::unique_ptr<char[]> buffer_;
+};
+
+}  // namespace neon
@@ -0,0 +1,381 @@
+#include "trace_writer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+#include "event_block.h"
+#include "latency_histogram.h"
+#include "self_overhead.h"
+#include "site_registry.h"
+
+namespace neon {
+
+static constexpr std::int64_t kClockSyncIntervalNs = 1000000000;
+
+static_assert(std::uint32_t{format::kCycles} == HardwareCounters::kCycles &&
+                  std::uint32_t{format::kInstructions} ==
+                      HardwareCounters::kInstructions &&
+                  std::uint32_t{format::kLlcMisses} ==
+                      HardwareCounters::kLlcMisses &&
+                  std::uint32_t{format::kBranchMisses} ==
+                      HardwareCounters::kBranchMisses &&
+                  std::uint32_t{format::kDtlbMisses} ==
+                      HardwareCounters::kDtlbMisses,
+              "counter bits are written to the header as is");
+
+std::unique_ptr<TraceWriter> TraceWriter::open(
+    std::string const& file_name, ClockCalibration const& calibration,
+    std::uint32_t counter_mask, OutputOption const& output) {
+    auto trace_output = TraceOutput::open(file_name, output);
+    if (!trace_output) {
+        return nullptr;
+    }
+    return std::unique_ptr<TraceWriter>(
+        new TraceWriter(std::move(trace_output), file_name, calibration,
+                        counter_mask, output));
+}
+
+TraceWriter::TraceWriter(std::unique_ptr<TraceOutput> output,
+                         std::string const& file_name,
+                         ClockCalibration const& calibration,
+                         std::uint32_t counter_mask,
+                         OutputOption const& option)
+    : output_{std::move(output)},
+      file_name_{file_name},
+      option_{option},
+      counter_mask_{counter_mask},
+      file_opened_ns_{TraceClock::steady_ns()},
+      opened_ns_{file_opened_ns_},
+      calibration_{calibration},
+      last_sync_ns_{calibration.base_ns},
+      counters_{counter_mask != 0} {
+    write_header();
+    // continue after the files an earlier process rotated out, and count
+    // them towards max_total_bytes
+    if (option_.rotate_bytes != 0 || option_.rotate_interval_ms != 0) {
+        for (NumberedFile& file : FindNumberedFiles(file_name_)) {
+            rotations_ = file.number;
+            rotated_bytes_ += file.size;
+            rotated_.push_back(RotatedFile{std::move(file.name), file.size});
+        }
+        enforce_retention();
+    }
+}
+
+void TraceWriter::write_header() {
+    format::FileHeader header;
+    header.clock = static_cast<format::ClockSource>(calibration_.clock);
+    header.counters = static_cast<std::uint8_t>(counter_mask_);
+    header.base_ticks = calibration_.base_ticks;
+    header.base_ns = calibration_.base_ns;
+    header.ns_per_tick = calibration_.ns_per_tick;
+    output_->write(&header, sizeof(header));
+    file_bytes_ = sizeof(header);
+    total_bytes_ += sizeof(header);
+}
+
+TraceWriter::~TraceWriter() {
+    for (auto& block : blocks_) {
+        write_block(block.second.events);
+    }
+    if (LatencyHistograms::enabled()) {
+        for (TraceLatency const& latency : LatencyHistograms::summaries()) {
+            write(latency);
+        }
+    }
+    write_clock_sync();
+    if (option_.self_overhead) {
+        write_overhead();
+        write_overhead_summary();
+    }
+}
+
+void TraceWriter::flush() {
+    SelfOverhead::Probe probe{SelfOverhead::kWriter};
+    if (rotation_due()) {
+        rotate();
+    }
+    for (auto& block : blocks_) {
+        if (!block.second.grown) {
+            write_block(block.second.events);
+        }
+        block.second.grown = false;
+    }
+    if (TraceClock::steady_ns() - last_sync_ns_ >= kClockSyncIntervalNs) {
+        write_clock_sync();
+        if (option_.self_overhead) {
+            write_overhead();
+        }
+    }
+    if (output_) {
+        output_->flush();
+    }
+    // without a size limit the current file has no bound to leave room for
+    if (option_.rotate_bytes == 0) {
+        enforce_retention();
+    }
+}
+
+bool TraceWriter::rotation_due() const {
+    if (option_.rotate_bytes != 0 && file_bytes_ >= option_.rotate_bytes) {
+        return true;
+    }
+    return option_.rotate_interval_ms != 0 &&
+           TraceClock::steady_ns() - file_opened_ns_ >=
+               std::int64_t{option_.rotate_interval_ms} * 1000000;
+}
+
+static std::uint64_t file_size(std::string const& file_name) {
+    std::FILE* file = std::fopen(file_name.c_str(), "rb");
+    if (!file) {
+        return 0;
+    }
+    std::fseek(file, 0, SEEK_END);
+    const long size = std::ftell(file);
+    std::fclose(file);
+    return size > 0 ? static_cast<std::uint64_t>(size) : 0;
+}
+
+void TraceWriter::rotate() {
+    if (!output_) {
+        return;
+    }
+    // pending events refer to sites defined in this file
+    for (auto& block : blocks_) {
+        write_block(block.second.events);
+    }
+    write_clock_sync();
+    output_.reset();
+    file_bytes_ = 0;
+    const std::string rotated = NumberedFileName(file_name_, ++rotations_);
+    if (std::rename(file_name_.c_str(), rotated.c_str()) == 0) {
+        rotated_.push_back(RotatedFile{rotated, file_size(rotated)});
+        rotated_bytes_ += rotated_.back().size;
+        enforce_retention();
+    } else {
+        std::cerr << "cxxtrace: cannot rename " << file_name_ << " to "
+                  << rotated << std::endl;
+    }
+    output_ = TraceOutput::open(file_name_, option_);
+    if (!output_) {
+        std::cerr << "cxxtrace: cannot create " << file_name_ << std::endl;
+        return;
+    }
+    file_opened_ns_ = TraceClock::steady_ns();
+    next_string_id_ = 1;
+    string_ids_.clear();
+    defined_sites_.clear();
+    write_header();
+    write_clock_sync();
+}
+
+void TraceWriter::enforce_retention() {
+    if (option_.max_total_bytes == 0) {
+        return;
+    }
+    // leave room for a full current file, or for the current file as it
+    // is when only its age limits it
+    const std::uint64_t current =
+        option_.rotate_bytes != 0
+            ? std::min(option_.rotate_bytes, option_.max_total_bytes)
+            : file_bytes_;
+    while (!rotated_.empty() &&
+           current + rotated_bytes_ > option_.max_total_bytes) {
+        rotated_bytes_ -= rotated_.front().size;
+        std::remove(rotated_.front().name.c_str());
+        rotated_.pop_front();
+    }
+}
+
+void TraceWriter::write_clock_sync() {
+    format::ClockSyncRecord record;
+    record.ticks = TraceClock::now(calibration_.clock);
+    record.ns = TraceClock::steady_ns();
+    last_sync_ns_ = record.ns;
+    write_record(format::RecordType::kClockSync, &record, sizeof(record));
+}
+
+void TraceWriter::write_overhead() {
+    for (SelfOverhead::ThreadTotals const& thread : SelfOverhead::totals()) {
+        for (int i = 0; i < SelfOverhead::kSectionCount; ++i) {
+            SelfOverhead::Totals const& totals = thread.sections[i];
+            if (totals.calls == 0) {
+                continue;
+            }
+            format::OverheadRecord record{};
+            record.tid = thread.tid;
+            record.section = static_cast<format::OverheadSection>(i);
+            record.calls = totals.calls;
+            record.sampled = totals.sampled;
+            record.ticks = totals.ticks;
+            record.task_clock_ns = totals.task_clock_ns;
+            write_record(format::RecordType::kOverhead, &record,
+                         sizeof(record));
+        }
+    }
+}
+
+void TraceWriter::write_overhead_summary() {
+    double overhead_ticks = 0;
+    for (SelfOverhead::ThreadTotals const& thread : SelfOverhead::totals()) {
+        for (SelfOverhead::Totals const& totals : thread.sections) {
+            if (totals.sampled != 0) {
+                overhead_ticks += static_cast<double>(totals.ticks) *
+                                  totals.calls / totals.sampled;
+            }
+        }
+    }
+    format::OverheadSummaryRecord record{};
+    record.events = events_;
+    record.bytes = total_bytes_;
+    record.lost = lost_;
+    record.duration_ns = TraceClock::steady_ns() - opened_ns_;
+    record.overhead_ns = static_cast<std::int64_t>(
+        overhead_ticks * calibration_.ns_per_tick);
+    if (record.duration_ns > 0) {
+        record.events_per_sec = events_ * 1e9 / record.duration_ns;
+    }
+    if (events_ != 0) {
+        record.ns_per_event =
+            static_cast<double>(record.overhead_ns) / events_;
+        record.bytes_per_event = static_cast<double>(total_bytes_) / events_;
+    }
+    write_record(format::RecordType::kOverheadSummary, &record,
+                 sizeof(record));
+}
+
+void TraceWriter::write_record(format::RecordType type, const void* payload,
+                               std::uint32_t size) {
+    if (!output_) {
+        return;
+    }
+    format::RecordHeader header{type, 0, size};
+    output_->write(&header, sizeof(header));
+    output_->write(payload, size);
+    file_bytes_ += sizeof(header) + size;
+    total_bytes_ += sizeof(header) + size;
+}
+
+std::uint32_t TraceWriter::string_id(std::string const& text) {
+    auto inserted = string_ids_.emplace(text, next_string_id_);
+    if (inserted.second) {
+        ++next_string_id_;
+        std::string payload(sizeof(format::StringRecord), '\0');
+        format::StringRecord record{inserted.first->second};
+        payload.replace(0, sizeof(record),
+                        reinterpret_cast<const char*>(&record), sizeof(record));
+        payload += text;
+        write_record(format::RecordType::kString, payload.data(),
+                     static_cast<std::uint32_t>(payload.size()));
+    }
+    return inserted.first->second;
+}
+
+void TraceWriter::define_site(TraceSiteId site) {
+    if (site < defined_sites_.size() && defined_sites_[site]) {
+        return;
+    }
+    SiteInfo const* info = SiteRegistry::inst().find(site);
+    if (!info) {
+        return;
+    }
+    if (site >= defined_sites_.size()) {
+        defined_sites_.resize(site + 1, false);
+    }
+    defined_sites_[site] = true;
+    format::SiteRecord record{};
+    record.id = site;
+    record.tag_id = string_id(info->tag ? info->tag : "");
+    record.file_id = string_id(info->loc.filename());
+    record.line = info->loc.line();
+    write_record(format::RecordType::kSite, &record, sizeof(record));
+}
+
+void TraceWriter::write(TraceEvent const& event) {
+    if (event.type != TraceEvent::Type::kScopeComplete) {
+        return;
+    }
+    SelfOverhead::Probe probe{SelfOverhead::kWriter};
+    ++events_;
+    format::EventRecord record{};
+    record.type = format::EventType::kScopeComplete;
+    define_site(event.site);
+    record.depth = static_cast<std::uint16_t>(
+        std::min<std::uint32_t>(event.depth, 0xffff));
+    record.site_id = event.site;
+    record.tid = event.tid;
+    record.weight = event.weight;
+    record.filtered = event.filtered;
+    record.ts = event.ts;
+    record.duration = event.duration;
+    record.task_clock_ns = event.task_clock_ns;
+    record.allocated_heap_bytes = event.allocated_heap_bytes;
+    record.deallocated_heap_bytes = event.deallocated_heap_bytes;
+    record.cycles = event.counters.cycles;
+    record.instructions = event.counters.instructions;
+    record.llc_misses = event.counters.llc_misses;
+    record.branch_misses = event.counters.branch_misses;
+    record.dtlb_misses = event.counters.dtlb_misses;
+    PendingBlock& block = blocks_[event.tid];
+    block.events.push_back(record);
+    block.grown = true;
+    if (block.events.size() == format::kEventBlockEvents) {
+        write_block(block.events);
+        if (rotation_due()) {
+            rotate();
+        }
+    }
+}
+
+void TraceWriter::write_block(std::vector<format::EventRecord>& events) {
+    if (events.empty()) {
+        return;
+    }
+    block_payload_.clear();
+    format::EncodeEventBlock(events.data(), events.size(), counters_,
+                             block_payload_);
+    write_record(format::RecordType::kEventBlock, block_payload_.data(),
+                 static_cast<std::uint32_t>(block_payload_.size()));
+    events.clear();
+}
+
+void TraceWriter::write_lost(std::uint32_t tid, std::uint64_t count,
+                             std::int64_t after_ts, std::int64_t before_ts) {
+    auto block = blocks_.find(tid);
+    if (block != blocks_.end()) {
+        write_block(block->second.events);
+    }
+    lost_ += count;
+    format::EventsLostRecord record{};
+    record.tid = tid;
+    record.count = count;
+    record.after_ts = after_ts;
+    record.before_ts = before_ts;
+    write_record(format::RecordType::kEventsLost, &record, sizeof(record));
+}
+
+void TraceWriter::write(format::CallNodeRecord const& node) {
+    define_site(node.site_id);
+    write_record(format::RecordType::kCallNode, &node, sizeof(node));
+}
+
+static void copy_percentiles(TraceLatency::Percentiles const& from,
+                             std::int64_t (&to)[5]) {
+    to[0] = from.p50;
+    to[1] = from.p90;
+    to[2] = from.p99;
+    to[3] = from.p999;
+    to[4] = from.max;
+}
+
+void TraceWriter::write(TraceLatency const& latency) {
+    format::LatencyRecord record{};
+    record.tag_id = string_id(latency.tag ? latency.tag : "");
+    record.count = latency.count;
+    copy_percentiles(latency.wall_ns, record.wall_ns);
+    copy_percentiles(latency.task_clock_ns, record.task_clock_ns);
+    write_record(format::RecordType::kLatency, &record, sizeof(record));
+}
+
+}  // namespace neon
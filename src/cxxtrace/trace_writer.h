@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "trace_clock.h"
+#include "trace_event.h"
+#include "trace_format.h"
+#include "trace_output.h"
+
+namespace neon {
+
+// Serializes TraceEvents into the binary trace format. Not thread-safe: each
+// backend owns one writer and calls it from its single consumer thread.
+// Events are held per thread until a kEventBlock is full; flush() writes
+// the blocks of threads that recorded nothing since the last flush, so an
+// idle thread's events are at most two flushes late.
+//
+// With rotation configured in OutputOption the writer closes the file,
+// renames it to a numbered name and starts over with a new header, string
+// table and site definitions, so every file reads on its own. Rotation and
+// retention run inside write() and flush(), on the consumer thread.
+class TraceWriter {
+   public:
+    // counter_mask: HardwareCounters::Mask bits recorded in the events
+    static std::unique_ptr<TraceWriter> open(
+        std::string const& file_name, ClockCalibration const& calibration,
+        std::uint32_t counter_mask = 0,
+        OutputOption const& output = OutputOption{});
+    ~TraceWriter();
+    TraceWriter(TraceWriter const&) = delete;
+    TraceWriter& operator=(TraceWriter const&) = delete;
+
+    void write(TraceEvent const& event);
+    void write(format::CallNodeRecord const& node);
+    void write(TraceLatency const& latency);
+    // Marks count events of tid as lost between after_ts and before_ts;
+    // the thread's pending events are written first to keep them in order.
+    void write_lost(std::uint32_t tid, std::uint64_t count,
+                    std::int64_t after_ts, std::int64_t before_ts);
+    void flush();
+
+   private:
+    TraceWriter(std::unique_ptr<TraceOutput> output,
+                std::string const& file_name,
+                ClockCalibration const& calibration,
+                std::uint32_t counter_mask, OutputOption const& option);
+    void write_header();
+    // size or age limit reached
+    bool rotation_due() const;
+    void rotate();
+    // deletes the oldest rotated files beyond max_total_bytes
+    void enforce_retention();
+    std::uint32_t string_id(std::string const& text);
+    // emits the kSite record the first time a site shows up in this trace
+    void define_site(TraceSiteId site);
+    void write_record(format::RecordType type, const void* payload,
+                      std::uint32_t size);
+    void write_clock_sync();
+    void write_overhead();
+    void write_overhead_summary();
+    void write_block(std::vector<format::EventRecord>& events);
+
+    // events of one thread not written yet
+    struct PendingBlock {
+        std::vector<format::EventRecord> events;
+        bool grown{false};  // since the last flush
+    };
+
+    // null after a failed rotation, the rest of the trace is lost
+    std::unique_ptr<TraceOutput> output_;
+    const std::string file_name_;
+    const OutputOption option_;
+    std::uint32_t counter_mask_;
+    std::uint64_t file_bytes_{0};  // written to the current file
+    std::int64_t file_opened_ns_;
+    std::uint32_t rotations_{0};
+    struct RotatedFile {
+        std::string name;
+        std::uint64_t size;
+    };
+    std::deque<RotatedFile> rotated_;  // oldest first
+    std::uint64_t rotated_bytes_{0};   // their sizes summed
+    // over all files, for the overhead summary
+    const std::int64_t opened_ns_;
+    std::uint64_t events_{0};
+    std::uint64_t total_bytes_{0};
+    std::uint64_t lost_{0};
+    ClockCalibration calibration_;
+    std::int64_t last_sync_ns_{0};
+    std::uint32_t next_string_id_{1};
+    std::unordered_map<std::string, std::uint32_t> string_ids_;
+    std::vector<bool> defined_sites_;
+    bool counters_;
+    std::unordered_map<std::uint32_t, PendingBlock> blocks_;
+    std::vector<std::uint8_t> block_payload_;
+};
+
+}  // namespace neon
@@ -0,0 +1,411 @@
+#include "uring_output.h"
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define CXXTRACE_HAS_IO_URING 1
+#endif
+#endif
+#ifndef CXXTRACE_HAS_IO_URING
+#define CXXTRACE_HAS_IO_URING 0
+#endif
+
+namespace neon {
+
+constexpr std::size_t UringOutput::kAlignment;
+
+static std::size_t align_up(std::size_t size) {
+    return (size + UringOutput::kAlignment - 1) / UringOutput::kAlignment *
+           UringOutput::kAlignment;
+}
+
+#if CXXTRACE_HAS_IO_URING
+
+// The submission and completion queues shared with the kernel, set up with
+// the raw system calls so that no liburing is needed.
+struct UringOutput::Ring {
+    int fd{-1};
+    void* sq_ring{MAP_FAILED};
+    std::size_t sq_ring_size{0};
+    void* cq_ring{MAP_FAILED};
+    std::size_t cq_ring_size{0};
+    io_uring_sqe* sqes{nullptr};
+    std::size_t sqes_size{0};
+    unsigned* sq_tail{nullptr};
+    unsigned* sq_mask{nullptr};
+    unsigned* sq_array{nullptr};
+    unsigned* cq_head{nullptr};
+    unsigned* cq_tail{nullptr};
+    unsigned* cq_mask{nullptr};
+    io_uring_cqe* cqes{nullptr};
+
+    ~Ring() {
+        if (sqes) {
+            munmap(sqes, sqes_size);
+        }
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        if (sq_ring != MAP_FAILED) {
+            munmap(sq_ring, sq_ring_size);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    static std::unique_ptr<Ring> create(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        std::unique_ptr<Ring> ring{new Ring};
+        ring->fd = static_cast<int>(
+            syscall(__NR_io_uring_setup, entries, &params));
+        if (ring->fd < 0) {
+            return nullptr;
+        }
+        ring->sq_ring_size =
+            params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring->cq_ring_size =
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            ring->sq_ring_size = ring->cq_ring_size =
+                std::max(ring->sq_ring_size, ring->cq_ring_size);
+        }
+        ring->sq_ring = mmap(nullptr, ring->sq_ring_size,
+                             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_SQ_RING);
+        if (ring->sq_ring == MAP_FAILED) {
+            return nullptr;
+        }
+        ring->cq_ring =
+            single_mmap
+                ? ring->sq_ring
+                : mmap(nullptr, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->fd,
+                       IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            return nullptr;
+        }
+        ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring->fd,
+                          IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return nullptr;
+        }
+        ring->sqes = static_cast<io_uring_sqe*>(sqes);
+        auto sq = static_cast<char*>(ring->sq_ring);
+        ring->sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        ring->sq_mask =
+            reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        ring->sq_array =
+            reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto cq = static_cast<char*>(ring->cq_ring);
+        ring->cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        ring->cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        ring->cq_mask =
+            reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        ring->cqes =
+            reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return ring;
+    }
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        int result;
+        do {
+            result = static_cast<int>(syscall(__NR_io_uring_enter, fd,
+                                              to_submit, min_complete, flags,
+                                              nullptr, 0));
+        } while (result < 0 && errno == EINTR);
+        return result;
+    }
+
+    // One IORING_OP_WRITEV (kernel 5.1) of iov at offset.
+    bool submit_writev(int file, iovec const* iov, std::uint64_t offset,
+                       std::uint64_t user_data) {
+        const unsigned tail = *sq_tail;
+        const unsigned index = tail & *sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITEV;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<std::uint64_t>(iov);
+        sqe.len = 1;
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        return enter(1, 0, 0) == 1;
+    }
+};
+
+#else
+
+struct UringOutput::Ring {
+    static std::unique_ptr<Ring> create(unsigned) { return nullptr; }
+};
+
+#endif
+
+std::unique_ptr<UringOutput> UringOutput::open(std::string const& file_name) {
+    return open(file_name, CreateOption{});
+}
+
+std::unique_ptr<UringOutput> UringOutput::open(std::string const& file_name,
+                                               CreateOption const& options) {
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int fd = -1;
+    bool direct = false;
+    if (options.direct) {
+        // tmpfs and some network file systems refuse O_DIRECT
+        fd = ::open(file_name.c_str(), flags | O_DIRECT, 0644);
+        direct = fd >= 0;
+    }
+    if (fd < 0) {
+        fd = ::open(file_name.c_str(), flags, 0644);
+    }
+    if (fd < 0) {
+        return nullptr;
+    }
+    CreateOption rounded = options;
+    rounded.buffer_size =
+        align_up(std::max<std::size_t>(1, options.buffer_size));
+    rounded.buffers = std::max<std::size_t>(2, options.buffers);
+    return std::unique_ptr<UringOutput>(new UringOutput(fd, direct, rounded));
+}
+
+UringOutput::UringOutput(int fd, bool direct, CreateOption const& options)
+    : fd_{fd}, direct_{direct}, options_{options} {
+    buffers_.resize(options_.buffers);
+    for (Buffer& buffer : buffers_) {
+        void* data = nullptr;
+        if (posix_memalign(&data, kAlignment, options_.buffer_size) != 0) {
+            failed_ = true;
+            return;
+        }
+        buffer.data = static_cast<char*>(data);
+    }
+    if (options_.use_io_uring) {
+        ring_ = Ring::create(static_cast<unsigned>(options_.buffers));
+    }
+}
+
+UringOutput::~UringOutput() {
+    Buffer& last = buffers_[current_];
+    if (!failed_ && last.size > 0) {
+        last.offset = file_size_;
+        file_size_ += last.size;
+        if (ring_) {
+            submit(current_);
+        } else {
+            last.in_flight = true;
+            pending_.push_back(current_);
+        }
+    }
+    // the kernel may still be reading buffers that failed to complete
+    bool leak = false;
+    if (ring_) {
+        while (in_flight_ > 0 && !leak) {
+            reap(true);
+            leak = in_flight_ > 0 && failed_;
+        }
+    } else {
+        write_pending();
+    }
+    // O_DIRECT wrote the last block padded
+    if (ftruncate(fd_, static_cast<off_t>(file_size_)) != 0) {
+        failed_ = true;
+    }
+    if (failed_) {
+        std::cerr << "cxxtrace: trace file is incomplete\n";
+    }
+    close(fd_);
+    if (!leak) {
+        for (Buffer& buffer : buffers_) {
+            std::free(buffer.data);
+        }
+    }
+}
+
+bool UringOutput::write(const void* data, std::size_t size) {
+    auto bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        if (failed_) {
+            return false;
+        }
+        Buffer& buffer = buffers_[current_];
+        const std::size_t chunk =
+            std::min(size, options_.buffer_size - buffer.size);
+        std::memcpy(buffer.data + buffer.size, bytes, chunk);
+        buffer.size += chunk;
+        bytes += chunk;
+        size -= chunk;
+        if (buffer.size == options_.buffer_size && !next_buffer()) {
+            return false;
+        }
+    }
+    return !failed_;
+}
+
+void UringOutput::flush() {
+    if (ring_ && in_flight_ > 0) {
+        reap(false);
+    }
+}
+
+bool UringOutput::next_buffer() {
+    Buffer& full = buffers_[current_];
+    full.offset = file_size_;
+    file_size_ += full.size;
+    if (ring_) {
+        submit(current_);
+    } else {
+        full.in_flight = true;
+        pending_.push_back(current_);
+    }
+    // buffers are reused in order, so the next one is the oldest write
+    const std::size_t next = (current_ + 1) % buffers_.size();
+    while (buffers_[next].in_flight && !failed_) {
+        if (ring_) {
+            reap(true);
+        } else {
+            write_pending();
+        }
+    }
+    current_ = next;
+    buffers_[current_].size = 0;
+    return !failed_;
+}
+
+// Only the last buffer can be partial; O_DIRECT needs it padded to a block.
+static std::size_t write_size(std::size_t size, bool direct) {
+    return direct ? align_up(size) : size;
+}
+
+void UringOutput::submit(std::size_t index) {
+    Buffer& buffer = buffers_[index];
+    const std::size_t size = write_size(buffer.size, direct_);
+    std::memset(buffer.data + buffer.size, 0, size - buffer.size);
+    buffer.iov.iov_base = buffer.data;
+    buffer.iov.iov_len = size;
+#if CXXTRACE_HAS_IO_URING
+    if (ring_->submit_writev(fd_, &buffer.iov, buffer.offset, index)) {
+        buffer.in_flight = true;
+        ++in_flight_;
+        return;
+    }
+#endif
+    if (!write_rest(buffer, 0, errno)) {
+        failed_ = true;
+    }
+}
+
+void UringOutput::reap(bool wait) {
+#if CXXTRACE_HAS_IO_URING
+    if (wait && ring_->enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+        std::cerr << "cxxtrace: io_uring wait failed: " << std::strerror(errno)
+                  << '\n';
+        failed_ = true;
+        return;
+    }
+    unsigned head = *ring_->cq_head;
+    const unsigned tail = __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        io_uring_cqe const& cqe = ring_->cqes[head & *ring_->cq_mask];
+        Buffer& buffer = buffers_[cqe.user_data];
+        if (!buffer.in_flight) {
+            // a submission that reported failure and was written already
+            continue;
+        }
+        const int error = cqe.res < 0 ? -cqe.res : 0;
+        const std::size_t done =
+            cqe.res < 0 ? 0 : static_cast<std::size_t>(cqe.res);
+        if (done < buffer.iov.iov_len && !write_rest(buffer, done, error)) {
+            failed_ = true;
+        }
+        buffer.in_flight = false;
+        --in_flight_;
+    }
+    __atomic_store_n(ring_->cq_head, head, __ATOMIC_RELEASE);
+#else
+    (void)wait;
+#endif
+}
+
+void UringOutput::write_pending() {
+    if (pending_.empty()) {
+        return;
+    }
+    std::vector<iovec> iovs(pending_.size());
+    for (std::size_t i = 0; i < pending_.size(); ++i) {
+        Buffer& buffer = buffers_[pending_[i]];
+        const std::size_t size = write_size(buffer.size, direct_);
+        std::memset(buffer.data + buffer.size, 0, size - buffer.size);
+        buffer.iov.iov_base = buffer.data;
+        buffer.iov.iov_len = size;
+        iovs[i] = buffer.iov;
+    }
+    // the pending buffers are consecutive in the file
+    ssize_t written;
+    do {
+        written = pwritev(fd_, iovs.data(), static_cast<int>(iovs.size()),
+                          static_cast<off_t>(buffers_[pending_[0]].offset));
+    } while (written < 0 && errno == EINTR);
+    const int error = written < 0 ? errno : 0;
+    std::size_t done = written < 0 ? 0 : static_cast<std::size_t>(written);
+    for (std::size_t index : pending_) {
+        Buffer& buffer = buffers_[index];
+        const std::size_t buffer_done = std::min(done, buffer.iov.iov_len);
+        if (buffer_done < buffer.iov.iov_len &&
+            !write_rest(buffer, buffer_done, error)) {
+            failed_ = true;
+        }
+        done -= buffer_done;
+        buffer.in_flight = false;
+    }
+    pending_.clear();
+}
+
+bool UringOutput::write_rest(Buffer const& buffer, std::size_t done,
+                             int error) {
+    if (error == EINVAL && direct_) {
+        // the file system took O_DIRECT at open but not for this write
+        const int flags = fcntl(fd_, F_GETFL);
+        if (flags >= 0 && fcntl(fd_, F_SETFL, flags & ~O_DIRECT) == 0) {
+            direct_ = false;
+        }
+    }
+    while (done < buffer.iov.iov_len) {
+        const ssize_t n =
+            pwrite(fd_, buffer.data + done, buffer.iov.iov_len - done,
+                   static_cast<off_t>(buffer.offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            std::cerr << "cxxtrace: cannot write trace file: "
+                      << std::strerror(errno) << '\n';
+            return false;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+}  // namespace neon
+
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "trace_output.h"
+
+namespace neon {
+
+// Trace file written in large aligned buffers that are submitted through
+// io_uring and completed in the background: write() copies into the current
+// buffer and only waits when every buffer is still in flight. The file is
+// opened with O_DIRECT where the file system allows it, so the data does
+// not go through the page cache. Without io_uring (old kernel, seccomp,
+// kernel.io_uring_disabled) the filled buffers are written with one
+// blocking pwritev each time none is left. Linux only.
+//
+// Bytes reach the file a whole buffer at a time; flush() does not write
+// a partial buffer, the destructor does.
+class UringOutput : public TraceOutput {
+   public:
+    struct CreateOption {
+        std::size_t buffer_size{1 << 20};  // rounded up to kAlignment
+        std::size_t buffers{8};            // at most buffers - 1 in flight
+        bool use_io_uring{true};           // false forces pwritev
+        bool direct{true};                 // try O_DIRECT
+    };
+    static std::unique_ptr<UringOutput> open(std::string const& file_name);
+    static std::unique_ptr<UringOutput> open(std::string const& file_name,
+                                             CreateOption const& options);
+    ~UringOutput() override;
+
+    bool write(const void* data, std::size_t size) override;
+    void flush() override;
+    bool uses_io_uring() const { return ring_ != nullptr; }
+    bool direct() const { return direct_; }
+
+    // O_DIRECT offset, length and buffer alignment
+    static constexpr std::size_t kAlignment = 4096;
+
+   private:
+    struct Ring;
+    struct Buffer {
+        char* data{nullptr};
+        std::size_t size{0};  // bytes of data to write
+        std::uint64_t offset{0};
+        iovec iov{};
+        bool in_flight{false};
+    };
+
+    UringOutput(int fd, bool direct, CreateOption const& options);
+    // Writes buffers_[index] from the current file offset.
+    void submit(std::size_t index);
+    // Handles finished writes, waiting for at least one if wait is set.
+    void reap(bool wait);
+    // Writes the filled buffers kept for pwritev.
+    void write_pending();
+    // Synchronous write of what a short or failed write left; error is the
+    // errno it failed with, 0 for a short write.
+    bool write_rest(Buffer const& buffer, std::size_t done, int error);
+    bool next_buffer();
+
+    const int fd_;
+    bool direct_;
+    const CreateOption options_;
+    std::unique_ptr<Ring> ring_;
+    std::vector<Buffer> buffers_;
+    std::size_t current_{0};
+    std::size_t in_flight_{0};
+    std::vector<std::size_t> pending_;  // filled, waiting for pwritev
+    std::uint64_t file_size_{0};        // bytes handed to submit()
+    bool failed_{false};
+};
+
+}  // namespace neon
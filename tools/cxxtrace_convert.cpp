@@ -0,0 +1,308 @@
+// Converts a binary trace written by the recorder into the json array read by
+// cxxtrace_viewer.
+//
+//   cxxtrace_convert <trace.bin> [out.json]
+//
+// The output defaults to the input path with a .json extension; "-" writes to
+// stdout. Every scope becomes one complete ("X") event, calling-context
+// tree traces one per tree node. Events a full backend queue dropped show up
+// in between as "lost" entries: count events of tid ended within
+// [ts, ts + dur]. Latency histogram summaries follow as "latency" entries,
+// one per tag, then the tracer's own cost: the last "overhead" totals of
+// every thread and section, with the estimated total in ns, and one
+// "overhead_summary".
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "trace_reader.h"
+
+using namespace neon;
+
+static void site_json(format::TraceReader const& reader, std::uint32_t site_id,
+                      nlohmann::json& json) {
+    format::SiteRecord const* site = reader.site(site_id);
+    json["tag"] = site ? reader.string(site->tag_id) : "";
+    json["file"] = site ? reader.string(site->file_id) : "";
+    json["line"] = site ? site->line : 0;
+}
+
+static nlohmann::json to_json(format::TraceReader const& reader,
+                              format::TickConverter const& ticks,
+                              format::EventRecord const& event) {
+    nlohmann::json json;
+    json["event"] = "X";
+    site_json(reader, event.site_id, json);
+    json["tid"] = event.tid;
+    json["depth"] = event.depth;
+    if (event.weight > 1) {
+        json["weight"] = event.weight;
+    }
+    if (event.filtered > 0) {
+        json["filtered"] = event.filtered;
+    }
+    json["ts"] = ticks.to_ns(event.ts);
+    json["dur"] = ticks.duration_ns(event.duration);
+    json["task_clock"] = event.task_clock_ns;
+    json["alloc"] = event.allocated_heap_bytes;
+    json["dealloc"] = event.deallocated_heap_bytes;
+    const std::uint8_t counters = reader.header().counters;
+    if (counters & format::kCycles) {
+        json["cycles"] = event.cycles;
+    }
+    if (counters & format::kInstructions) {
+        json["instructions"] = event.instructions;
+    }
+    if (counters & format::kLlcMisses) {
+        json["llc_misses"] = event.llc_misses;
+    }
+    if (counters & format::kBranchMisses) {
+        json["branch_misses"] = event.branch_misses;
+    }
+    if (counters & format::kDtlbMisses) {
+        json["dtlb_misses"] = event.dtlb_misses;
+    }
+    return json;
+}
+
+static nlohmann::json to_json(format::TickConverter const& ticks,
+                              format::EventsLostRecord const& lost) {
+    const std::int64_t until = ticks.to_ns(lost.before_ts);
+    const std::int64_t from =
+        lost.after_ts != 0 ? ticks.to_ns(lost.after_ts) : until;
+    nlohmann::json json;
+    json["event"] = "lost";
+    json["tid"] = lost.tid;
+    json["count"] = lost.count;
+    json["ts"] = from;
+    json["dur"] = std::max<std::int64_t>(0, until - from);
+    return json;
+}
+
+// Synthesizes one complete event per calling-context tree node, in the same
+// end order the recorder writes: the children of a node are laid out back to
+// back from the node's start and precede it.
+class CallTreeExpander {
+   public:
+    CallTreeExpander(format::TraceReader const& reader,
+                     format::TickConverter const& ticks, std::ostream& out)
+        : reader_{reader}, ticks_{ticks}, out_{out} {}
+
+    std::size_t expand(std::vector<format::CallNodeRecord> const& nodes) {
+        for (auto const& node : nodes) {
+            children_[node.parent_id].push_back(&node);
+        }
+        std::unordered_map<std::uint32_t, std::int64_t> threads;
+        for (auto const* root : children_[0]) {
+            std::int64_t& ts = threads[root->tid];
+            ts = expand(*root, ts, 0);
+        }
+        return events_;
+    }
+
+   private:
+    // returns the end of the node
+    std::int64_t expand(format::CallNodeRecord const& node, std::int64_t ts,
+                        std::uint32_t depth) {
+        std::int64_t child_ts = ts;
+        for (auto const* next : children_[node.id]) {
+            child_ts = expand(*next, child_ts, depth + 1);
+        }
+        const std::int64_t dur = ticks_.duration_ns(node.total_ticks);
+        nlohmann::json json;
+        json["event"] = "X";
+        site_json(reader_, node.site_id, json);
+        json["tid"] = node.tid;
+        json["depth"] = depth;
+        json["count"] = node.count;
+        json["ts"] = ts;
+        json["dur"] = dur;
+        json["task_clock"] = node.total_task_clock_ns;
+        json["alloc"] = node.total_allocated_heap_bytes;
+        json["dealloc"] = node.total_deallocated_heap_bytes;
+        out_ << (events_++ ? ",\n    " : "    ") << json.dump();
+        return ts + dur;
+    }
+
+    format::TraceReader const& reader_;
+    format::TickConverter const& ticks_;
+    std::ostream& out_;
+    std::unordered_map<std::uint32_t,
+                       std::vector<format::CallNodeRecord const*>>
+        children_;
+    std::size_t events_{0};
+};
+
+static nlohmann::json percentiles_json(std::int64_t const (&values)[5]) {
+    nlohmann::json json;
+    json["p50"] = values[0];
+    json["p90"] = values[1];
+    json["p99"] = values[2];
+    json["p999"] = values[3];
+    json["max"] = values[4];
+    return json;
+}
+
+static nlohmann::json to_json(format::TraceReader const& reader,
+                              format::LatencyRecord const& latency) {
+    nlohmann::json json;
+    json["event"] = "latency";
+    json["tag"] = reader.string(latency.tag_id);
+    json["count"] = latency.count;
+    json["wall_ns"] = percentiles_json(latency.wall_ns);
+    json["task_clock_ns"] = percentiles_json(latency.task_clock_ns);
+    return json;
+}
+
+static const char* const kOverheadSections[] = {"scope_begin", "scope_end",
+                                                "malloc", "writer"};
+
+static nlohmann::json to_json(format::TickConverter const& ticks,
+                              format::OverheadRecord const& overhead) {
+    const auto section = static_cast<std::size_t>(overhead.section);
+    nlohmann::json json;
+    json["event"] = "overhead";
+    json["tid"] = overhead.tid;
+    json["section"] = section < 4 ? kOverheadSections[section] : "unknown";
+    json["calls"] = overhead.calls;
+    json["sampled"] = overhead.sampled;
+    if (overhead.sampled != 0) {
+        const double scale =
+            static_cast<double>(overhead.calls) / overhead.sampled;
+        json["ns"] = static_cast<std::int64_t>(
+            ticks.duration_ns(overhead.ticks) * scale);
+        json["task_clock_ns"] =
+            static_cast<std::int64_t>(overhead.task_clock_ns * scale);
+    }
+    return json;
+}
+
+static nlohmann::json to_json(format::OverheadSummaryRecord const& summary) {
+    nlohmann::json json;
+    json["event"] = "overhead_summary";
+    json["events"] = summary.events;
+    json["bytes"] = summary.bytes;
+    json["lost"] = summary.lost;
+    json["duration_ns"] = summary.duration_ns;
+    json["overhead_ns"] = summary.overhead_ns;
+    json["events_per_sec"] = summary.events_per_sec;
+    json["ns_per_event"] = summary.ns_per_event;
+    json["bytes_per_event"] = summary.bytes_per_event;
+    return json;
+}
+
+static std::string default_output(std::string const& input) {
+    auto dot = input.find_last_of('.');
+    auto slash = input.find_last_of("/\\");
+    if (dot == std::string::npos ||
+        (slash != std::string::npos && dot < slash)) {
+        return input + ".json";
+    }
+    return input.substr(0, dot) + ".json";
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "usage: " << argv[0] << " <trace.bin> [out.json]\n";
+        return 2;
+    }
+    std::string input = argv[1];
+    std::string output = argc == 3 ? argv[2] : default_output(input);
+
+    auto reader = format::TraceReader::open(input);
+    if (!reader) {
+        std::cerr << reader.error() << '\n';
+        return 1;
+    }
+    // First pass: the last clock sync point gives the best tick rate, and
+    // one rate has to be used for the whole trace to keep durations exact.
+    format::TickConverter ticks{reader->header()};
+    format::Record record;
+    std::vector<format::CallNodeRecord> call_nodes;
+    std::vector<nlohmann::json> latencies;
+    // cumulative, the last record of a thread and section has the totals
+    std::map<std::pair<std::uint32_t, int>, format::OverheadRecord> overhead;
+    std::vector<format::OverheadSummaryRecord> summaries;
+    while (reader->next(record)) {
+        if (record.type == format::RecordType::kClockSync &&
+            record.payload.size() >= sizeof(format::ClockSyncRecord)) {
+            ticks.refine(record.as<format::ClockSyncRecord>());
+        } else if (record.type == format::RecordType::kCallNode &&
+                   record.payload.size() >= sizeof(format::CallNodeRecord)) {
+            call_nodes.push_back(record.as<format::CallNodeRecord>());
+        } else if (record.type == format::RecordType::kLatency &&
+                   record.payload.size() >= sizeof(format::LatencyRecord)) {
+            latencies.push_back(
+                to_json(*reader, record.as<format::LatencyRecord>()));
+        } else if (record.type == format::RecordType::kOverhead &&
+                   record.payload.size() >= sizeof(format::OverheadRecord)) {
+            auto const& totals = record.as<format::OverheadRecord>();
+            overhead[{totals.tid, static_cast<int>(totals.section)}] = totals;
+        } else if (record.type == format::RecordType::kOverheadSummary &&
+                   record.payload.size() >=
+                       sizeof(format::OverheadSummaryRecord)) {
+            summaries.push_back(record.as<format::OverheadSummaryRecord>());
+        }
+    }
+    if (call_nodes.empty()) {
+        reader = format::TraceReader::open(input);
+    }
+
+    std::ofstream file;
+    if (output != "-") {
+        file.open(output);
+        if (!file) {
+            std::cerr << "cannot open " << output << '\n';
+            return 1;
+        }
+    }
+    std::ostream& out = output == "-" ? std::cout : file;
+
+    std::size_t events = 0;
+    std::size_t entries = 0;
+    out << "[\n";
+    if (!call_nodes.empty()) {
+        events = CallTreeExpander{*reader, ticks, out}.expand(call_nodes);
+        entries = events;
+    } else {
+        while (reader->next(record)) {
+            if (record.type == format::RecordType::kEvent &&
+                record.payload.size() >= sizeof(format::EventRecord)) {
+                out << (entries++ ? ",\n    " : "    ")
+                    << to_json(*reader, ticks,
+                               record.as<format::EventRecord>())
+                           .dump();
+                ++events;
+            } else if (record.type == format::RecordType::kEventsLost &&
+                       record.payload.size() >=
+                           sizeof(format::EventsLostRecord)) {
+                out << (entries++ ? ",\n    " : "    ")
+                    << to_json(ticks, record.as<format::EventsLostRecord>())
+                           .dump();
+            }
+        }
+    }
+    for (auto const& latency : latencies) {
+        out << (entries++ ? ",\n    " : "    ") << latency.dump();
+    }
+    for (auto const& totals : overhead) {
+        out << (entries++ ? ",\n    " : "    ")
+            << to_json(ticks, totals.second).dump();
+    }
+    for (auto const& summary : summaries) {
+        out << (entries++ ? ",\n    " : "    ") << to_json(summary).dump();
+    }
+    out << "\n]\n";
+
+    if (reader->truncated()) {
+        std::cerr << input << ": trace is truncated, converted " << events
+                  << " events\n";
+    }
+    return 0;
+}
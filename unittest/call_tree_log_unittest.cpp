@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "call_tree_log.h"
+#include "trace_test_util.h"
+
+using namespace neon;
+
+static std::vector<format::CallNodeRecord> read_nodes(std::string const& path) {
+    return read_records<format::CallNodeRecord>(path,
+                                                format::RecordType::kCallNode);
+}
+
+TEST(CallTreeLog, AggregatesCallsPerPath) {
+    const std::string path = "call_tree_log_unittest.bin";
+    const TraceSiteId outer =
+        TraceRegisterSite("outer", SourceLocation::current());
+    const TraceSiteId inner =
+        TraceRegisterSite("inner", SourceLocation::current());
+    {
+        CallTreeLog::CreateOption option;
+        option.file_name = path;
+        option.dump_interval = std::chrono::milliseconds(60000);
+        CallTreeLog log{option};
+        // an end whose begin was never seen is ignored
+        log.record(test_scope(inner, 0, 5));
+        log.record(test_scope_begin(outer));
+        for (int i = 0; i < 2; ++i) {
+            log.record(test_scope_begin(inner));
+            log.record(test_scope(inner, 0, 10, 16));
+        }
+        log.record(test_scope(outer, 0, 100, 40));
+        ASSERT_TRUE(log.dump());
+        // the next dump replaces this one instead of appending
+        log.record(test_scope_begin(outer));
+        log.record(test_scope(outer, 0, 100));
+    }
+
+    auto nodes = read_nodes(path);
+    ASSERT_EQ(nodes.size(), 2u);
+    auto const& root = nodes[0];
+    EXPECT_EQ(root.site_id, outer);
+    EXPECT_EQ(root.parent_id, 0u);
+    EXPECT_EQ(root.tid, kTestTid);
+    EXPECT_EQ(root.count, 2u);
+    EXPECT_EQ(root.total_ticks, 200);
+    EXPECT_EQ(root.self_ticks, 180);
+    EXPECT_EQ(root.total_task_clock_ns, 100);
+    EXPECT_EQ(root.total_allocated_heap_bytes, 40);
+    EXPECT_EQ(root.self_allocated_heap_bytes, 8);
+
+    auto const& child = nodes[1];
+    EXPECT_EQ(child.site_id, inner);
+    EXPECT_EQ(child.parent_id, root.id);
+    EXPECT_EQ(child.count, 2u);
+    EXPECT_EQ(child.total_ticks, 20);
+    EXPECT_EQ(child.self_ticks, 20);
+    EXPECT_EQ(child.total_allocated_heap_bytes, 32);
+    std::remove(path.c_str());
+}
+
+// a log created where another one was destroyed gets its own thread trees
+TEST(CallTreeLog, ReusedAddressStartsNewTrees) {
+    const std::string path = "call_tree_log_reuse_unittest.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("reused", SourceLocation::current());
+    CallTreeLog::CreateOption option;
+    option.file_name = path;
+    option.dump_interval = std::chrono::milliseconds(60000);
+    typename std::aligned_storage<sizeof(CallTreeLog),
+                                  alignof(CallTreeLog)>::type storage;
+    auto* first = new (&storage) CallTreeLog{option};
+    first->record(test_scope_begin(site));
+    first->record(test_scope(site, 0, 10));
+    first->~CallTreeLog();
+
+    auto* second = new (&storage) CallTreeLog{option};
+    second->record(test_scope_begin(site));
+    second->record(test_scope(site, 0, 20));
+    second->~CallTreeLog();
+
+    auto nodes = read_nodes(path);
+    ASSERT_EQ(nodes.size(), 1u);
+    EXPECT_EQ(nodes[0].count, 1u);
+    EXPECT_EQ(nodes[0].total_ticks, 20);
+    std::remove(path.c_str());
+}
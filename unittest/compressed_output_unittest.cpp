@@ -0,0 +1,142 @@
+#include "compressed_output.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "crc32c.h"
+#include "trace_reader.h"
+#include "trace_writer.h"
+
+using namespace neon;
+
+static std::vector<char> read_file(std::string const& path) {
+    std::vector<char> bytes;
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return bytes;
+    }
+    char buffer[4096];
+    std::size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + n);
+    }
+    std::fclose(file);
+    return bytes;
+}
+
+static void write_trace(std::string const& path, unsigned threads,
+                        TraceSiteId site, int events) {
+    OutputOption output;
+    output.kind = TraceOption::Output::kStdio;
+    output.compression_threads = threads;
+    auto writer = TraceWriter::open(path, ClockCalibration{}, 0, output);
+    ASSERT_TRUE(writer);
+    for (int i = 0; i < events; ++i) {
+        TraceEvent event{TraceEvent::Type::kScopeComplete, site};
+        event.tid = 1 + i % 4;
+        event.ts = i * 10;
+        event.duration = i % 1000;
+        writer->write(event);
+        if (i % 1000 == 0) {
+            writer->flush();
+        }
+    }
+}
+
+static std::vector<format::EventRecord> read_events(std::string const& path,
+                                                    bool& truncated) {
+    std::vector<format::EventRecord> events;
+    auto reader = format::TraceReader::open(path);
+    EXPECT_TRUE(reader) << reader.error();
+    format::Record record;
+    while (reader && reader->next(record)) {
+        if (record.type == format::RecordType::kEvent) {
+            events.push_back(record.as<format::EventRecord>());
+        }
+    }
+    truncated = reader && reader->truncated();
+    return events;
+}
+
+TEST(Crc32c, MatchesTheCheckValue) {
+    EXPECT_EQ(format::Crc32c("123456789", 9), 0xe3069283u);
+    // chaining gives the same result as one call
+    EXPECT_EQ(format::Crc32c("6789", 4, format::Crc32c("12345", 5)),
+              0xe3069283u);
+    EXPECT_EQ(format::Crc32c("", 0), 0u);
+}
+
+TEST(CompressedOutput, TraceRoundTripsAcrossBlocks) {
+    const std::string plain = "compressed_output_plain.bin";
+    const std::string packed = "compressed_output_packed.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("compressed", SourceLocation::current());
+    constexpr int kEvents = 400000;
+    write_trace(plain, 0, site, kEvents);
+    write_trace(packed, 2, site, kEvents);
+
+    auto packed_bytes = read_file(packed);
+    ASSERT_GT(packed_bytes.size(), sizeof(format::CompressedFileHeader));
+    EXPECT_LT(packed_bytes.size(), read_file(plain).size());
+
+    bool truncated = true;
+    auto expected = read_events(plain, truncated);
+    EXPECT_FALSE(truncated);
+    auto events = read_events(packed, truncated);
+    EXPECT_FALSE(truncated);
+    ASSERT_EQ(events.size(), static_cast<std::size_t>(kEvents));
+    ASSERT_EQ(events.size(), expected.size());
+    for (std::size_t i = 0; i < events.size(); ++i) {
+        ASSERT_EQ(events[i].tid, expected[i].tid) << i;
+        ASSERT_EQ(events[i].ts, expected[i].ts) << i;
+        ASSERT_EQ(events[i].duration, expected[i].duration) << i;
+    }
+    std::remove(plain.c_str());
+    std::remove(packed.c_str());
+}
+
+TEST(CompressedOutput, CorruptBlockEndsTheTrace) {
+    const std::string path = "compressed_output_corrupt.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("corrupt", SourceLocation::current());
+    constexpr int kEvents = 400000;
+    write_trace(path, 1, site, kEvents);
+
+    auto bytes = read_file(path);
+    // flip a byte of the last block's payload
+    bytes[bytes.size() - 10] ^= 0x55;
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    ASSERT_TRUE(file);
+    std::fwrite(bytes.data(), 1, bytes.size(), file);
+    std::fclose(file);
+
+    bool truncated = false;
+    auto events = read_events(path, truncated);
+    EXPECT_TRUE(truncated);
+    EXPECT_LT(events.size(), static_cast<std::size_t>(kEvents));
+    std::remove(path.c_str());
+}
+
+// A crash leaves the preallocated tail of a mapped file zeroed behind the
+// last whole block, and a zeroed header passes the checksum of no bytes.
+TEST(CompressedOutput, ZeroedTailEndsTheTrace) {
+    const std::string path = "compressed_output_zeroed.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("zeroed", SourceLocation::current());
+    constexpr int kEvents = 1000;
+    write_trace(path, 1, site, kEvents);
+    std::FILE* file = std::fopen(path.c_str(), "ab");
+    ASSERT_TRUE(file);
+    const std::vector<char> tail(4096);
+    std::fwrite(tail.data(), 1, tail.size(), file);
+    std::fclose(file);
+
+    bool truncated = false;
+    auto events = read_events(path, truncated);
+    EXPECT_TRUE(truncated);
+    EXPECT_EQ(events.size(), static_cast<std::size_t>(kEvents));
+    std::remove(path.c_str());
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include "event_block.h"
+#include "stream_vbyte.h"
+
+using namespace neon;
+
+TEST(StreamVByte, RoundTripsEveryLength) {
+    std::vector<std::uint32_t> values;
+    std::uint32_t random = 12345;
+    for (int i = 0; i < 1000; ++i) {
+        random = random * 1103515245u + 12345u;
+        // zeros and 1, 2 and 4 byte values
+        values.push_back(random >> (8 * (i % 5)));
+    }
+    // counts that do not fill the last control byte, decoded partly by the
+    // vectorized path where the CPU has one
+    for (std::size_t count : {0u, 1u, 3u, 5u, 17u, 1000u}) {
+        std::vector<std::uint8_t> encoded;
+        format::StreamVByteEncode(values.data(), count, encoded);
+        std::vector<std::uint32_t> decoded(count);
+        const std::size_t used = format::StreamVByteDecode(
+            encoded.data(), encoded.size(), count, decoded.data());
+        EXPECT_EQ(used, encoded.size());
+        EXPECT_TRUE(std::equal(decoded.begin(), decoded.end(),
+                               values.begin()));
+    }
+    std::vector<std::uint8_t> encoded;
+    format::StreamVByteEncode(values.data(), values.size(), encoded);
+    std::vector<std::uint32_t> decoded(values.size());
+    EXPECT_EQ(format::StreamVByteDecode(encoded.data(), encoded.size() - 1,
+                                        values.size(), decoded.data()),
+              0u);
+}
+
+static format::EventRecord event(std::int64_t ts, std::int64_t duration) {
+    format::EventRecord record{};
+    record.type = format::EventType::kScopeComplete;
+    record.tid = 9;
+    record.site_id = 3;
+    record.weight = 1;
+    record.ts = ts;
+    record.duration = duration;
+    record.task_clock_ns = duration / 3;
+    return record;
+}
+
+TEST(EventBlock, RoundTripsEvents) {
+    std::vector<format::EventRecord> events;
+    events.push_back(event(1000, 50));
+    // a parent ends after its child but started before it
+    events.push_back(event(990, 200));
+    events.back().depth = 1;
+    events.back().site_id = 4;
+    events.back().weight = 16;
+    events.back().filtered = 2;
+    events.back().allocated_heap_bytes = 4096;
+    // needs the high words: long scope, large counters
+    events.push_back(event(5000, std::int64_t{1} << 40));
+    events.back().cycles = std::uint64_t{3} << 34;
+    events.back().dtlb_misses = 7;
+    events.push_back(event(-20, 5));
+
+    std::vector<std::uint8_t> payload;
+    format::EncodeEventBlock(events.data(), events.size(), true, payload);
+    std::vector<format::EventRecord> decoded;
+    ASSERT_TRUE(format::DecodeEventBlock(payload.data(), payload.size(),
+                                         decoded));
+    ASSERT_EQ(decoded.size(), events.size());
+    for (std::size_t i = 0; i < events.size(); ++i) {
+        EXPECT_EQ(std::memcmp(&decoded[i], &events[i], sizeof(events[i])), 0)
+            << "event " << i;
+    }
+    EXPECT_FALSE(format::DecodeEventBlock(payload.data(), payload.size() - 1,
+                                          decoded));
+}
+
+TEST(EventBlock, TypicalEventsTakeUnder12Bytes) {
+    // back to back scopes of a few microseconds in TSC ticks, a few sites,
+    // no heap traffic
+    std::vector<format::EventRecord> events;
+    std::int64_t ts = 1234567890123;
+    for (std::uint32_t i = 0; i < format::kEventBlockEvents; ++i) {
+        const std::int64_t duration = 3000 + (i * 7919) % 9000;
+        events.push_back(event(ts, duration));
+        events.back().site_id = 1 + i % 5;
+        events.back().depth = static_cast<std::uint16_t>(i % 3);
+        ts += duration + 150;
+    }
+    std::vector<std::uint8_t> payload;
+    format::EncodeEventBlock(events.data(), events.size(), false, payload);
+    const double bytes = payload.size() + sizeof(format::RecordHeader);
+    EXPECT_LT(bytes / events.size(), 12.0);
+}
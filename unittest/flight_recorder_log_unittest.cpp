@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "flight_recorder_log.h"
+#include "trace_test_util.h"
+
+using namespace neon;
+
+static std::vector<format::EventRecord> read_events(std::string const& path) {
+    return read_records<format::EventRecord>(path, format::RecordType::kEvent);
+}
+
+TEST(FlightRecorderLog, DumpsTheNewestEventsOfEachThread) {
+    const TraceSiteId site =
+        TraceRegisterSite("flight", SourceLocation::current());
+    FlightRecorderLog::CreateOption option;
+    option.capacity = 4;
+    option.file_name = "flight_recorder_unittest.bin";
+    {
+        FlightRecorderLog log{option};
+        for (int i = 0; i < 10; ++i) {
+            log.record(test_scope(site, i, 10));
+        }
+        std::thread other(
+            [&log, site]() { log.record(test_scope(site, 100, 10)); });
+        other.join();
+        ASSERT_TRUE(log.dump());
+        // nothing new, the second dump repeats the rings
+        ASSERT_TRUE(log.dump());
+    }
+
+    for (const char* path : {"flight_recorder_unittest.1.bin",
+                             "flight_recorder_unittest.2.bin"}) {
+        auto events = read_events(path);
+        std::vector<std::int64_t> ts;
+        for (auto const& event : events) {
+            EXPECT_EQ(event.site_id, site);
+            ts.push_back(event.ts);
+        }
+        // one slot of a full ring is never read
+        EXPECT_EQ(ts, (std::vector<std::int64_t>{7, 8, 9, 100}));
+        std::remove(path);
+    }
+}
+
+TEST(FlightRecorderLog, KeepsOnlyTheWindow) {
+    const TraceSiteId site =
+        TraceRegisterSite("flight", SourceLocation::current());
+    FlightRecorderLog::CreateOption option;
+    option.file_name = "flight_recorder_window.bin";
+    option.window = std::chrono::milliseconds(1000);
+    {
+        FlightRecorderLog log{option};
+        const std::int64_t now = TraceClock::now(option.calibration.clock);
+        log.record(test_scope(site, now - 5000000000, 10));
+        log.record(test_scope(site, now, 10));
+        ASSERT_TRUE(log.dump());
+    }
+    auto events = read_events("flight_recorder_window.1.bin");
+    ASSERT_EQ(events.size(), 1u);
+    std::remove("flight_recorder_window.1.bin");
+}
+
+#if !defined(_WIN32)
+TEST(FlightRecorderLog, DumpsOnSignal) {
+    const TraceSiteId site =
+        TraceRegisterSite("flight", SourceLocation::current());
+    FlightRecorderLog::CreateOption option;
+    option.file_name = "flight_recorder_signal.bin";
+    option.dump_signal = SIGUSR2;
+    {
+        FlightRecorderLog log{option};
+        log.record(test_scope(site, 1, 10));
+        std::raise(SIGUSR2);
+        // the dump runs on the recorder's own thread
+        for (int i = 0; i < 2000; ++i) {
+            if (!read_events("flight_recorder_signal.1.bin").empty()) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    EXPECT_EQ(read_events("flight_recorder_signal.1.bin").size(), 1u);
+    std::remove("flight_recorder_signal.1.bin");
+}
+#endif
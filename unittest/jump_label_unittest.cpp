@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "jump_label.h"
+
+using namespace neon;
+
+__attribute__((noinline)) static bool key_state() { return TraceKeyEnabled(); }
+
+TEST(JumpLabel, PatchesEverySite) {
+#if CXXTRACE_STATIC_KEYS
+    EXPECT_GT(JumpLabel::sites(), 0u);
+#endif
+    EXPECT_FALSE(key_state());
+    ASSERT_TRUE(JumpLabel::set(true));
+    EXPECT_TRUE(key_state());
+    EXPECT_TRUE(TraceKeyEnabled());
+    ASSERT_TRUE(JumpLabel::set(false));
+    EXPECT_FALSE(key_state());
+    EXPECT_FALSE(TraceKeyEnabled());
+}
+
+#if CXXTRACE_STATIC_KEYS
+// every translation unit of a module registers the same table
+TEST(JumpLabel, RegistersATableOnce) {
+    const std::size_t sites = JumpLabel::sites();
+    detail::RegisterJumpTable(__start_cxxtrace_jump_table,
+                              __stop_cxxtrace_jump_table);
+    EXPECT_EQ(JumpLabel::sites(), sites);
+}
+
+// a table registered while enabled is patched right away, as for a shared
+// object dlopen'ed after TraceEnable
+TEST(JumpLabel, PatchesATableRegisteredWhileEnabled) {
+    detail::UnregisterJumpTable(__start_cxxtrace_jump_table);
+    EXPECT_EQ(JumpLabel::sites(), 0u);
+    ASSERT_TRUE(JumpLabel::set(true));
+    EXPECT_FALSE(key_state());
+    detail::RegisterJumpTable(__start_cxxtrace_jump_table,
+                              __stop_cxxtrace_jump_table);
+    EXPECT_TRUE(key_state());
+    ASSERT_TRUE(JumpLabel::set(false));
+    EXPECT_FALSE(key_state());
+}
+#endif
+
+// threads run through the sites while they are rewritten
+TEST(JumpLabel, PatchesSitesOtherThreadsRun) {
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&stop] {
+            while (!stop.load(std::memory_order_relaxed)) {
+                key_state();
+            }
+        });
+    }
+    for (int i = 0; i < 200; ++i) {
+        ASSERT_TRUE(JumpLabel::set(i % 2 == 0));
+    }
+    stop = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_FALSE(key_state());
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <thread>
+
+#include "latency_histogram.h"
+
+using namespace neon;
+
+TEST(LatencyHistogram, BucketsAreContiguousAndNarrow) {
+    for (std::uint64_t value = 0; value < (1u << 20); ++value) {
+        const std::size_t index = LatencyHistogram::index(value);
+        ASSERT_LT(index, LatencyHistogram::kBuckets);
+        const std::uint64_t upper = LatencyHistogram::upper_bound(index);
+        ASSERT_GE(upper, value);
+        ASSERT_LE(upper - value, value / 32);
+        if (index > 0) {
+            ASSERT_LT(LatencyHistogram::upper_bound(index - 1), value);
+        }
+    }
+    EXPECT_EQ(LatencyHistogram::index(~0ull), LatencyHistogram::kBuckets - 1);
+}
+
+TEST(LatencyHistogram, Quantiles) {
+    LatencyHistogram histogram;
+    for (std::uint64_t value = 1; value <= 10000; ++value) {
+        histogram.record(value, 1);
+    }
+    std::vector<std::uint64_t> counts(LatencyHistogram::kBuckets);
+    std::uint64_t max = 0;
+    histogram.add_to(counts, max);
+    EXPECT_EQ(max, 10000u);
+    const std::uint64_t p50 =
+        LatencyHistogram::quantile(counts, 10000, 0.5, max);
+    EXPECT_GE(p50, 5000u);
+    EXPECT_LE(p50, 5000u + 5000u / 32);
+    const std::uint64_t p999 =
+        LatencyHistogram::quantile(counts, 10000, 0.999, max);
+    EXPECT_GE(p999, 9990u);
+    EXPECT_LE(p999, 10000u);
+}
+
+TEST(LatencyHistograms, MergesThreadsAndSitesPerTag) {
+    const TraceSiteId first =
+        TraceRegisterSite("latency_tag", SourceLocation::current());
+    const TraceSiteId second =
+        TraceRegisterSite("latency_tag", SourceLocation::current());
+    std::thread worker([second]() {
+        for (int i = 0; i < 99; ++i) {
+            LatencyHistograms::record(second, 100, 50, 1);
+        }
+    });
+    worker.join();
+    // a sampled scope stands for weight calls
+    LatencyHistograms::record(first, 10000, 20000, 10);
+
+    bool found = false;
+    for (TraceLatency const& latency : LatencyHistograms::summaries()) {
+        if (std::strcmp(latency.tag, "latency_tag") != 0) {
+            continue;
+        }
+        found = true;
+        EXPECT_EQ(latency.count, 109u);
+        // 100 shares a bucket with 101
+        EXPECT_EQ(latency.wall_ns.p50, 101);
+        EXPECT_EQ(latency.wall_ns.p90, 101);
+        EXPECT_GE(latency.wall_ns.p99, 10000);
+        EXPECT_EQ(latency.wall_ns.max, 10000);
+        EXPECT_EQ(latency.task_clock_ns.p50, 50);
+        EXPECT_EQ(latency.task_clock_ns.p999, 20000);
+        EXPECT_EQ(latency.task_clock_ns.max, 20000);
+    }
+    EXPECT_TRUE(found);
+}
@@ -0,0 +1,74 @@
+#include "mapped_file_output.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace neon;
+
+static std::vector<char> read_file(std::string const& path) {
+    std::vector<char> bytes;
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return bytes;
+    }
+    char buffer[4096];
+    std::size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + n);
+    }
+    std::fclose(file);
+    return bytes;
+}
+
+#if !defined(_WIN32)
+TEST(MappedFileOutput, WritesAcrossSegments) {
+    const std::string path = "mapped_file_output_unittest.bin";
+    std::vector<char> expected;
+    {
+        MappedFileOutput::CreateOption option;
+        option.segment_size = 1;  // one page
+        option.max_pending_segments = 1;
+        auto output = MappedFileOutput::open(path, option);
+        ASSERT_TRUE(output);
+        // chunks that do not divide the segment size, one larger than it
+        std::vector<char> chunk(1000);
+        for (int i = 0; i < 300; ++i) {
+            for (std::size_t j = 0; j < chunk.size(); ++j) {
+                chunk[j] = static_cast<char>(i * 31 + j);
+            }
+            ASSERT_TRUE(output->write(chunk.data(), chunk.size()));
+            expected.insert(expected.end(), chunk.begin(), chunk.end());
+        }
+        std::vector<char> large(10000, 'x');
+        ASSERT_TRUE(output->write(large.data(), large.size()));
+        expected.insert(expected.end(), large.begin(), large.end());
+        output->flush();
+        EXPECT_EQ(output->size(), expected.size());
+    }
+    // the preallocated tail is cut off
+    EXPECT_EQ(read_file(path), expected);
+    std::remove(path.c_str());
+}
+
+TEST(MappedFileOutput, EmptyOutputLeavesEmptyFile) {
+    const std::string path = "mapped_file_output_empty.bin";
+    ASSERT_TRUE(MappedFileOutput::open(path));
+    EXPECT_TRUE(read_file(path).empty());
+    std::remove(path.c_str());
+}
+#endif
+
+TEST(TraceOutput, StdioOutputWritesInOrder) {
+    const std::string path = "stdio_output_unittest.bin";
+    {
+        auto output = TraceOutput::open(path, TraceOption::Output::kStdio);
+        ASSERT_TRUE(output);
+        EXPECT_TRUE(output->write("abc", 3));
+        EXPECT_TRUE(output->write("de", 2));
+    }
+    EXPECT_EQ(read_file(path), (std::vector<char>{'a', 'b', 'c', 'd', 'e'}));
+    std::remove(path.c_str());
+}
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "ring_buffer_log.h"
+#include "structlog.h"
+#include "trace_test_util.h"
+
+using namespace neon;
+
+namespace {
+
+struct TraceCounts {
+    std::uint64_t events{0};
+    std::uint64_t lost{0};
+    std::uint64_t markers{0};
+};
+
+TraceCounts read_counts(std::string const& path) {
+    TraceCounts counts;
+    counts.events =
+        read_records<format::EventRecord>(path, format::RecordType::kEvent)
+            .size();
+    for (auto const& lost : read_records<format::EventsLostRecord>(
+             path, format::RecordType::kEventsLost)) {
+        EXPECT_EQ(lost.tid, kTestTid);
+        EXPECT_LE(lost.after_ts, lost.before_ts);
+        counts.lost += lost.count;
+        ++counts.markers;
+    }
+    return counts;
+}
+
+}  // namespace
+
+class RingBufferOverflowTest
+    : public ::testing::TestWithParam<TraceOption::Overflow> {};
+
+// A burst far larger than the ring between two drains: what is not written
+// is marked as lost, nothing goes missing silently.
+TEST_P(RingBufferOverflowTest, AccountsForEveryEvent) {
+    const std::string path = "overflow_policy_ring.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("overflow", SourceLocation::current());
+    constexpr int kEvents = 20000;
+    std::uint64_t dropped;
+    TraceContention contention;
+    {
+        RingBufferLog::CreateOption option;
+        option.capacity = 64;
+        option.overflow = GetParam();
+        option.file_name = path;
+        // a blocked producer waits for the drainer's next round
+        option.drain_interval = std::chrono::milliseconds(
+            GetParam() == TraceOption::Overflow::kBlock ? 1 : 20);
+        option.output.kind = TraceOption::Output::kStdio;
+        RingBufferLog log{option};
+        for (int i = 0; i < kEvents; ++i) {
+            log.record(test_scope(site, 10 + i * 10, 1));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        dropped = log.dropped_events();
+        contention = log.contention();
+    }
+    const TraceCounts counts = read_counts(path);
+    EXPECT_EQ(counts.events + counts.lost, static_cast<std::uint64_t>(kEvents));
+    EXPECT_EQ(counts.lost, dropped);
+    if (GetParam() == TraceOption::Overflow::kBlock) {
+        EXPECT_EQ(counts.lost, 0u);
+        EXPECT_GT(contention.full_waits, 0u);
+    } else {
+        EXPECT_GT(counts.markers, 0u);
+        EXPECT_EQ(contention.full_waits, 0u);
+    }
+    std::remove(path.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Policies, RingBufferOverflowTest,
+    ::testing::Values(TraceOption::Overflow::kBlock,
+                      TraceOption::Overflow::kDropNewest,
+                      TraceOption::Overflow::kOverwriteOldest));
+
+TEST(StructLogOverflow, MarksDroppedEventsAtTheNextEvent) {
+    const std::string path = "overflow_policy_structlog.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("overflow", SourceLocation::current());
+    constexpr int kEvents = 20000;
+    std::uint64_t dropped;
+    TraceContention contention;
+    {
+        StructLog::CreateOption option;
+        option.file_name = path;
+        option.capacity = 16;
+        option.overflow = TraceOption::Overflow::kDropNewest;
+        option.output.kind = TraceOption::Output::kStdio;
+        StructLog log{option};
+        for (int i = 0; i < kEvents; ++i) {
+            log.record(test_scope(site, 10 + i * 10, 1));
+        }
+        // gets through once the queue has drained and carries the gap
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        log.record(test_scope(site, 10 + kEvents * 10, 1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        dropped = log.dropped_events();
+        contention = log.contention();
+    }
+    spdlog::shutdown();
+    const TraceCounts counts = read_counts(path);
+    EXPECT_EQ(counts.events + counts.lost,
+              static_cast<std::uint64_t>(kEvents + 1));
+    EXPECT_EQ(counts.lost, dropped);
+    // dropped only once the queue was full, never over-reserved
+    EXPECT_EQ(contention.queue_peak, 16u);
+    std::remove(path.c_str());
+}
+
+// kBlock loses nothing and counts the producers that waited for room
+TEST(StructLogOverflow, BlockCountsFullWaits) {
+    const std::string path = "overflow_policy_structlog_block.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("overflow", SourceLocation::current());
+    constexpr int kEvents = 20000;
+    std::uint64_t dropped;
+    TraceContention contention;
+    {
+        StructLog::CreateOption option;
+        option.file_name = path;
+        option.capacity = 16;
+        option.overflow = TraceOption::Overflow::kBlock;
+        option.output.kind = TraceOption::Output::kStdio;
+        StructLog log{option};
+        for (int i = 0; i < kEvents; ++i) {
+            log.record(test_scope(site, 10 + i * 10, 1));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        dropped = log.dropped_events();
+        contention = log.contention();
+    }
+    spdlog::shutdown();
+    const TraceCounts counts = read_counts(path);
+    EXPECT_EQ(counts.events, static_cast<std::uint64_t>(kEvents));
+    EXPECT_EQ(dropped, 0u);
+    EXPECT_GT(contention.full_waits, 0u);
+    EXPECT_EQ(contention.queue_peak, 16u);
+    std::remove(path.c_str());
+}
@@ -0,0 +1,73 @@
+#include "overwrite_ring.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using namespace neon;
+
+TEST(OverwriteRing, KeepsTheNewestRecords) {
+    OverwriteRing<int> ring{5};
+    EXPECT_EQ(ring.capacity(), 8u);
+    std::vector<int> values;
+    ring.snapshot(values);
+    EXPECT_TRUE(values.empty());
+
+    for (int i = 0; i < 3; ++i) {
+        ring.push(i);
+    }
+    ring.snapshot(values);
+    EXPECT_EQ(values, (std::vector<int>{0, 1, 2}));
+
+    for (int i = 3; i < 20; ++i) {
+        ring.push(i);
+    }
+    EXPECT_EQ(ring.pushed(), 20u);
+    ring.snapshot(values);
+    // the slot of 12 may be in the middle of the next push, so it is left out
+    EXPECT_EQ(values, (std::vector<int>{13, 14, 15, 16, 17, 18, 19}));
+}
+
+TEST(OverwriteRing, SnapshotsWhileTheProducerRuns) {
+    constexpr int kCount = 200000;
+    OverwriteRing<int> ring{64};
+    std::thread producer([&ring]() {
+        for (int i = 0; i < kCount; ++i) {
+            ring.push(i);
+        }
+    });
+    std::vector<int> values;
+    while (ring.pushed() < static_cast<std::uint64_t>(kCount)) {
+        ring.snapshot(values);
+        ASSERT_LT(values.size(), ring.capacity());
+        // never a torn or overwritten record: always a run of consecutive
+        // values
+        for (std::size_t i = 1; i < values.size(); ++i) {
+            ASSERT_EQ(values[i], values[i - 1] + 1);
+        }
+    }
+    producer.join();
+    ring.snapshot(values);
+    ASSERT_FALSE(values.empty());
+    EXPECT_EQ(values.back(), kCount - 1);
+}
+
+TEST(OverwriteRing, ReadsFromAPositionAndReportsTheGap) {
+    OverwriteRing<int> ring{8};
+    std::vector<int> values;
+    for (int i = 0; i < 5; ++i) {
+        ring.push(i);
+    }
+    EXPECT_EQ(ring.read_from(2, values), 2u);
+    EXPECT_EQ(values, (std::vector<int>{2, 3, 4}));
+    EXPECT_EQ(ring.read_from(5, values), 5u);
+    EXPECT_TRUE(values.empty());
+
+    for (int i = 5; i < 30; ++i) {
+        ring.push(i);
+    }
+    // 5 to 22 were overwritten, 22's slot is the one the next push reuses
+    EXPECT_EQ(ring.read_from(5, values), 23u);
+    EXPECT_EQ(values, (std::vector<int>{23, 24, 25, 26, 27, 28, 29}));
+}
@@ -0,0 +1,38 @@
+#if defined(__linux__)
+#include "platform/impl/linux/perf_event.h"
+
+#include <gtest/gtest.h>
+
+using namespace neon;
+
+// The task clock's times from the user page, read between two read()s of
+// the same event, lie between them. Without cap_user_time both go through
+// read(), which keeps the test meaningful only as a smoke test there.
+TEST(PerfEvent, UserPageTimesAgreeWithRead) {
+    auto event = PerfEvent::create(PerfEvent::TypeID::SOFTWARE,
+                                   PerfEvent::Config::SW_TASK_CLOCK,
+                                   PerfEvent::Domain::USER,
+                                   PerfEvent::ReadMode::kUserPage);
+    if (!event) {
+        GTEST_SKIP() << "perf_event_open is not permitted";
+    }
+    event->enable();
+    volatile std::uint64_t sink = 0;
+    for (int round = 0; round < 100; ++round) {
+        for (int i = 0; i < 10000; ++i) {
+            sink = sink + static_cast<std::uint64_t>(i);
+        }
+        PerfEvent::Count before{};
+        PerfEvent::Count page{};
+        PerfEvent::Count after{};
+        ASSERT_TRUE(event->now_syscall(before));
+        ASSERT_TRUE(event->now_times(page));
+        ASSERT_TRUE(event->now_syscall(after));
+        EXPECT_LE(before.time_enabled, page.time_enabled);
+        EXPECT_LE(page.time_enabled, after.time_enabled);
+        EXPECT_LE(before.time_running, page.time_running);
+        EXPECT_LE(page.time_running, after.time_running);
+    }
+    event->disable();
+}
+#endif
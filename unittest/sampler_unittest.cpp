@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "sampler.h"
+
+using namespace neon;
+
+TEST(Sampler, EveryNDropsNestedScopesWithTheirParent) {
+    TraceSampling every_third;
+    every_third.mode = TraceSampling::Mode::kEveryN;
+    every_third.period = 3;
+    TraceSetSampling("sampler_parent", every_third);
+    const TraceSiteId parent =
+        TraceRegisterSite("sampler_parent", SourceLocation::current());
+    const TraceSiteId child =
+        TraceRegisterSite("sampler_child", SourceLocation::current());
+
+    int recorded = 0;
+    for (int i = 0; i < 9; ++i) {
+        const std::uint32_t weight = Sampler::begin(parent, 1);
+        const std::uint32_t child_weight = Sampler::begin(child, weight);
+        EXPECT_EQ(child_weight != 0, weight != 0);
+        if (weight != 0) {
+            ++recorded;
+            EXPECT_EQ(weight, 3u);
+            EXPECT_EQ(child_weight, 3u);
+        }
+    }
+    EXPECT_EQ(recorded, 3);
+}
+
+TEST(Sampler, IndependentScopesDecideOnTheirOwn) {
+    TraceSampling never;
+    never.mode = TraceSampling::Mode::kEveryN;
+    never.period = 1000000;
+    TraceSetSampling("sampler_outer", never);
+    TraceSampling independent;
+    independent.independent = true;
+    TraceSetSampling("sampler_inner", independent);
+    const TraceSiteId outer =
+        TraceRegisterSite("sampler_outer", SourceLocation::current());
+    const TraceSiteId inner =
+        TraceRegisterSite("sampler_inner", SourceLocation::current());
+
+    // the first call is kept
+    EXPECT_NE(Sampler::begin(outer, 1), 0u);
+    const std::uint32_t weight = Sampler::begin(outer, 1);
+    EXPECT_EQ(weight, 0u);
+    EXPECT_EQ(Sampler::begin(inner, weight), 1u);
+}
+
+// inside a recorded parent too, the weight is the site's own period
+TEST(Sampler, IndependentScopesKeepTheirOwnWeight) {
+    TraceSampling every_third;
+    every_third.mode = TraceSampling::Mode::kEveryN;
+    every_third.period = 3;
+    TraceSetSampling("sampler_sampled_parent", every_third);
+    TraceSampling every_tenth;
+    every_tenth.mode = TraceSampling::Mode::kEveryN;
+    every_tenth.period = 10;
+    every_tenth.independent = true;
+    TraceSetSampling("sampler_independent_child", every_tenth);
+    const TraceSiteId parent =
+        TraceRegisterSite("sampler_sampled_parent", SourceLocation::current());
+    const TraceSiteId child = TraceRegisterSite("sampler_independent_child",
+                                                SourceLocation::current());
+
+    const int calls = 30000;
+    std::uint64_t estimates[2] = {0, 0};
+    for (int i = 0; i < calls; ++i) {
+        const std::uint32_t weight = Sampler::begin(parent, 1);
+        estimates[0] += weight;
+        estimates[1] += Sampler::begin(child, weight);
+    }
+    EXPECT_EQ(estimates[0], static_cast<std::uint64_t>(calls));
+    EXPECT_EQ(estimates[1], static_cast<std::uint64_t>(calls));
+}
+
+TEST(Sampler, PoissonWeightsAreUnbiased) {
+    TraceSampling poisson;
+    poisson.mode = TraceSampling::Mode::kPoisson;
+    poisson.period = 10;
+    TraceSetSampling("sampler_poisson", poisson);
+    const TraceSiteId site =
+        TraceRegisterSite("sampler_poisson", SourceLocation::current());
+
+    const int calls = 200000;
+    std::uint64_t estimate = 0;
+    for (int i = 0; i < calls; ++i) {
+        estimate += Sampler::begin(site, 1);
+    }
+    EXPECT_NEAR(static_cast<double>(estimate), calls, calls * 0.05);
+}
+
+// sites far apart in id keep their own counts
+TEST(Sampler, SitesDoNotShareState) {
+    TraceSampling every_eighth;
+    every_eighth.mode = TraceSampling::Mode::kEveryN;
+    every_eighth.period = 8;
+    TraceSetSampling("sampler_first", every_eighth);
+    TraceSetSampling("sampler_second", every_eighth);
+    const TraceSiteId first =
+        TraceRegisterSite("sampler_first", SourceLocation::current());
+    static std::deque<std::string> tags;
+    for (int i = 0; i < 255; ++i) {
+        tags.push_back("sampler_filler_" + std::to_string(i));
+        TraceRegisterSite(tags.back().c_str(), SourceLocation::current());
+    }
+    const TraceSiteId second =
+        TraceRegisterSite("sampler_second", SourceLocation::current());
+    ASSERT_EQ(second, first + 256);
+
+    std::uint64_t estimates[2] = {0, 0};
+    for (int i = 0; i < 8000; ++i) {
+        estimates[0] += Sampler::begin(first, 1);
+        estimates[1] += Sampler::begin(second, 1);
+    }
+    EXPECT_EQ(estimates[0], 8000u);
+    EXPECT_EQ(estimates[1], 8000u);
+}
+
+#if !defined(_WIN32)
+// Scopes left open by TraceDisable must not carry their weight, or their
+// sampled-out state, into the scopes after the next TraceEnable. Run in a
+// child: TraceEnable cannot be undone in this process.
+TEST(Sampler, ScopesOpenAcrossTraceDisableAreDropped) {
+    int result[2];
+    ASSERT_EQ(pipe(result), 0);
+    const pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        TraceOption option;
+        option.backend = TraceOption::Backend::kCallTree;
+        option.file_name = "sampler_unittest.bin";
+        option.latency_histograms = true;
+        option.overhead_sample_rate = 0;
+        option.sampling.mode = TraceSampling::Mode::kEveryN;
+        option.sampling.period = 2;
+        TraceEnable(option);
+        const TraceSiteId site =
+            TraceRegisterSite("sampler_reenabled", SourceLocation::current());
+        auto calls = [site](int count) {
+            for (int i = 0; i < count; ++i) {
+                TraceSectionBegin(site);
+                TraceSectionEnd(site);
+            }
+        };
+        calls(1);
+        // tracing turned off inside a sampled-out, then a recorded call
+        for (int i = 0; i < 2; ++i) {
+            TraceSectionBegin(site);
+            TraceDisable();
+            TraceEnable(option);
+            calls(100);
+        }
+        std::uint64_t count = 0;
+        for (TraceLatency const& latency : TraceLatencies()) {
+            if (std::strcmp(latency.tag, "sampler_reenabled") == 0) {
+                count = latency.count;
+            }
+        }
+        std::remove(option.file_name.c_str());
+        _exit(write(result[1], &count, sizeof(count)) == sizeof(count) ? 0
+                                                                         : 1);
+    }
+    close(result[1]);
+    std::uint64_t count = 0;
+    EXPECT_EQ(read(result[0], &count, sizeof(count)),
+              static_cast<ssize_t>(sizeof(count)));
+    close(result[0]);
+    int status = 0;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    // 101 calls recorded with weight 2, the two left open never end
+    EXPECT_EQ(count, 202u);
+}
+#endif
@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "scope_stack.h"
+
+using namespace neon;
+
+namespace {
+
+class CollectingRecorder : public Recorder {
+   public:
+    void record(TraceEvent const& event) override { events.push_back(event); }
+    std::vector<TraceEvent> events;
+};
+
+TraceEvent snapshot(TraceEvent::Type type, TraceSiteId site, std::int64_t ts,
+                    std::int64_t alloc = 0) {
+    TraceEvent event{type, site};
+    event.ts = ts;
+    event.allocated_heap_bytes = alloc;
+    return event;
+}
+
+void begin(TraceSiteId site, std::int64_t ts, std::int64_t alloc = 0) {
+    ScopeStack::begin(snapshot(TraceEvent::Type::kScopeBegin, site, ts, alloc));
+}
+
+void end(TraceSiteId site, std::int64_t ts, Recorder& recorder,
+         std::int64_t min_ticks = 0, std::int64_t alloc = 0) {
+    ScopeStack::end(
+        snapshot(TraceEvent::Type::kScopeComplete, site, ts, alloc),
+        min_ticks, false, recorder);
+}
+
+}  // namespace
+
+TEST(ScopeStack, RecordsOneCompleteEventPerScopeInEndOrder) {
+    CollectingRecorder recorder;
+    begin(1, 0, 100);
+    begin(2, 10, 110);
+    end(2, 30, recorder, 0, 150);
+    end(1, 50, recorder, 0, 160);
+
+    ASSERT_EQ(recorder.events.size(), 2u);
+    auto const& child = recorder.events[0];
+    EXPECT_EQ(child.type, TraceEvent::Type::kScopeComplete);
+    EXPECT_EQ(child.site, 2u);
+    EXPECT_EQ(child.depth, 1u);
+    EXPECT_EQ(child.ts, 10);
+    EXPECT_EQ(child.duration, 20);
+    EXPECT_EQ(child.allocated_heap_bytes, 40);
+    auto const& parent = recorder.events[1];
+    EXPECT_EQ(parent.site, 1u);
+    EXPECT_EQ(parent.depth, 0u);
+    EXPECT_EQ(parent.duration, 50);
+    EXPECT_EQ(parent.allocated_heap_bytes, 60);
+}
+
+TEST(ScopeStack, DropsShortScopesAndCountsThemInTheParent) {
+    const std::int64_t min_ticks = 100;
+    CollectingRecorder recorder;
+    begin(1, 0);
+    for (int i = 0; i < 3; ++i) {
+        begin(2, 10 + i * 10);
+        begin(3, 11 + i * 10);
+        end(3, 12 + i * 10, recorder, min_ticks);
+        end(2, 15 + i * 10, recorder, min_ticks);
+    }
+    EXPECT_TRUE(recorder.events.empty());
+    end(1, 500, recorder, min_ticks);
+
+    ASSERT_EQ(recorder.events.size(), 1u);
+    EXPECT_EQ(recorder.events[0].duration, 500);
+    EXPECT_EQ(recorder.events[0].filtered, 6u);
+}
+
+TEST(ScopeStack, HandlesUnmatchedEnds) {
+    CollectingRecorder recorder;
+    // begin never seen
+    end(7, 10, recorder);
+    EXPECT_TRUE(recorder.events.empty());
+
+    // the end of scope 2 was lost
+    begin(1, 0);
+    begin(2, 10);
+    end(1, 40, recorder);
+    ASSERT_EQ(recorder.events.size(), 1u);
+    EXPECT_EQ(recorder.events[0].site, 1u);
+    EXPECT_EQ(recorder.events[0].depth, 0u);
+    end(2, 50, recorder);
+    EXPECT_EQ(recorder.events.size(), 1u);
+}
+
+// what TraceEnable does: scopes left open while tracing was off are gone,
+// ended or not, and nothing after them nests in them
+TEST(ScopeStack, NewEpochDropsOpenScopes) {
+    CollectingRecorder recorder;
+    const std::int64_t min_ticks = 5;
+    begin(1, 0);
+    begin(2, 10);
+    end(2, 11, recorder, min_ticks);
+    ScopeStack::begin_sampled_out(3);
+    ScopeStack::new_epoch();
+    EXPECT_EQ(ScopeStack::parent_weight(), 1u);
+    EXPECT_FALSE(ScopeStack::end_sampled_out(3));
+    begin(4, 20);
+    end(4, 30, recorder);
+    end(1, 40, recorder);
+
+    ScopeStack::begin_sampled_out(5);
+    begin(6, 50);
+    ScopeStack::new_epoch();
+    end(6, 60, recorder);
+    EXPECT_FALSE(ScopeStack::end_sampled_out(5));
+    begin(7, 70);
+    end(7, 80, recorder);
+
+    ASSERT_EQ(recorder.events.size(), 2u);
+    EXPECT_EQ(recorder.events[0].site, 4u);
+    EXPECT_EQ(recorder.events[0].depth, 0u);
+    EXPECT_EQ(recorder.events[0].weight, 1u);
+    EXPECT_EQ(recorder.events[1].site, 7u);
+    EXPECT_EQ(recorder.events[1].depth, 0u);
+    EXPECT_EQ(recorder.events[1].filtered, 0u);
+}
+
+// deeper than the first allocation, and a fresh stack on another thread
+TEST(ScopeStack, GrowsAndIsPerThread) {
+    constexpr int kDepth = 100;
+    CollectingRecorder recorder;
+    for (int i = 0; i < kDepth; ++i) {
+        begin(100 + i, i);
+    }
+    std::thread other([] {
+        CollectingRecorder other_recorder;
+        end(100, 1000, other_recorder);
+        EXPECT_TRUE(other_recorder.events.empty());
+    });
+    other.join();
+    for (int i = kDepth - 1; i >= 0; --i) {
+        end(100 + i, 1000, recorder);
+    }
+    ASSERT_EQ(recorder.events.size(), static_cast<std::size_t>(kDepth));
+    for (int i = 0; i < kDepth; ++i) {
+        auto const& event = recorder.events[i];
+        EXPECT_EQ(event.site, static_cast<TraceSiteId>(100 + kDepth - 1 - i));
+        EXPECT_EQ(event.depth, static_cast<std::uint32_t>(kDepth - 1 - i));
+        EXPECT_EQ(event.duration, 1000 - (kDepth - 1 - i));
+    }
+}
+
+// a sampled-out scope is matched without a snapshot and keeps its children
+// at the depth of the recorded scopes
+TEST(ScopeStack, KeepsSampledOutScopes) {
+    CollectingRecorder recorder;
+    EXPECT_EQ(ScopeStack::parent_weight(), 1u);
+    begin(1, 0);
+    ScopeStack::begin_sampled_out(2);
+    EXPECT_EQ(ScopeStack::parent_weight(), 0u);
+    begin(3, 20);
+    end(3, 30, recorder);
+    EXPECT_FALSE(ScopeStack::end_sampled_out(1));
+    EXPECT_TRUE(ScopeStack::end_sampled_out(2));
+    // its end reaches end() if sampling was switched off inside it
+    ScopeStack::begin_sampled_out(2);
+    end(2, 40, recorder);
+    end(1, 50, recorder);
+
+    ASSERT_EQ(recorder.events.size(), 2u);
+    EXPECT_EQ(recorder.events[0].site, 3u);
+    EXPECT_EQ(recorder.events[0].depth, 1u);
+    EXPECT_EQ(recorder.events[1].site, 1u);
+    EXPECT_EQ(recorder.events[1].depth, 0u);
+}
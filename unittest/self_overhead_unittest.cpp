@@ -0,0 +1,126 @@
+#include "self_overhead.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "thread_info.h"
+#include "trace_reader.h"
+#include "trace_writer.h"
+
+using namespace neon;
+
+static SelfOverhead::Totals local_totals(SelfOverhead::Section section) {
+    const std::uint32_t tid = ThreadInfo::current().tid();
+    for (auto const& thread : SelfOverhead::totals()) {
+        if (thread.tid == tid) {
+            return thread.sections[section];
+        }
+    }
+    return SelfOverhead::Totals{};
+}
+
+TEST(SelfOverhead, CountsEveryCallAndMeasuresTheSampledOnes) {
+    SelfOverhead::enable(4, TraceOption::Clock::kSteady);
+    // the thread's countdown may be left over from another rate
+    for (int i = 0; i < 64; ++i) {
+        SelfOverhead::Probe probe{SelfOverhead::kScopeBegin};
+    }
+    const SelfOverhead::Totals before =
+        local_totals(SelfOverhead::kScopeBegin);
+    for (int i = 0; i < 400; ++i) {
+        SelfOverhead::Probe probe{SelfOverhead::kScopeBegin};
+    }
+    const SelfOverhead::Totals after = local_totals(SelfOverhead::kScopeBegin);
+    SelfOverhead::enable(0, TraceOption::Clock::kSteady);
+    EXPECT_EQ(after.calls - before.calls, 400u);
+    EXPECT_EQ(after.sampled - before.sampled, 100u);
+    EXPECT_GT(after.ticks, before.ticks);
+
+    // off: not even counted
+    for (int i = 0; i < 10; ++i) {
+        SelfOverhead::Probe probe{SelfOverhead::kScopeBegin};
+    }
+    EXPECT_EQ(local_totals(SelfOverhead::kScopeBegin).calls, after.calls);
+}
+
+TEST(SelfOverhead, ExitedThreadsAreFoldedIntoOneTotal) {
+    auto exited = [] {
+        for (auto const& thread : SelfOverhead::totals()) {
+            if (thread.tid == 0) {
+                return thread.sections[SelfOverhead::kMalloc].calls;
+            }
+        }
+        return std::uint64_t{0};
+    };
+    SelfOverhead::enable(4, TraceOption::Clock::kSteady);
+    const std::size_t threads = SelfOverhead::totals().size();
+    const std::uint64_t before = exited();
+    for (int i = 0; i < 8; ++i) {
+        std::thread([] {
+            for (int j = 0; j < 10; ++j) {
+                SelfOverhead::Probe probe{SelfOverhead::kMalloc};
+            }
+        }).join();
+    }
+    const std::size_t after = SelfOverhead::totals().size();
+    SelfOverhead::enable(0, TraceOption::Clock::kSteady);
+    EXPECT_LE(after, threads + 1);
+    EXPECT_EQ(exited() - before, 80u);
+}
+
+TEST(SelfOverhead, WriterEmitsTotalsAndASummary) {
+    const std::string path = "self_overhead_unittest.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("overhead", SourceLocation::current());
+    constexpr int kEvents = 1000;
+    SelfOverhead::enable(1, TraceOption::Clock::kSteady);
+    {
+        OutputOption output;
+        output.kind = TraceOption::Output::kStdio;
+        output.self_overhead = true;
+        auto writer = TraceWriter::open(path, ClockCalibration{}, 0, output);
+        ASSERT_TRUE(writer);
+        for (int i = 0; i < kEvents; ++i) {
+            TraceEvent event{TraceEvent::Type::kScopeComplete, site};
+            event.tid = 1;
+            event.ts = i * 10;
+            event.duration = 5;
+            writer->write(event);
+        }
+        writer->write_lost(1, 3, kEvents * 10, kEvents * 10 + 5);
+    }
+    SelfOverhead::enable(0, TraceOption::Clock::kSteady);
+
+    auto reader = format::TraceReader::open(path);
+    ASSERT_TRUE(reader) << reader.error();
+    const std::uint32_t tid = ThreadInfo::current().tid();
+    bool writer_totals = false;
+    int summaries = 0;
+    format::Record record;
+    while (reader->next(record)) {
+        if (record.type == format::RecordType::kOverhead) {
+            auto const& totals = record.as<format::OverheadRecord>();
+            if (totals.tid == tid &&
+                totals.section == format::OverheadSection::kWriter) {
+                writer_totals = true;
+                EXPECT_GE(totals.calls, static_cast<std::uint64_t>(kEvents));
+                EXPECT_GT(totals.sampled, 0u);
+            }
+        } else if (record.type == format::RecordType::kOverheadSummary) {
+            auto const& summary = record.as<format::OverheadSummaryRecord>();
+            ++summaries;
+            EXPECT_EQ(summary.events, static_cast<std::uint64_t>(kEvents));
+            EXPECT_EQ(summary.lost, 3u);
+            EXPECT_GT(summary.bytes, 0u);
+            EXPECT_GT(summary.overhead_ns, 0);
+            EXPECT_DOUBLE_EQ(summary.bytes_per_event,
+                             static_cast<double>(summary.bytes) / kEvents);
+        }
+    }
+    EXPECT_TRUE(writer_totals);
+    EXPECT_EQ(summaries, 1);
+    std::remove(path.c_str());
+}
@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+
+#include "site_registry.h"
+
+using namespace neon;
+
+TEST(SiteRegistry, TagFilterUpdatesSiteState) {
+    static TraceSite order{"order_matching_book", SourceLocation::current()};
+    static TraceSite risk{"risk_check", SourceLocation::current()};
+    const TraceSiteId order_id = TraceSiteState(order);
+    const TraceSiteId risk_id = TraceSiteState(risk);
+    EXPECT_EQ(order_id & kTraceSiteDisabled, 0u);
+    EXPECT_EQ(risk_id & kTraceSiteDisabled, 0u);
+
+    TraceSetTagFilter("-*,order_matching*");
+    EXPECT_EQ(TraceSiteState(order), order_id);
+    EXPECT_EQ(TraceSiteState(risk), risk_id | kTraceSiteDisabled);
+    EXPECT_TRUE(SiteRegistry::inst().enabled(order_id));
+    EXPECT_FALSE(SiteRegistry::inst().enabled(risk_id));
+
+    // sites registered later follow the filter too
+    static TraceSite late{"risk_late", SourceLocation::current()};
+    EXPECT_NE(TraceSiteState(late) & kTraceSiteDisabled, 0u);
+    const TraceSiteId by_id =
+        TraceRegisterSite("order_matching_fill", SourceLocation::current());
+    EXPECT_TRUE(SiteRegistry::inst().enabled(by_id));
+
+    // the newest matching rule wins
+    TraceSetTagEnabled("risk_check", true);
+    EXPECT_EQ(TraceSiteState(risk), risk_id);
+    TraceSetTagEnabled("order_matching*", false);
+    EXPECT_EQ(TraceSiteState(order), order_id | kTraceSiteDisabled);
+
+    TraceSetTagFilter("");
+    EXPECT_EQ(TraceSiteState(order), order_id);
+    EXPECT_EQ(TraceSiteState(late) & kTraceSiteDisabled, 0u);
+}
@@ -0,0 +1,47 @@
+#include "spsc_ring.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+using namespace neon;
+
+TEST(SpscRing, RoundsCapacityAndRejectsWhenFull) {
+    SpscRing<int> ring{5};
+    EXPECT_EQ(ring.capacity(), 8u);
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_TRUE(ring.try_push(i));
+    }
+    EXPECT_FALSE(ring.try_push(8));
+
+    int value = -1;
+    EXPECT_TRUE(ring.try_pop(value));
+    EXPECT_EQ(value, 0);
+    EXPECT_TRUE(ring.try_push(8));
+}
+
+TEST(SpscRing, PreservesOrderAcrossThreads) {
+    constexpr int kCount = 100000;
+    SpscRing<int> ring{64};
+    std::thread producer([&ring]() {
+        for (int i = 0; i < kCount;) {
+            if (ring.try_push(i)) {
+                ++i;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    int expected = 0;
+    while (expected < kCount) {
+        auto consumed = ring.consume_all([&expected](int value) {
+            EXPECT_EQ(value, expected);
+            ++expected;
+        });
+        if (consumed == 0) {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    EXPECT_TRUE(ring.empty());
+}
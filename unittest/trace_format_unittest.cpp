@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "trace_reader.h"
+#include "trace_writer.h"
+
+using namespace neon;
+
+TEST(TraceFormat, WriterOutputRoundTripsThroughReader) {
+    const std::string path = "trace_format_unittest.bin";
+    const Location loc = SourceLocation::current();
+    const TraceSiteId site = TraceRegisterSite("scope", loc);
+    EXPECT_EQ(TraceRegisterSite("scope", loc), site);
+    {
+        auto writer = TraceWriter::open(
+            path, ClockCalibration{},
+            HardwareCounters::kCycles | HardwareCounters::kInstructions);
+        ASSERT_TRUE(writer);
+        // begins stay on the shadow stack and are never written
+        TraceEvent begin{TraceEvent::Type::kScopeBegin, site};
+        writer->write(begin);
+        TraceEvent scope{TraceEvent::Type::kScopeComplete, site};
+        scope.tid = 7;
+        scope.depth = 2;
+        scope.ts = 100;
+        scope.duration = 150;
+        scope.task_clock_ns = 90;
+        scope.allocated_heap_bytes = 16;
+        scope.counters.cycles = 1200;
+        scope.counters.instructions = 3000;
+        writer->write(scope);
+    }
+
+    auto reader = format::TraceReader::open(path);
+    ASSERT_TRUE(reader) << reader.error();
+    EXPECT_EQ(reader->header().clock, format::ClockSource::kSteady);
+    EXPECT_EQ(reader->header().counters,
+              format::kCycles | format::kInstructions);
+    format::Record record;
+    ASSERT_TRUE(reader->next(record));
+    ASSERT_EQ(record.type, format::RecordType::kEvent);
+    auto const& scope = record.as<format::EventRecord>();
+    EXPECT_EQ(scope.type, format::EventType::kScopeComplete);
+    ASSERT_EQ(scope.site_id, site);
+    auto const* site_record = reader->site(scope.site_id);
+    ASSERT_TRUE(site_record);
+    EXPECT_EQ(reader->string(site_record->tag_id), "scope");
+    EXPECT_EQ(reader->string(site_record->file_id), loc.filename());
+    EXPECT_EQ(site_record->line, loc.line());
+    EXPECT_EQ(scope.tid, 7u);
+    EXPECT_EQ(scope.depth, 2u);
+    EXPECT_EQ(scope.ts, 100);
+    EXPECT_EQ(scope.duration, 150);
+    EXPECT_EQ(scope.task_clock_ns, 90);
+    EXPECT_EQ(scope.allocated_heap_bytes, 16);
+    EXPECT_EQ(scope.cycles, 1200u);
+    EXPECT_EQ(scope.instructions, 3000u);
+    ASSERT_TRUE(reader->next(record));
+    EXPECT_EQ(record.type, format::RecordType::kClockSync);
+    EXPECT_FALSE(reader->next(record));
+    EXPECT_FALSE(reader->truncated());
+    std::remove(path.c_str());
+}
+
+TEST(TraceFormat, EventsKeepTheirThreadOrderAcrossBlocks) {
+    const std::string path = "trace_format_blocks.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("block", SourceLocation::current());
+    constexpr int kEvents = 300;
+    {
+        auto writer = TraceWriter::open(path, ClockCalibration{});
+        ASSERT_TRUE(writer);
+        for (int i = 0; i < kEvents; ++i) {
+            TraceEvent event{TraceEvent::Type::kScopeComplete, site};
+            event.tid = 1 + i % 2;
+            event.ts = i * 10;
+            event.duration = 5;
+            writer->write(event);
+        }
+        // thread 1 and 2 grew since the last flush, their blocks stay
+        // open until the next one
+        writer->flush();
+    }
+
+    auto reader = format::TraceReader::open(path);
+    ASSERT_TRUE(reader) << reader.error();
+    std::int64_t last_ts[3] = {-1, -1, -1};
+    int count = 0;
+    format::Record record;
+    while (reader->next(record)) {
+        if (record.type != format::RecordType::kEvent) {
+            continue;
+        }
+        auto const& event = record.as<format::EventRecord>();
+        ASSERT_TRUE(event.tid == 1 || event.tid == 2);
+        EXPECT_GT(event.ts, last_ts[event.tid]);
+        EXPECT_EQ(event.ts % 20, (event.tid - 1) * 10);
+        EXPECT_EQ(event.weight, 1u);
+        last_ts[event.tid] = event.ts;
+        ++count;
+    }
+    EXPECT_EQ(count, kEvents);
+    std::remove(path.c_str());
+}
+
+#if !defined(_WIN32)
+// by compression threads
+class CrashedMappedFileTest : public ::testing::TestWithParam<unsigned> {};
+
+TEST_P(CrashedMappedFileTest, ReaderStopsAtTheTail) {
+    const std::string path = "trace_format_crashed.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("crashed", SourceLocation::current());
+    // compressed, only whole blocks reach the file; enough for several
+    const int events_written = GetParam() == 0 ? 1 : 400000;
+    // the writer exits without its destructors, which cut off the
+    // preallocated tail
+    const pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        OutputOption output;
+        output.kind = TraceOption::Output::kMappedFile;
+        output.compression_threads = GetParam();
+        auto writer = TraceWriter::open(path, ClockCalibration{}, 0, output);
+        if (writer) {
+            for (int i = 0; i < events_written; ++i) {
+                TraceEvent scope{TraceEvent::Type::kScopeComplete, site};
+                scope.tid = 3;
+                scope.ts = 100 + i * 10;
+                scope.duration = 50 + i % 1000;
+                writer->write(scope);
+                if (i % 1000 == 999) {
+                    writer->flush();
+                }
+            }
+            writer->flush();
+            writer->flush();
+        }
+        _exit(writer ? 0 : 1);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    auto reader = format::TraceReader::open(path);
+    ASSERT_TRUE(reader) << reader.error();
+    format::Record record;
+    int events = 0;
+    while (reader->next(record)) {
+        ASSERT_NE(static_cast<int>(record.type), 0);
+        if (record.type == format::RecordType::kEvent) {
+            EXPECT_EQ(record.as<format::EventRecord>().site_id, site);
+            ++events;
+        }
+    }
+    if (GetParam() == 0) {
+        EXPECT_EQ(events, events_written);
+    } else {
+        EXPECT_GT(events, 0);
+        EXPECT_LT(events, events_written);
+    }
+    EXPECT_TRUE(reader->truncated());
+    std::remove(path.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(TraceFormat, CrashedMappedFileTest,
+                         ::testing::Values(0u, 1u));
+#endif
+
+TEST(TraceFormat, RejectsForeignFiles) {
+    const std::string path = "trace_format_unittest.txt";
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    std::fputs("[\n{}]", file);
+    std::fclose(file);
+    EXPECT_FALSE(format::TraceReader::open(path));
+    std::remove(path.c_str());
+}
+
+TEST(TraceFormat, TickConverterPrefersSyncPoint) {
+    format::FileHeader header;
+    header.base_ticks = 1000;
+    header.base_ns = 50;
+    header.ns_per_tick = 0.5;
+    format::TickConverter ticks{header};
+    EXPECT_EQ(ticks.to_ns(3000), 1050);
+    ticks.refine(format::ClockSyncRecord{5000, 1250});
+    EXPECT_EQ(ticks.to_ns(3000), 650);
+    EXPECT_EQ(ticks.duration_ns(400), 120);
+}
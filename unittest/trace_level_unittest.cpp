@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+
+#include <type_traits>
+
+// only category bit 0 is compiled into this file
+#undef CXXTRACE_CATEGORIES
+#define CXXTRACE_CATEGORIES 0x1u
+#include "cxxtrace/cxxtrace.h"
+#include "jump_label.h"
+#include "site_registry.h"
+
+using namespace neon;
+
+static_assert(std::is_empty<TraceLevelScope<false>>::value,
+              "a compiled out scope must not take space");
+static_assert(!TraceCompiledIn(TraceLevel::kInfo, 0x2u),
+              "category outside CXXTRACE_CATEGORIES");
+
+TEST(TraceLevel, CompiledOutScopesRegisterNothing) {
+    // sites register the first time they are passed with the key enabled
+    ASSERT_TRUE(JumpLabel::set(true));
+    const TraceSiteId before = SiteRegistry::inst().end_id();
+    for (int i = 0; i < 3; ++i) {
+        TRACE_SCOPE_L(kInfo, 0x2u, level_compiled_out);
+    }
+    EXPECT_EQ(SiteRegistry::inst().end_id(), before);
+    TRACE_SCOPE_L(kInfo, 0x1u, level_compiled_in);
+    EXPECT_EQ(SiteRegistry::inst().end_id(), before + 1);
+    JumpLabel::set(false);
+}
+
+TEST(TraceLevel, RuntimeFilter) {
+    EXPECT_TRUE(TraceLevelEnabled(TraceLevel::kVerbose, 0x4u));
+    TraceSetLevel(TraceLevel::kDebug);
+    EXPECT_FALSE(TraceLevelEnabled(TraceLevel::kVerbose, 0x4u));
+    EXPECT_TRUE(TraceLevelEnabled(TraceLevel::kDebug, 0x4u));
+    TraceSetCategories(0x3u);
+    EXPECT_FALSE(TraceLevelEnabled(TraceLevel::kInfo, 0x4u));
+    EXPECT_TRUE(TraceLevelEnabled(TraceLevel::kInfo, 0x6u));
+    TraceSetLevel(TraceLevel::kVerbose);
+    TraceSetCategories(kTraceAllCategories);
+}
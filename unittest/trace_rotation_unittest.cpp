@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "trace_test_util.h"
+#include "trace_writer.h"
+
+using namespace neon;
+
+static bool file_exists(std::string const& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file) {
+        std::fclose(file);
+    }
+    return file != nullptr;
+}
+
+static std::uint64_t file_size(std::string const& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return 0;
+    }
+    std::fseek(file, 0, SEEK_END);
+    const long size = std::ftell(file);
+    std::fclose(file);
+    return static_cast<std::uint64_t>(size);
+}
+
+// stands for a file an earlier run rotated out
+static void write_file(std::string const& path, std::size_t size) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    std::string bytes(size, 'x');
+    std::fwrite(bytes.data(), 1, bytes.size(), file);
+    std::fclose(file);
+}
+
+// Counts the events of one file, checking that each resolves its site and
+// tag without any other file.
+static int count_events(std::string const& path, std::string const& tag) {
+    int events = 0;
+    EXPECT_TRUE(for_each_record(
+        path, format::RecordType::kEvent,
+        [&](format::TraceReader& reader, format::Record const& record) {
+            auto const& event = record.as<format::EventRecord>();
+            auto const* site = reader.site(event.site_id);
+            EXPECT_TRUE(site) << path;
+            if (site) {
+                EXPECT_EQ(reader.string(site->tag_id), tag);
+            }
+            ++events;
+        }))
+        << path;
+    return events;
+}
+
+static void write_events(TraceWriter& writer, TraceSiteId site, int count) {
+    for (int i = 0; i < count; ++i) {
+        writer.write(test_scope(site, i * 100, 50));
+    }
+}
+
+TEST(TraceRotation, EveryRotatedFileIsSelfContained) {
+    const std::string path = "trace_rotation_size.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("rotated", SourceLocation::current());
+    constexpr int kEvents = 20000;
+    OutputOption output;
+    output.kind = TraceOption::Output::kStdio;
+    output.rotate_bytes = 16 << 10;
+    {
+        auto writer = TraceWriter::open(path, ClockCalibration{}, 0, output);
+        ASSERT_TRUE(writer);
+        write_events(*writer, site, kEvents);
+    }
+    int events = count_events(path, "rotated");
+    int files = 1;
+    for (std::uint32_t n = 1;; ++n) {
+        const std::string rotated = NumberedFileName(path, n);
+        if (!file_exists(rotated)) {
+            break;
+        }
+        events += count_events(rotated, "rotated");
+        ++files;
+        std::remove(rotated.c_str());
+    }
+    EXPECT_GT(files, 3);
+    EXPECT_EQ(events, kEvents);
+    std::remove(path.c_str());
+}
+
+TEST(TraceRotation, RetentionDeletesTheOldestFiles) {
+    const std::string path = "trace_rotation_retention.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("retained", SourceLocation::current());
+    OutputOption output;
+    output.kind = TraceOption::Output::kStdio;
+    output.rotate_bytes = 16 << 10;
+    output.max_total_bytes = 64 << 10;
+    std::uint32_t rotations = 0;
+    {
+        auto writer = TraceWriter::open(path, ClockCalibration{}, 0, output);
+        ASSERT_TRUE(writer);
+        write_events(*writer, site, 20000);
+    }
+    std::uint64_t total = 0;
+    for (std::uint32_t n = 1; n < 1000; ++n) {
+        const std::string rotated = NumberedFileName(path, n);
+        if (file_exists(rotated)) {
+            rotations = n;
+            std::FILE* file = std::fopen(rotated.c_str(), "rb");
+            std::fseek(file, 0, SEEK_END);
+            total += std::ftell(file);
+            std::fclose(file);
+            std::remove(rotated.c_str());
+        }
+    }
+    EXPECT_GT(rotations, 4u);
+    EXPECT_FALSE(file_exists(NumberedFileName(path, 1)));
+    EXPECT_LE(total + output.rotate_bytes, output.max_total_bytes);
+    std::remove(path.c_str());
+}
+
+TEST(TraceRotation, RotatesByAge) {
+    const std::string path = "trace_rotation_age.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("aged", SourceLocation::current());
+    OutputOption output;
+    output.kind = TraceOption::Output::kStdio;
+    output.rotate_interval_ms = 1;
+    {
+        auto writer = TraceWriter::open(path, ClockCalibration{}, 0, output);
+        ASSERT_TRUE(writer);
+        write_events(*writer, site, 10);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        writer->flush();
+        write_events(*writer, site, 10);
+    }
+    const std::string rotated = NumberedFileName(path, 1);
+    EXPECT_EQ(count_events(rotated, "aged"), 10);
+    EXPECT_EQ(count_events(path, "aged"), 10);
+    std::remove(rotated.c_str());
+    std::remove(path.c_str());
+}
+
+TEST(TraceRotation, RetentionBoundsTheCurrentFileWhenRotatingByAge) {
+    const std::string path = "trace_rotation_age_retention.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("aged_retained", SourceLocation::current());
+    OutputOption output;
+    output.kind = TraceOption::Output::kStdio;
+    output.rotate_interval_ms = 1;
+    output.max_total_bytes = 32 << 10;
+    auto on_disk = [&path]() {
+        std::uint64_t total = file_size(path);
+        for (NumberedFile const& file : FindNumberedFiles(path)) {
+            total += file.size;
+        }
+        return total;
+    };
+    {
+        auto writer = TraceWriter::open(path, ClockCalibration{}, 0, output);
+        ASSERT_TRUE(writer);
+        for (int round = 0; round < 12; ++round) {
+            write_events(*writer, site, 2000);
+            // the second flush writes the blocks the first saw grow
+            writer->flush();
+            writer->flush();
+            EXPECT_LE(on_disk(), output.max_total_bytes) << round;
+            std::this_thread::sleep_for(std::chrono::milliseconds(3));
+        }
+    }
+    EXPECT_FALSE(file_exists(NumberedFileName(path, 1)));
+    for (NumberedFile const& file : FindNumberedFiles(path)) {
+        std::remove(file.name.c_str());
+    }
+    std::remove(path.c_str());
+}
+
+TEST(TraceRotation, ContinuesAfterTheFilesOfAnEarlierRun) {
+    const std::string path = "trace_rotation_restart.bin";
+    const TraceSiteId site =
+        TraceRegisterSite("restarted", SourceLocation::current());
+    write_file(NumberedFileName(path, 2), 30 << 10);
+    write_file(NumberedFileName(path, 5), 30 << 10);
+    OutputOption output;
+    output.kind = TraceOption::Output::kStdio;
+    output.rotate_interval_ms = 1;
+    output.rotate_bytes = 16 << 10;
+    output.max_total_bytes = 64 << 10;
+    {
+        auto writer = TraceWriter::open(path, ClockCalibration{}, 0, output);
+        ASSERT_TRUE(writer);
+        // with a full current file they would not fit, the older one goes
+        EXPECT_FALSE(file_exists(NumberedFileName(path, 2)));
+        EXPECT_EQ(file_size(NumberedFileName(path, 5)), 30u << 10);
+        write_events(*writer, site, 10);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        writer->flush();
+        write_events(*writer, site, 10);
+    }
+    EXPECT_EQ(count_events(NumberedFileName(path, 6), "restarted"), 10);
+    EXPECT_EQ(count_events(path, "restarted"), 10);
+    for (NumberedFile const& file : FindNumberedFiles(path)) {
+        std::remove(file.name.c_str());
+    }
+    std::remove(path.c_str());
+}
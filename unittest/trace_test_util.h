@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "trace_event.h"
+#include "trace_reader.h"
+
+namespace neon {
+
+// Events the tests record directly into a backend, as if from this thread.
+constexpr std::uint32_t kTestTid = 7;
+
+inline TraceEvent test_scope_begin(TraceSiteId site) {
+    TraceEvent event{TraceEvent::Type::kScopeBegin, site};
+    event.tid = kTestTid;
+    return event;
+}
+
+// half of the duration on the task clock
+inline TraceEvent test_scope(TraceSiteId site, std::int64_t ts,
+                             std::int64_t duration,
+                             std::int64_t allocated_heap_bytes = 0) {
+    TraceEvent event{TraceEvent::Type::kScopeComplete, site};
+    event.tid = kTestTid;
+    event.ts = ts;
+    event.duration = duration;
+    event.task_clock_ns = duration / 2;
+    event.allocated_heap_bytes = allocated_heap_bytes;
+    return event;
+}
+
+// Calls on_record(reader, record) for each record of the given type in the
+// file at path; false when it cannot be opened or ends truncated.
+template <typename OnRecord>
+bool for_each_record(std::string const& path, format::RecordType type,
+                     OnRecord on_record) {
+    auto reader = format::TraceReader::open(path);
+    if (!reader) {
+        return false;
+    }
+    format::Record record;
+    while (reader->next(record)) {
+        if (record.type == type) {
+            on_record(*reader, record);
+        }
+    }
+    return !reader->truncated();
+}
+
+// Empty when the file cannot be opened: a dump may not have been written yet.
+template <typename T>
+std::vector<T> read_records(std::string const& path, format::RecordType type) {
+    std::vector<T> records;
+    for_each_record(path, type,
+                    [&](format::TraceReader&, format::Record const& record) {
+                        records.push_back(record.as<T>());
+                    });
+    return records;
+}
+
+}  // namespace neon
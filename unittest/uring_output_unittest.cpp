@@ -0,0 +1,66 @@
+#include "uring_output.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace neon;
+
+#if defined(__linux__)
+static std::vector<char> read_file(std::string const& path) {
+    std::vector<char> bytes;
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return bytes;
+    }
+    char buffer[4096];
+    std::size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + n);
+    }
+    std::fclose(file);
+    return bytes;
+}
+
+// (use_io_uring, direct)
+class UringOutputTest
+    : public ::testing::TestWithParam<std::tuple<bool, bool>> {};
+
+TEST_P(UringOutputTest, WritesInOrderAndCutsThePadding) {
+    const std::string path = "uring_output_unittest.bin";
+    std::vector<char> expected;
+    {
+        UringOutput::CreateOption option;
+        option.buffer_size = UringOutput::kAlignment;
+        option.buffers = 3;
+        option.use_io_uring = std::get<0>(GetParam());
+        option.direct = std::get<1>(GetParam());
+        auto output = UringOutput::open(path, option);
+        ASSERT_TRUE(output);
+        if (!option.use_io_uring) {
+            EXPECT_FALSE(output->uses_io_uring());
+        }
+        std::vector<char> chunk(1000);
+        for (int i = 0; i < 100; ++i) {
+            for (std::size_t j = 0; j < chunk.size(); ++j) {
+                chunk[j] = static_cast<char>(i * 7 + j);
+            }
+            ASSERT_TRUE(output->write(chunk.data(), chunk.size()));
+            expected.insert(expected.end(), chunk.begin(), chunk.end());
+            output->flush();
+        }
+        // leaves a partial last buffer, padded under O_DIRECT
+        ASSERT_TRUE(output->write("tail", 4));
+        expected.insert(expected.end(), {'t', 'a', 'i', 'l'});
+    }
+    EXPECT_EQ(read_file(path), expected);
+    std::remove(path.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(Modes, UringOutputTest,
+                         ::testing::Combine(::testing::Bool(),
+                                            ::testing::Bool()));
+#endif